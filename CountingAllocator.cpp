@@ -0,0 +1,80 @@
+/*
+ *                    Copyright 2021 TrafficSignals.ai
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the "Software"), to deal in the Software 
+ * without restriction, including without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+ * permit persons to whom the Software is furnished to do so, subject to the following 
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+ * PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ * 
+ * For more information on this licence, please refer to: 
+ * https://opensource.org/licenses/MIT
+ * 
+ */
+
+
+/*
+    A replacement operator new counting allocations, linked only into 
+    console-allocations, for countAllocations, benchmarkReconnectStorm and 
+    benchmarkSendCopies. The console itself keeps the default allocator.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<std::size_t> allocationCount{0}; //!< Heap allocations made by the process.
+static thread_local std::size_t threadAllocatedBytes = 0; //!< Bytes allocated by this thread.
+
+/*!
+    \fn AllocationCount
+    \brief Gets the heap allocations made by the process so far.
+    \return the count.
+*/
+std::size_t AllocationCount()
+{
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+/*!
+    \fn ThreadAllocatedBytes
+    \brief Gets the bytes the calling thread has allocated so far.
+    \return the bytes.
+*/
+std::size_t ThreadAllocatedBytes()
+{
+    return threadAllocatedBytes;
+}
+
+void* operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    threadAllocatedBytes += size;
+    if (void* memory = std::malloc((size > 0) ? size : 1))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t /*size*/) noexcept
+{
+    std::free(memory);
+}
@@ -0,0 +1,186 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef BUFFERLIMITS_H
+#define BUFFERLIMITS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <queue>
+#include <string>
+
+/*!
+    \enum OverflowPolicy
+    \brief What a receive buffer does when a limit is reached.
+*/
+enum class OverflowPolicy
+{
+    DropOldest,     //!< Discard the oldest buffered messages to make room.
+    DropNewest,     //!< Discard the message that would exceed the limit.
+    Backpressure    //!< Stop reading until a consumer makes room, so TCP slows the sender.
+};
+
+/*!
+    \struct BufferLimits
+    \brief The caps applied to a receive buffer. A cap of 0 is unlimited.
+*/
+struct BufferLimits
+{
+    std::size_t maxBytes = 0; //!< The most bytes to hold.
+    std::size_t maxMessages = 0; //!< The most messages to hold.
+    OverflowPolicy policy = OverflowPolicy::DropOldest; //!< What to do when a cap is reached.
+
+    /*!
+    \fn Exceeded
+    \brief Returns if a buffer of this size is over either cap.
+    \return bool
+    */
+    bool Exceeded(std::size_t bytes, std::size_t messages) const
+    {
+        return ((maxBytes != 0) && (bytes > maxBytes)) || ((maxMessages != 0) && (messages > maxMessages));
+    }
+
+    /*!
+    \fn Full
+    \brief Returns if a buffer of this size has reached either cap.
+    \return bool
+    */
+    bool Full(std::size_t bytes, std::size_t messages) const
+    {
+        return ((maxBytes != 0) && (bytes >= maxBytes)) || ((maxMessages != 0) && (messages >= maxMessages));
+    }
+};
+
+/*!
+    \struct BufferStatistics
+    \brief A snapshot of a receive buffer's counters.
+*/
+struct BufferStatistics
+{
+    std::uint64_t messagesBuffered = 0; //!< Messages accepted into the buffer.
+    std::uint64_t messagesDroppedOldest = 0; //!< Messages discarded by DropOldest.
+    std::uint64_t messagesDroppedNewest = 0; //!< Messages discarded by DropNewest.
+    std::uint64_t bytesDropped = 0; //!< Bytes discarded by either drop policy.
+    std::uint64_t readsPaused = 0; //!< Times reading stopped under Backpressure.
+    std::size_t bytesHeld = 0; //!< Bytes currently held.
+    std::size_t messagesHeld = 0; //!< Messages currently held.
+};
+
+/*!
+    \class BufferCounters
+    \brief Counters for a receive buffer, safe to update and read from any thread.
+*/
+class BufferCounters
+{
+public:
+    std::atomic<std::uint64_t> messagesBuffered{0}; //!< Messages accepted into the buffer.
+    std::atomic<std::uint64_t> messagesDroppedOldest{0}; //!< Messages discarded by DropOldest.
+    std::atomic<std::uint64_t> messagesDroppedNewest{0}; //!< Messages discarded by DropNewest.
+    std::atomic<std::uint64_t> bytesDropped{0}; //!< Bytes discarded by either drop policy.
+    std::atomic<std::uint64_t> readsPaused{0}; //!< Times reading stopped under Backpressure.
+
+    /*!
+    \fn Snapshot
+    \brief Copy the counters, together with the buffer's current size.
+    \return the statistics.
+    */
+    BufferStatistics Snapshot(std::size_t bytesHeld, std::size_t messagesHeld) const
+    {
+        BufferStatistics statistics;
+        statistics.messagesBuffered = messagesBuffered;
+        statistics.messagesDroppedOldest = messagesDroppedOldest;
+        statistics.messagesDroppedNewest = messagesDroppedNewest;
+        statistics.bytesDropped = bytesDropped;
+        statistics.readsPaused = readsPaused;
+        statistics.bytesHeld = bytesHeld;
+        statistics.messagesHeld = messagesHeld;
+        return statistics;
+    }
+};
+
+/*!
+    \fn MessageSize
+    \brief Gets the bytes a buffered message counts against BufferLimits::maxBytes.
+    \return the size.
+*/
+inline std::size_t MessageSize(const std::string& message) { return message.size(); }
+
+/*!
+    \fn DropFront
+    \brief Remove the oldest message of a buffer.
+    \return void
+*/
+template <typename T> void DropFront(std::queue<T>& buffer) { buffer.pop(); }
+template <typename T> void DropFront(std::deque<T>& buffer) { buffer.pop_front(); } //!< \sa DropFront
+template <typename T> void DropFront(std::list<T>& buffer) { buffer.pop_front(); } //!< \sa DropFront
+
+/*!
+    \fn PushBack
+    \brief Add a message to the end of a buffer.
+    \return void
+*/
+template <typename T> void PushBack(std::queue<T>& buffer, T message) { buffer.push(std::move(message)); }
+template <typename T> void PushBack(std::deque<T>& buffer, T message) { buffer.push_back(std::move(message)); } //!< \sa PushBack
+template <typename T> void PushBack(std::list<T>& buffer, T message) { buffer.push_back(std::move(message)); } //!< \sa PushBack
+
+/*!
+    \fn PushBounded
+    \brief Add a message to a buffer, applying the drop policies.
+    \param buffer the buffer to add to.
+    \param message the message received.
+    \param bytes the bytes held by the buffer, updated.
+    \param messages the messages held by the buffer, updated. This may count
+           more than one buffer when they share a limit.
+    \param limits the caps and policy.
+    \param counters updated with what happened.
+    \note Under Backpressure the message is always added; the caller stops
+          reading while limits.Full() holds.
+    \warning The caller must hold the buffer's lock.
+    \return false if the message was dropped.
+*/
+template <typename Buffer>
+bool PushBounded(Buffer& buffer, typename Buffer::value_type message, std::size_t& bytes, std::size_t& messages, const BufferLimits& limits, BufferCounters& counters)
+{
+    if (limits.Exceeded(bytes + MessageSize(message), messages + 1))
+    {
+        if (limits.policy == OverflowPolicy::DropNewest)
+        {
+            counters.messagesDroppedNewest++;
+            counters.bytesDropped += MessageSize(message);
+            return false;
+        }
+
+        if (limits.policy == OverflowPolicy::DropOldest)
+        {
+            while (!buffer.empty() && limits.Exceeded(bytes + MessageSize(message), messages + 1))
+            {
+                std::size_t size = MessageSize(buffer.front());
+                DropFront(buffer);
+                bytes -= size;
+                messages--;
+                counters.messagesDroppedOldest++;
+                counters.bytesDropped += size;
+            }
+
+            if (limits.Exceeded(bytes + MessageSize(message), messages + 1)) // Nothing older left in this buffer.
+            {
+                counters.messagesDroppedNewest++;
+                counters.bytesDropped += MessageSize(message);
+                return false;
+            }
+        }
+    }
+
+    bytes += MessageSize(message);
+    messages++;
+    PushBack(buffer, std::move(message));
+    counters.messagesBuffered++;
+    return true;
+}
+
+#endif
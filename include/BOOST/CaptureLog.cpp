@@ -0,0 +1,289 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CAPTURELOG_H
+#define CAPTURELOG_H
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RingBuffer.cpp"
+#include "Log.cpp"
+
+/*!
+    \class CaptureLog
+    \brief Records received data to disk without blocking the network thread.
+
+    Responsability
+    --------------
+    Capture() copies the data into a preallocated slot of a lock-free ring
+    and returns; if the ring is full the data is dropped and counted, never
+    waited for. A background writer batches records and appends them to one
+    file, preallocated to its maximum size. When full the file is rotated:
+    path becomes path.1, path.1 becomes path.2 and so on.
+
+    Each record is a 4 byte length, an 8 byte timestamp in nanoseconds since
+    the epoch, both little endian as written by the host, then the data.
+
+    Collaboration
+    -------------
+    Used by ConnectionClient to capture its input for debugging.
+*/
+class CaptureLog
+{
+private:
+
+    /*!
+        \struct Record
+        \brief One captured read, held in a ring slot.
+    */
+    struct Record
+    {
+        std::int64_t timestamp; //!< Nanoseconds since the epoch.
+        std::string data; //!< The bytes captured, reusing the slot's capacity.
+    };
+
+    std::string _path; //!< The file written to.
+    std::size_t _fileSize; //!< Preallocated size, and the size at which to rotate.
+    int _files; //!< The number of files kept, including the current one.
+
+    SpscRing<Record> _ring; //!< Records awaiting the writer.
+    std::atomic<bool> _stopping{false}; //!< Set when the log is being destroyed.
+    std::thread _writer; //!< Drains _ring to disk.
+
+    std::atomic<std::uint64_t> _written{0}; //!< Records written.
+    std::atomic<std::uint64_t> _dropped{0}; //!< Records dropped as the ring was full or the file could not be written.
+
+    int _fd = -1; //!< The current file, only used by the writer.
+    std::size_t _offset = 0; //!< Bytes written to the current file, only used by the writer.
+
+    /*!
+    \fn Open
+    \brief Open a new current file and preallocate it.
+    \return false if the file could not be opened.
+    */
+    bool Open()
+    {
+        _fd = ::open(_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (_fd < 0)
+        {
+            LOG_ERROR("CaptureLog::Open ERROR: Unable to open " << _path << ": " << std::strerror(errno));
+            return false;
+        }
+
+        ::posix_fallocate(_fd, 0, _fileSize); // Best effort, the writes still succeed without it.
+        _offset = 0;
+        return true;
+    }
+
+    /*!
+    \fn Close
+    \brief Trim the preallocated space after the last record and close the current file.
+    \return void
+    */
+    void Close()
+    {
+        if (_fd >= 0)
+        {
+            if (::ftruncate(_fd, _offset) != 0)
+            {
+                LOG_ERROR("CaptureLog::Close ERROR: Unable to trim " << _path);
+            }
+            ::close(_fd);
+            _fd = -1;
+        }
+    }
+
+    /*!
+    \fn Rotate
+    \brief Close the current file, shift the older files along and open a new one.
+    \return false if the new file could not be opened.
+    */
+    bool Rotate()
+    {
+        Close();
+
+        for (int i = _files - 1; i > 0; i--)
+        {
+            std::string from = (i == 1) ? _path : _path + "." + std::to_string(i - 1);
+            std::string to = _path + "." + std::to_string(i);
+            std::rename(from.c_str(), to.c_str());
+        }
+
+        return Open();
+    }
+
+    /*!
+    \fn Flush
+    \brief Write a batch to the current file, rotating first if it would not fit.
+    \param batch the records to write, cleared once written.
+    \param records the number of records in the batch.
+    \return void
+    */
+    void Flush(std::vector<char>& batch, std::uint64_t records)
+    {
+        if (batch.empty())
+        {
+            return;
+        }
+
+        if ((_offset > 0) && (_offset + batch.size() > _fileSize))
+        {
+            Rotate();
+        }
+
+        std::size_t done = 0;
+        while ((_fd >= 0) && (done < batch.size()))
+        {
+            ssize_t result = ::pwrite(_fd, batch.data() + done, batch.size() - done, _offset + done);
+            if (result <= 0)
+            {
+                break;
+            }
+            done += result;
+        }
+
+        if (done == batch.size())
+        {
+            _written += records;
+        }
+        else
+        {
+            _dropped += records;
+        }
+        _offset += done;
+        batch.clear();
+    }
+
+    /*!
+    \fn Write
+    \brief Drain the ring to disk in batches until stopped.
+    \warning Called on the writer thread.
+    \return void
+    */
+    void Write()
+    {
+        const std::size_t batchSize = 64 * 1024;
+        std::vector<char> batch;
+        batch.reserve(batchSize * 2);
+
+        Open();
+
+        while (true)
+        {
+            std::uint64_t records = 0;
+            while ((batch.size() < batchSize) && _ring.TryPop([&batch](Record& record)
+            {
+                std::uint32_t length = record.data.size();
+                const char* header[] = { reinterpret_cast<const char*>(&length), reinterpret_cast<const char*>(&record.timestamp) };
+                batch.insert(batch.end(), header[0], header[0] + sizeof(length));
+                batch.insert(batch.end(), header[1], header[1] + sizeof(record.timestamp));
+                batch.insert(batch.end(), record.data.begin(), record.data.end());
+            }))
+            {
+                records++;
+            }
+
+            Flush(batch, records);
+
+            if (records == 0)
+            {
+                if (_stopping)
+                {
+                    break;
+                }
+                std::this_thread::sleep_for (std::chrono::milliseconds(5)); // Nothing to write.
+            }
+        }
+
+        Close();
+    }
+
+public:
+
+    /*!
+    \fn CaptureLog
+    \brief Start the writer.
+    \param path the file to write, rotated to path.1, path.2...
+    \param fileSize the size to preallocate and rotate at.
+    \param files the number of files kept, including the current one.
+    \param depth the most records held awaiting the writer.
+    \return void
+    */
+    CaptureLog(std::string path, std::size_t fileSize = 64 * 1024 * 1024, int files = 4, std::size_t depth = 4096)
+        : _path(path), _fileSize(fileSize), _files(files), _ring(depth)
+    {
+        _writer = std::thread(&CaptureLog::Write, this);
+    }
+
+    /*!
+    \fn ~CaptureLog
+    \brief Write everything captured, then stop the writer.
+    \return void
+    */
+    ~CaptureLog()
+    {
+        _stopping = true;
+        _writer.join();
+    }
+
+    /*!
+    \fn Capture
+    \brief Queue data to be written with the current time.
+    \param data the bytes to capture.
+    \param length the number of bytes.
+    \note Never blocks. Only call from one thread, e.g. the receive thread.
+    \return false if the data was dropped as the writer is behind.
+    */
+    bool Capture(const char* data, std::size_t length)
+    {
+        std::int64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+
+        bool queued = _ring.TryPush([data, length, timestamp](Record& record)
+        {
+            record.timestamp = timestamp;
+            record.data.assign(data, length);
+        });
+
+        if (!queued)
+        {
+            _dropped++;
+        }
+        return queued;
+    }
+
+    /*!
+    \fn Written
+    \brief Gets the number of records written.
+    \return the count.
+    */
+    std::uint64_t Written()
+    {
+        return _written;
+    }
+
+    /*!
+    \fn Dropped
+    \brief Gets the number of records dropped.
+    \return the count.
+    */
+    std::uint64_t Dropped()
+    {
+        return _dropped;
+    }
+};
+
+#endif
@@ -0,0 +1,946 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CHANNEL_MUX_H
+#define CHANNEL_MUX_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include <boost/asio.hpp>
+
+#include "asyncClientTCP.cpp"
+#include "asyncServerTCP.cpp"
+
+/*!
+    \enum ChannelFrameKind
+    \brief What a channel frame carries.
+*/
+enum class ChannelFrameKind : char
+{
+    Data = 'D',     //!< A message for the channel.
+    Credit = 'C'    //!< Bytes the receiver has consumed, so the sender may send as many more.
+};
+
+/*!
+    \class ChannelHeader
+    \brief Carries the channel of a message ahead of it, inside the frame.
+
+    Responsability
+    --------------
+    Each frame starts with the channel, 2 bytes big-endian, and its kind, 1
+    byte. The header is binary, so it needs a framing that keeps the whole
+    message whatever its bytes, i.e. LengthPrefixFraming, where it follows
+    the length: [length:4][channel:2][kind:1][message].
+
+    Collaboration
+    -------------
+    Used by ChannelMux.
+*/
+class ChannelHeader
+{
+public:
+    static constexpr std::size_t HeaderSize = 3; //!< The bytes ahead of the message.
+
+    /*!
+    \fn Encode
+    \brief Put the header ahead of a message.
+    \return the frame to send.
+    */
+    static std::string Encode(std::uint16_t channel, ChannelFrameKind kind, const std::string& message)
+    {
+        std::string frame;
+        frame.reserve(HeaderSize + message.size());
+        frame += static_cast<char>(channel >> 8);
+        frame += static_cast<char>(channel & 0xFF);
+        frame += static_cast<char>(kind);
+        frame += message;
+        return frame;
+    }
+
+    /*!
+    \fn Decode
+    \brief Take the header off a frame.
+    \param frame the frame received, left with the message.
+    \param channel set to the channel.
+    \param kind set to the kind.
+    \return false if the frame is too short for a header, leaving it unchanged.
+    */
+    static bool Decode(std::string& frame, std::uint16_t& channel, ChannelFrameKind& kind)
+    {
+        if (frame.size() < HeaderSize)
+        {
+            return false;
+        }
+        channel = static_cast<std::uint16_t>((static_cast<unsigned char>(frame[0]) << 8) | static_cast<unsigned char>(frame[1]));
+        kind = static_cast<ChannelFrameKind>(frame[2]);
+        frame.erase(0, HeaderSize);
+        return true;
+    }
+
+    /*!
+    \fn EncodeCredit
+    \brief Build a frame granting credit on a channel.
+    \return the frame to send.
+    */
+    static std::string EncodeCredit(std::uint16_t channel, std::uint32_t bytes)
+    {
+        std::string grant(4, '\0');
+        for (std::size_t i = 0; i < 4; i++)
+        {
+            grant[i] = static_cast<char>((bytes >> (8 * (3 - i))) & 0xFF);
+        }
+        return Encode(channel, ChannelFrameKind::Credit, grant);
+    }
+
+    /*!
+    \fn DecodeCredit
+    \brief Read the bytes granted by a credit frame, once decoded.
+    \return the bytes, 0 if malformed.
+    */
+    static std::uint32_t DecodeCredit(const std::string& grant)
+    {
+        if (grant.size() != 4)
+        {
+            return 0;
+        }
+        std::uint32_t bytes = 0;
+        for (std::size_t i = 0; i < 4; i++)
+        {
+            bytes = (bytes << 8) | static_cast<unsigned char>(grant[i]);
+        }
+        return bytes;
+    }
+};
+
+/*!
+    \struct ChannelStatistics
+    \brief What one channel of a ChannelMux has done.
+*/
+struct ChannelStatistics
+{
+    std::uint64_t sent = 0; //!< Messages written.
+    std::uint64_t received = 0; //!< Messages received.
+    std::uint64_t stalls = 0; //!< Messages that had to wait for credit.
+    std::size_t waiting = 0; //!< Messages waiting for credit.
+    std::size_t buffered = 0; //!< Messages received, not yet taken.
+    std::int64_t credit = 0; //!< The bytes that may be sent before the receiver grants more.
+};
+
+/*!
+    \class ChannelMux
+    \brief Logical channels over one connection, each with its own queue and
+           its own flow control.
+
+    Responsability
+    --------------
+    Messages are sent with a ChannelHeader giving their channel, and routed
+    on receipt to the channel's handler or, if it has none, its own buffer,
+    so detections, health and configuration share one socket, one thread
+    and one reconnect rather than each having their own.
+
+    Flow control is by credit, as in HTTP/2: a sender may have at most a
+    window of bytes on a channel that the receiver has not yet consumed,
+    and waits for the receiver to grant more. The receiver grants what it
+    has consumed once that is half the window, in Control frames, so grants
+    are not held behind bulk data. A channel whose receiver is slow stops
+    at its window, at the sender, rather than filling the connection's
+    buffers, so the receiver never pauses reading the socket and the other
+    channels keep flowing.
+
+    Both ends of a connection must use a ChannelMux with the same window. If
+    the connection is replaced, Reset() starts the credit again, as the
+    peer's ChannelMux is new.
+
+    Collaboration
+    -------------
+    Used by asyncChannelClientTCP and asyncChannelServerTCP. ServerTCP
+    streams are already split by element tag, see ConnectionClient::Subscribe.
+    \sa ChannelHeader()
+*/
+class ChannelMux
+{
+public:
+    typedef std::function<void(std::string, TrafficClass)> Writer; //!< Sends a frame on the connection. Must not call back into the ChannelMux.
+    typedef std::function<void(std::string&)> Handler; //!< Receives each message of a channel.
+
+    static constexpr std::uint32_t DefaultWindow = 256 * 1024; //!< The unconsumed bytes each channel may have in flight.
+
+    /*!
+    \fn ChannelMux
+    \brief Channels are created as they are first used.
+    \param write sends a frame on the connection.
+    \param window the unconsumed bytes each channel may have in flight, the same at both ends.
+    \return void
+    */
+    explicit ChannelMux(Writer write, std::uint32_t window = DefaultWindow)
+        : _write(std::move(write)), _window(window)
+    {
+    }
+
+    /*!
+    \fn Handle
+    \brief Pass each message of a channel to a handler, rather than buffering it.
+    \param handler called on the receiving thread; credit is granted once it returns.
+    \return void
+    */
+    void Handle(std::uint16_t channel, Handler handler)
+    {
+        std::lock_guard<std::mutex> channelGuard(_mx);
+        Find(channel).handler = std::make_shared<Handler>(std::move(handler));
+    }
+
+    /*!
+    \fn Send
+    \brief Send a message on a channel, or queue it until the receiver grants credit.
+    \param traffic the message's class.
+    \note Safe to call from any thread; messages of a channel are written in order.
+    \return false if the message must wait for credit.
+    */
+    bool Send(std::uint16_t channel, std::string message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        std::lock_guard<std::mutex> channelGuard(_mx);
+        Channel& found = Find(channel);
+        if ((found.credit <= 0) || !found.waiting.empty())
+        {
+            found.waiting.emplace_back(std::move(message), traffic);
+            found.stalls++;
+            return false;
+        }
+
+        WriteLocked(channel, found, message, traffic);
+        return true;
+    }
+
+    /*!
+    \fn Received
+    \brief Route a frame received on the connection.
+    \note Call from one thread at a time, in the order frames were received.
+    \return void
+    */
+    void Received(std::string frame)
+    {
+        std::uint16_t channel;
+        ChannelFrameKind kind;
+        if (!ChannelHeader::Decode(frame, channel, kind))
+        {
+            LOG_ERROR("ChannelMux::Received ERROR: Frame without a channel header, discarded.");
+            return;
+        }
+
+        std::unique_lock<std::mutex> channelGuard(_mx);
+        Channel& found = Find(channel);
+
+        if (kind == ChannelFrameKind::Credit)
+        {
+            found.credit += ChannelHeader::DecodeCredit(frame);
+            while ((found.credit > 0) && !found.waiting.empty())
+            {
+                WriteLocked(channel, found, found.waiting.front().first, found.waiting.front().second);
+                found.waiting.pop_front();
+            }
+            return;
+        }
+
+        found.received++;
+        if (!found.handler)
+        {
+            found.inbox.push_back(std::move(frame));
+            found.ready.notify_one();
+            return;
+        }
+
+        std::shared_ptr<Handler> handler = found.handler;
+        channelGuard.unlock();
+
+        std::size_t size = frame.size();
+        (*handler)(frame);
+
+        channelGuard.lock();
+        ConsumedLocked(channel, Find(channel), size);
+    }
+
+    /*!
+    \fn TryReceive
+    \brief Take the oldest buffered message of a channel, if any, without waiting.
+    \return false if none is buffered.
+    */
+    bool TryReceive(std::uint16_t channel, std::string& message)
+    {
+        std::lock_guard<std::mutex> channelGuard(_mx);
+        Channel& found = Find(channel);
+        if (found.inbox.empty())
+        {
+            return false;
+        }
+        TakeLocked(channel, found, message);
+        return true;
+    }
+
+    /*!
+    \fn Receive
+    \brief Take the oldest buffered message of a channel.
+    \warning Blocks until a message is buffered.
+    \return false if the ChannelMux was stopped.
+    */
+    bool Receive(std::uint16_t channel, std::string& message)
+    {
+        std::unique_lock<std::mutex> channelGuard(_mx);
+        Channel& found = Find(channel);
+        found.ready.wait(channelGuard, [this, &found] { return !found.inbox.empty() || _stopping; });
+        if (found.inbox.empty())
+        {
+            return false;
+        }
+        TakeLocked(channel, found, message);
+        return true;
+    }
+
+    /*!
+    \fn Reset
+    \brief Start the credit of every channel again, once the connection is replaced,
+           sending what was waiting for credit. Buffered messages are kept.
+    \return void
+    */
+    void Reset()
+    {
+        std::lock_guard<std::mutex> channelGuard(_mx);
+        for (auto& entry : _channels)
+        {
+            Channel& channel = *entry.second;
+            channel.credit = _window;
+            channel.consumed = 0;
+            while ((channel.credit > 0) && !channel.waiting.empty())
+            {
+                WriteLocked(entry.first, channel, channel.waiting.front().first, channel.waiting.front().second);
+                channel.waiting.pop_front();
+            }
+        }
+    }
+
+    /*!
+    \fn Stop
+    \brief Wake every waiting receiver, which return false once nothing is buffered.
+    \return void
+    */
+    void Stop()
+    {
+        std::lock_guard<std::mutex> channelGuard(_mx);
+        _stopping = true;
+        for (auto& entry : _channels)
+        {
+            entry.second->ready.notify_all();
+        }
+    }
+
+    /*!
+    \fn Statistics
+    \brief Gets what a channel has done.
+    \return The statistics.
+    */
+    ChannelStatistics Statistics(std::uint16_t channel)
+    {
+        std::lock_guard<std::mutex> channelGuard(_mx);
+        Channel& found = Find(channel);
+        ChannelStatistics statistics;
+        statistics.sent = found.sent;
+        statistics.received = found.received;
+        statistics.stalls = found.stalls;
+        statistics.waiting = found.waiting.size();
+        statistics.buffered = found.inbox.size();
+        statistics.credit = found.credit;
+        return statistics;
+    }
+
+private:
+
+    /*!
+        \struct Channel
+        \brief The state of one channel, guarded by _mx.
+    */
+    struct Channel
+    {
+        std::deque<std::string> inbox; //!< Messages received without a handler, not yet taken.
+        std::deque<std::pair<std::string, TrafficClass>> waiting; //!< Messages waiting for credit.
+        std::shared_ptr<Handler> handler; //!< Receives each message, if set.
+        std::condition_variable ready; //!< Signalled when a message is buffered.
+        std::int64_t credit = 0; //!< The bytes that may be sent, less than 0 after a message larger than the credit left.
+        std::uint32_t consumed = 0; //!< Bytes consumed since credit was last granted.
+        std::uint64_t sent = 0;
+        std::uint64_t received = 0;
+        std::uint64_t stalls = 0;
+    };
+
+    Writer _write; //!< Sends a frame on the connection.
+    std::uint32_t _window; //!< The unconsumed bytes each channel may have in flight.
+    std::mutex _mx; //!< Held while writing, so each channel's frames are written in order.
+    std::unordered_map<std::uint16_t, std::unique_ptr<Channel>> _channels; //!< By channel id, guarded by _mx.
+    bool _stopping = false; //!< Set by Stop, guarded by _mx.
+
+    /*!
+    \fn Find
+    \brief Gets a channel, creating it with a full window.
+    \warning _mx must be held.
+    \return the channel.
+    */
+    Channel& Find(std::uint16_t channel)
+    {
+        std::unique_ptr<Channel>& found = _channels[channel];
+        if (!found)
+        {
+            found.reset(new Channel());
+            found->credit = _window;
+        }
+        return *found;
+    }
+
+    void WriteLocked(std::uint16_t id, Channel& channel, const std::string& message, TrafficClass traffic)
+    {
+        channel.credit -= static_cast<std::int64_t>(message.size());
+        channel.sent++;
+        _write(ChannelHeader::Encode(id, ChannelFrameKind::Data, message), traffic);
+    }
+
+    void TakeLocked(std::uint16_t id, Channel& channel, std::string& message)
+    {
+        message.swap(channel.inbox.front());
+        channel.inbox.pop_front();
+        ConsumedLocked(id, channel, message.size());
+    }
+
+    /*!
+    \fn ConsumedLocked
+    \brief Count bytes consumed, granting them back once they are half the window.
+    \warning _mx must be held.
+    \return void
+    */
+    void ConsumedLocked(std::uint16_t id, Channel& channel, std::size_t bytes)
+    {
+        channel.consumed += static_cast<std::uint32_t>(bytes);
+        if (channel.consumed >= _window / 2)
+        {
+            _write(ChannelHeader::EncodeCredit(id, channel.consumed), TrafficClass::Control);
+            channel.consumed = 0;
+        }
+    }
+};
+
+/*!
+    \class basic_asyncChannelClientTCP
+    \brief Logical channels to a server over the one connection of a
+           basic_asyncClientTCPManager.
+
+    Responsability
+    --------------
+    Frames are sent and received through a ChannelMux. Each channel is sent
+    by its key, so if the manager keeps several stripes a channel stays on
+    one, in order. Each time the manager connects, the channels' credit is
+    started again, ahead of any frame from the server's new channels.
+
+    The client takes every message the manager receives, so the manager
+    must not be received from directly. Handlers are called on the
+    client's own thread.
+
+    Collaboration
+    -------------
+    Uses basic_asyncClientTCPManager. The server uses basic_asyncChannelServerTCP.
+    \sa ChannelMux()
+*/
+template <typename Framing = LengthPrefixFraming>
+class basic_asyncChannelClientTCP
+{
+public:
+    typedef basic_asyncClientTCPManager<Framing> manager;
+    typedef ChannelMux::Handler Handler; //!< Receives each message of a channel, on the client's thread.
+
+private:
+
+    /*!
+        \struct State
+        \brief Shared with the handlers receiving from the manager, which may complete after the client is destroyed.
+    */
+    struct State
+    {
+        boost::asio::io_context io; //!< Receives frames.
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work{io.get_executor()};
+        boost::asio::steady_timer retry{io}; //!< Waits before receiving again while the manager is unhealthy.
+
+        manager* connection; //!< Sends and receives frames.
+        std::unique_ptr<ChannelMux> mux; //!< The channels.
+        std::weak_ptr<State> self; //!< Lets handlers tell if the state still exists.
+        bool stopping = false; //!< Set when the client is destroyed, only used on the io thread.
+
+        /*!
+        \fn Received
+        \brief Pass a frame to the channels, on the io thread.
+        \return void
+        */
+        void Received(const boost::system::error_code& error, std::string frame)
+        {
+            if (stopping)
+            {
+                return;
+            }
+
+            if (error)
+            {
+                retry.expires_after(std::chrono::milliseconds(100)); // Reconnecting may take only milliseconds.
+                retry.async_wait([this](const boost::system::error_code& error)
+                {
+                    if (!error && !stopping)
+                    {
+                        Receive();
+                    }
+                });
+                return;
+            }
+
+            mux->Received(std::move(frame));
+            Receive();
+        }
+
+        /*!
+        \fn Receive
+        \brief Receive the next frame from the manager.
+        \return void
+        */
+        void Receive()
+        {
+            std::weak_ptr<State> weak = self;
+            connection->async_receive([weak](const boost::system::error_code& error, std::string frame)
+            {
+                if (std::shared_ptr<State> state = weak.lock())
+                {
+                    boost::asio::post(state->io, [weak, error, frame = std::move(frame)]() mutable
+                    {
+                        if (std::shared_ptr<State> state = weak.lock())
+                        {
+                            state->Received(error, std::move(frame));
+                        }
+                    });
+                }
+            });
+        }
+    };
+
+    std::shared_ptr<State> _state;
+    std::thread _thread; //!< Runs _state->io.
+
+public:
+
+    /*!
+    \fn asyncChannelClientTCP
+    \brief Start taking frames from the manager.
+    \param connection the manager, outliving the client.
+    \param window the unconsumed bytes each channel may have in flight, the same as the server's.
+    \return void
+    */
+    basic_asyncChannelClientTCP(manager& connection, std::uint32_t window = ChannelMux::DefaultWindow)
+        : _state(std::make_shared<State>())
+    {
+        LOG_INFO("asyncChannelClientTCP::asyncChannelClientTCP");
+        _state->connection = &connection;
+        _state->mux.reset(new ChannelMux([&connection](std::string frame, TrafficClass traffic)
+        {
+            std::uint16_t channel = static_cast<std::uint16_t>((static_cast<unsigned char>(frame[0]) << 8) | static_cast<unsigned char>(frame[1]));
+            if (connection.stripes() == 1)
+            {
+                connection.send(std::move(frame), traffic);
+            }
+            else
+            {
+                connection.send(std::to_string(channel), std::move(frame), traffic);
+            }
+        }, window));
+        _state->self = _state;
+
+        std::weak_ptr<State> weak = _state;
+        connection.on_connected([weak]() // The server's channels are new, so start the credit again before any frame from them.
+        {
+            if (std::shared_ptr<State> state = weak.lock())
+            {
+                boost::asio::post(state->io, [weak]()
+                {
+                    std::shared_ptr<State> state = weak.lock();
+                    if (state && !state->stopping)
+                    {
+                        state->mux->Reset();
+                    }
+                });
+            }
+        });
+
+        std::shared_ptr<State> state = _state;
+        boost::asio::post(_state->io, [state]() { state->Receive(); });
+        _thread = std::thread([state]() { state->io.run(); });
+    }
+
+    /*!
+    \fn ~asyncChannelClientTCP
+    \brief Wake every waiting receiver, and stop the thread.
+    \return void
+    */
+    ~basic_asyncChannelClientTCP()
+    {
+        LOG_INFO("asyncChannelClientTCP::~asyncChannelClientTCP");
+        _state->connection->on_connected(nullptr);
+        _state->mux->Stop();
+        std::shared_ptr<State> state = _state;
+        boost::asio::post(_state->io, [state]()
+        {
+            state->stopping = true;
+            state->retry.cancel();
+            state->io.stop();
+        });
+        _thread.join();
+    }
+
+    /*!
+    \fn handle
+    \brief Pass each message of a channel to a handler, rather than buffering it.
+    \return void
+    */
+    void handle(std::uint16_t channel, Handler handler)
+    {
+        _state->mux->Handle(channel, std::move(handler));
+    }
+
+    /*!
+    \fn send
+    \brief Send a message on a channel, once the server has granted credit for it.
+    \param traffic the message's class.
+    \return false if the message must wait for credit.
+    */
+    bool send(std::uint16_t channel, std::string message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        return _state->mux->Send(channel, std::move(message), traffic);
+    }
+
+    /*!
+    \fn receive
+    \brief Receive the next message of a channel without a handler.
+    \warning This is a blocking call.
+    \return the text received, or empty once the client is destroyed.
+    */
+    std::string receive(std::uint16_t channel)
+    {
+        std::string message;
+        _state->mux->Receive(channel, message);
+        return message;
+    }
+
+    /*!
+    \fn try_receive
+    \brief Take the next message of a channel without a handler, if any, without waiting.
+    \return false if none is buffered.
+    */
+    bool try_receive(std::uint16_t channel, std::string& message)
+    {
+        return _state->mux->TryReceive(channel, message);
+    }
+
+    /*!
+    \fn statistics
+    \brief Gets what a channel has done.
+    \return The statistics.
+    */
+    ChannelStatistics statistics(std::uint16_t channel)
+    {
+        return _state->mux->Statistics(channel);
+    }
+};
+
+typedef basic_asyncChannelClientTCP<> asyncChannelClientTCP; //!< Frames prefixed by their length.
+
+/*!
+    \class basic_asyncChannelServerTCP
+    \brief Logical channels to each client of a basic_asyncServerTCPManager,
+           over one connection per client.
+
+    Responsability
+    --------------
+    A ChannelMux is kept per connection, made when it first sends, and
+    forgotten once the manager reports it closed, when sending to it fails
+    or when forget() is called. Handlers are
+    called with the id of the connection, on the server's own receiving
+    thread; messages on channels without a handler are buffered per
+    connection, for try_receive.
+
+    The server takes every message the manager receives, so the manager
+    must not be received from directly, and must outlive the server, which
+    wakes and joins its thread when destroyed.
+
+    Collaboration
+    -------------
+    Uses basic_asyncServerTCPManager. Clients use basic_asyncChannelClientTCP.
+    \sa ChannelMux()
+*/
+template <typename Framing = LengthPrefixFraming>
+class basic_asyncChannelServerTCP
+{
+public:
+    typedef basic_asyncServerTCPManager<Framing> manager;
+    typedef std::function<void(std::uint64_t, std::string&)> Handler; //!< Receives each message of a channel, with the id of its connection.
+
+private:
+
+    /*!
+        \struct Peer
+        \brief The channels of one connection.
+    */
+    struct Peer
+    {
+        std::shared_ptr<ChannelMux> mux; //!< The channels.
+        std::shared_ptr<std::atomic<bool>> closed; //!< Set once sending to the connection fails.
+    };
+
+    /*!
+        \struct State
+        \brief Shared with the receiving thread.
+    */
+    struct State
+    {
+        manager* server; //!< Sends and receives frames.
+        std::uint32_t window; //!< Given to each ChannelMux.
+        std::mutex mx;
+        std::unordered_map<std::uint64_t, Peer> peers; //!< By connection id, guarded by mx.
+        std::unordered_map<std::uint16_t, Handler> handlers; //!< By channel, guarded by mx.
+        std::atomic<bool> stopping{false};
+
+        /*!
+        \fn Channels
+        \brief Gets the channels of a connection, making them if new.
+        \return the channels, empty if the connection has already closed.
+        */
+        std::shared_ptr<ChannelMux> Channels(std::uint64_t id)
+        {
+            std::lock_guard<std::mutex> peerGuard(mx);
+            auto known = peers.find(id);
+            if (known != peers.end())
+            {
+                return known->second.mux;
+            }
+            if (!server->connected(id)) // Checked under mx, so Closed can not have missed the peer.
+            {
+                return std::shared_ptr<ChannelMux>();
+            }
+
+            Peer& found = peers[id];
+            manager* to = server;
+            std::shared_ptr<std::atomic<bool>> closed = std::make_shared<std::atomic<bool>>(false);
+            found.closed = closed;
+            found.mux = std::make_shared<ChannelMux>([to, id, closed](std::string frame, TrafficClass traffic)
+            {
+                if (!to->send(id, std::move(frame), traffic))
+                {
+                    *closed = true;
+                }
+            }, window);
+            for (auto& entry : handlers)
+            {
+                Handler handler = entry.second;
+                found.mux->Handle(entry.first, [handler, id](std::string& message) { handler(id, message); });
+            }
+            return found.mux;
+        }
+
+        /*!
+        \fn Find
+        \brief Gets the channels of a known connection.
+        \return the channels, empty if not known.
+        */
+        Peer Find(std::uint64_t id)
+        {
+            std::lock_guard<std::mutex> peerGuard(mx);
+            auto found = peers.find(id);
+            if (found == peers.end())
+            {
+                return Peer();
+            }
+            return found->second;
+        }
+
+        /*!
+        \fn Closed
+        \brief Drop the channels of a connection the manager reports closed.
+        \return void
+        */
+        void Closed(std::uint64_t id)
+        {
+            std::lock_guard<std::mutex> peerGuard(mx);
+            peers.erase(id);
+        }
+
+        /*!
+        \fn Run
+        \brief Pass each frame the manager receives to its connection's channels, until stopping.
+        \return void
+        */
+        void Run()
+        {
+            while (!stopping)
+            {
+                std::uint64_t from;
+                std::string frame = server->receive(from, stopping);
+                if (stopping)
+                {
+                    return;
+                }
+                if (!frame.empty())
+                {
+                    std::shared_ptr<ChannelMux> channels = Channels(from);
+                    if (channels)
+                    {
+                        channels->Received(std::move(frame));
+                    }
+                }
+            }
+        }
+    };
+
+    std::shared_ptr<State> _state;
+    std::thread _thread; //!< Runs _state->Run.
+
+public:
+
+    /*!
+    \fn asyncChannelServerTCP
+    \brief Start taking frames from the manager.
+    \param server the manager, outliving the server.
+    \param window the unconsumed bytes each channel may have in flight, the same as the clients'.
+    \return void
+    */
+    basic_asyncChannelServerTCP(manager& server, std::uint32_t window = ChannelMux::DefaultWindow)
+        : _state(std::make_shared<State>())
+    {
+        LOG_INFO("asyncChannelServerTCP::asyncChannelServerTCP");
+        _state->server = &server;
+        _state->window = window;
+
+        std::weak_ptr<State> weak = _state;
+        server.on_closed([weak](std::uint64_t id)
+        {
+            if (std::shared_ptr<State> state = weak.lock())
+            {
+                state->Closed(id);
+            }
+        });
+
+        std::shared_ptr<State> state = _state;
+        _thread = std::thread([state]() { state->Run(); });
+    }
+
+    /*!
+    \fn ~asyncChannelServerTCP
+    \brief Stop being told of closed connections, and wake and join the thread.
+    \return void
+    */
+    ~basic_asyncChannelServerTCP()
+    {
+        LOG_INFO("asyncChannelServerTCP::~asyncChannelServerTCP");
+        _state->server->on_closed(nullptr);
+        _state->stopping = true;
+        _state->server->wake_receivers();
+        _thread.join();
+    }
+
+    /*!
+    \fn handle
+    \brief Pass each message of a channel, from every connection, to a handler.
+    \warning Set handlers before clients connect; connections already known keep their handlers.
+    \return void
+    */
+    void handle(std::uint16_t channel, Handler handler)
+    {
+        std::lock_guard<std::mutex> peerGuard(_state->mx);
+        _state->handlers[channel] = std::move(handler);
+    }
+
+    /*!
+    \fn send
+    \brief Send a message on a channel of one connection, once it has granted credit.
+    \param to the id of the connection, as given to a handler.
+    \param traffic the message's class.
+    \return false if the connection is not known, or has closed, when it is forgotten.
+    */
+    bool send(std::uint64_t to, std::uint16_t channel, std::string message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        Peer peer = _state->Find(to);
+        if (!peer.mux)
+        {
+            return false;
+        }
+        peer.mux->Send(channel, std::move(message), traffic);
+        if (*peer.closed)
+        {
+            forget(to);
+            return false;
+        }
+        return true;
+    }
+
+    /*!
+    \fn try_receive
+    \brief Take the next message of a channel without a handler, from one connection, if any.
+    \return false if none is buffered.
+    */
+    bool try_receive(std::uint64_t from, std::uint16_t channel, std::string& message)
+    {
+        Peer peer = _state->Find(from);
+        return peer.mux && peer.mux->TryReceive(channel, message);
+    }
+
+    /*!
+    \fn forget
+    \brief Drop the channels of a connection that has closed.
+    \return void
+    */
+    void forget(std::uint64_t id)
+    {
+        std::lock_guard<std::mutex> peerGuard(_state->mx);
+        _state->peers.erase(id);
+    }
+
+    /*!
+    \fn peers
+    \brief Gets the number of connections with channels.
+    \return the count.
+    */
+    std::size_t peers()
+    {
+        std::lock_guard<std::mutex> peerGuard(_state->mx);
+        return _state->peers.size();
+    }
+
+    /*!
+    \fn statistics
+    \brief Gets what a channel of one connection has done.
+    \return The statistics, empty if the connection is not known.
+    */
+    ChannelStatistics statistics(std::uint64_t from, std::uint16_t channel)
+    {
+        Peer peer = _state->Find(from);
+        if (!peer.mux)
+        {
+            return ChannelStatistics();
+        }
+        return peer.mux->Statistics(channel);
+    }
+};
+
+typedef basic_asyncChannelServerTCP<> asyncChannelServerTCP; //!< Frames prefixed by their length.
+
+#endif
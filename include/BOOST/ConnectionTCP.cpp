@@ -8,9 +8,11 @@
 
 //#pragma once
 
+#include <utility>
+
 #include <boost/bind/bind.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/enable_shared_from_this.hpp>
+#include <boost/intrusive_ptr.hpp>
 #include <boost/asio.hpp>
 
 #include <stdio.h>
@@ -30,16 +32,49 @@
 
 #include <thread>
 #include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
 
 #include <list>
+#include <map>
+#include <deque>
 #include <queue>
+#include <vector>
 
 #include <stdexcept>
 
 #include <utility>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include "TagFramer.cpp"
+#include "BufferLimits.cpp"
+#include "CaptureLog.cpp"
+#include "XmlDocumentPool.cpp"
+#include "ReconnectBackoff.cpp"
+#include "EndpointCache.cpp"
+#include "HandlerAllocator.cpp"
+#include "SlabPool.cpp"
+#include "TrafficClass.cpp"
+#include "TimerWheel.cpp"
+#include "Log.cpp"
 
 using boost::asio::ip::tcp;
 
+/*!
+    \struct HeldMessage
+    \brief A sequenced message, held to resume clients.
+*/
+struct HeldMessage
+{
+    std::uint64_t sequence;
+    std::shared_ptr<const std::string> message; //!< Shared with the connections writing it.
+    std::shared_ptr<const std::string> marker; //!< Its <Seq n="k"/>, shared with the connections writing it.
+};
+
 /*!
     \class ConnectionTCP
     \brief Represents a connection made over TCP
@@ -48,25 +83,42 @@ using boost::asio::ip::tcp;
     --------------
     Control connections by clients. 
 
+    Reference counted intrusively, so a ServerTCP can recycle connections 
+    through a SlabPool.
+
+    Messages are queued by TrafficClass; between writes the oldest Control 
+    message is always written before any Bulk one.
+
+    With heartbeats, the client is read from continuously, only to hear it, 
+    a heartbeat is sent once nothing has been written for the interval, and 
+    the socket is closed once nothing has been read for the timeout.
+
+    With a resume history, the client is read from continuously for 
+    <Resume seq="N"/> requests. Only a client that has sent one is sent 
+    sequenced messages, each followed by its <Seq n="k"/> marker. Until the 
+    client has asked or the server's grace period has ended, sequenced 
+    messages are withheld, so none overtakes those it is to be replayed.
+
     Collaboration
     -------------
     Used by objects detecting where an object has been detected within a 2d plane. 
     \sa ServerTCP()
 */
-class ConnectionTCP : public boost::enable_shared_from_this<ConnectionTCP>
+class ConnectionTCP : public Pooled<ConnectionTCP>
 {
 public:
-    typedef boost::shared_ptr<ConnectionTCP> pointer;
+    typedef boost::intrusive_ptr<ConnectionTCP> pointer;
 
     /*!
     \fn ConnectionTCP
     \brief Instantiate the object, particularly the parent.  
     \param io_context the server context in which to create the connection.
+    \param latency updated with the latency of each message written, by class.
     \return void
     */
-    ConnectionTCP(boost::asio::io_context& io_context) : socket_(io_context)
+    ConnectionTCP(boost::asio::io_context& io_context, LaneLatency& latency) : _io(io_context), socket_(io_context), _latency(latency)
     {
-        std::cout << "ConnectionTCP::ConnectionTCP initalised." << std::endl;
+        LOG_DEBUG("ConnectionTCP::ConnectionTCP initalised.");
         return;
     }
 
@@ -74,12 +126,35 @@ public:
     \fn create
     \brief Create a new ConnectionTCP pointer
     \param io_context the server context in which to create the connection.
+    \param latency updated with the latency of each message written, by class.
     \return pointer
     */
-    static pointer create(boost::asio::io_context& io_context)
+    static pointer create(boost::asio::io_context& io_context, LaneLatency& latency)
+    {
+        LOG_DEBUG("ConnectionTCP::create Creating new ConnectionTCP from io_context.");
+        return pointer(new ConnectionTCP(io_context, latency));
+    }
+
+    /*!
+    \fn recycle
+    \brief Return to the state after construction, once no longer referenced, 
+           so a SlabPool can reuse the connection.
+    \return void
+    */
+    void recycle()
     {
-        std::cout << "ConnectionTCP::create Creating new ConnectionTCP from io_context." << std::endl;
-        return pointer(new ConnectionTCP(io_context));
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        ClearOutbox();
+        _request.consume(_request.size());
+        _reading = false;
+        _resumeHandler = nullptr;
+        _sequenced = false;
+        _awaitingResume = false;
+        _registeredSequence = 0;
+        _withheld.clear();
+        _wheel = nullptr;
+        _heartbeat = nullptr;
     }
 
     /*!
@@ -97,22 +172,272 @@ public:
     \fn SendMessage
     \brief Send a message to the connected client. 
     \param message the text desired to be sent to all connected parties.
+    \param traffic the message's class; queued Control messages are written before Bulk ones.
+    \note Safe to call from any thread. Messages of a class are queued and 
+          written in order on the connection's io_context, one write at a time.
     \return void
     */
-    void SendMessage(std::string message)
+    void SendMessage(std::string message, TrafficClass traffic = TrafficClass::Bulk)
     {
+        OutboundMessage outbound;
+        outbound.message = std::move(message);
+        Queue(std::move(outbound), traffic);
+    }
 
-        boost::asio::async_write(socket_, boost::asio::buffer(message),
-            boost::bind(&ConnectionTCP::HandleWrite, shared_from_this(),
-            boost::asio::placeholders::error,
-            boost::asio::placeholders::bytes_transferred));
+    /*!
+    \fn SendMessage
+    \brief Send a message shared with other connections, e.g. one broadcast to 
+           all, written without copying it. 
+    \param message left unchanged until written by every connection, then released.
+    \param traffic the message's class.
+    \return void
+    */
+    void SendMessage(std::shared_ptr<const std::string> message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        OutboundMessage outbound;
+        outbound.shared = std::move(message);
+        Queue(std::move(outbound), traffic);
+    }
 
-        //std::cout << "ConnectionTCP::start Sent message: " << message;
+    /*!
+    \fn SendSequenced
+    \brief Send a sequenced Bulk message shared with other connections, 
+           followed by its marker, both written without copying them. 
+    \param message left unchanged until written by every connection.
+    \param marker the message's <Seq n="k"/>, written after it.
+    \return void
+    */
+    void SendSequenced(std::shared_ptr<const std::string> message, std::shared_ptr<const std::string> marker)
+    {
+        OutboundMessage outbound;
+        outbound.shared = std::move(message);
+        outbound.suffix = boost::asio::buffer(*marker);
+        outbound.sharedSuffix = std::move(marker);
+        Queue(std::move(outbound), TrafficClass::Bulk);
+    }
 
+    /*!
+    \fn StartResume
+    \brief Read from the client, calling a handler for each request to 
+           resume, i.e. <Resume seq="N"/> with the last sequence number it 
+           received, whenever it is sent. 
+    \param handler called on the io_context with the connection and N.
+    \warning Call on the io_context.
+    \return void
+    */
+    void StartResume(std::function<void(pointer, std::uint64_t)> handler)
+    {
+        _resumeHandler = std::move(handler);
+        StartReading();
     }
 
+    /*!
+    \fn StartHeartbeat
+    \brief Read from the client, send heartbeats, and close the socket once 
+           nothing is read for the timeout.
+    \param wheel drives the checks, on the io_context, outliving the connection.
+    \param heartbeat the options, outliving the connection.
+    \warning Call on the io_context.
+    \return void
+    */
+    void StartHeartbeat(TimerWheel& wheel, const HeartbeatOptions& heartbeat)
+    {
+        _wheel = &wheel;
+        _heartbeat = &heartbeat;
+        _lastRead = _lastWrite = std::chrono::steady_clock::now();
+        if (_heartbeat->timeout.count() > 0)
+        {
+            StartReading();
+        }
+        ScheduleHeartbeat();
+    }
 
 private:
+    friend class ServerTCP; // Keeps each connection's resume state under its lock.
+
+    /*!
+    \fn Queue
+    \brief Queue a message on the io_context, and start writing if idle.
+    \return void
+    */
+    void Queue(OutboundMessage outbound, TrafficClass traffic)
+    {
+        outbound.traffic = traffic;
+        outbound.queued = std::chrono::steady_clock::now();
+        boost::asio::post(_io.get_executor(), MakeAllocatingHandler(_postMemory,
+            [self = pointer(this), outbound = std::move(outbound)]() mutable
+            {
+                self->_outbox[static_cast<std::size_t>(outbound.traffic)].push_back(std::move(outbound));
+                if (!self->_writingMessage)
+                {
+                    self->WriteNext();
+                }
+            }));
+    }
+
+    /*!
+    \fn StartReading
+    \brief Start reading from the client, unless already reading.
+    \return void
+    */
+    void StartReading()
+    {
+        if (!_reading)
+        {
+            _reading = true;
+            _lastRead = std::chrono::steady_clock::now();
+            ReadNext();
+        }
+    }
+
+    /*!
+    \fn ReadNext
+    \brief Read whatever the client sends, to know it is there and for resume requests.
+    \return void
+    */
+    void ReadNext()
+    {
+        pointer self(this);
+        socket_.async_read_some(_request.prepare(512), MakeAllocatingHandler(_readMemory,
+            [self](const boost::system::error_code& error, std::size_t length)
+            {
+                if (!error)
+                {
+                    self->_lastRead = std::chrono::steady_clock::now();
+                    self->_request.commit(length);
+                    self->TakeRequests();
+                    self->ReadNext();
+                }
+            }));
+    }
+
+    /*!
+    \fn TakeRequests
+    \brief Call the resume handler for each complete request read, and 
+           discard everything else, keeping only a request partly read.
+    \return void
+    */
+    void TakeRequests()
+    {
+        static const std::string request = "<Resume seq=\"";
+        static const std::size_t longest = 64; // A partial request longer than this is not one.
+
+        const char* data = static_cast<const char*>(_request.data().data()); // The streambuf's data is contiguous.
+        std::size_t size = _request.size();
+        std::size_t taken = size;
+
+        for (std::size_t at = 0; _resumeHandler && (at < size); )
+        {
+            const char* open = static_cast<const char*>(std::memchr(data + at, '<', size - at));
+            if (open == nullptr)
+            {
+                break;
+            }
+
+            std::size_t start = open - data;
+            const char* close = static_cast<const char*>(std::memchr(open, '>', size - start));
+            if (close == nullptr)
+            {
+                taken = ((size - start) < longest) ? start : size; // Wait for the rest.
+                break;
+            }
+
+            std::size_t end = (close - data) + 1;
+            if ((end - start > request.size()) && (request.compare(0, request.size(), open, request.size()) == 0))
+            {
+                std::uint64_t sequence = 0;
+                for (const char* digit = open + request.size(); (digit < close) && std::isdigit(static_cast<unsigned char>(*digit)); digit++)
+                {
+                    sequence = sequence * 10 + static_cast<std::uint64_t>(*digit - '0');
+                }
+                _resumeHandler(pointer(this), sequence);
+            }
+            at = end;
+        }
+        _request.consume(taken);
+    }
+
+    /*!
+    \fn ScheduleHeartbeat
+    \brief Check the connection again when the next heartbeat or timeout is due.
+    \return void
+    */
+    void ScheduleHeartbeat()
+    {
+        std::chrono::steady_clock::time_point due = std::chrono::steady_clock::time_point::max();
+        if (_heartbeat->interval.count() > 0)
+        {
+            due = std::min(due, _lastWrite + _heartbeat->interval);
+        }
+        if (_heartbeat->timeout.count() > 0)
+        {
+            due = std::min(due, _lastRead + _heartbeat->timeout);
+        }
+        if (due == std::chrono::steady_clock::time_point::max())
+        {
+            return;
+        }
+
+        pointer self(this);
+        _wheel->Schedule(due - std::chrono::steady_clock::now(), [self]() { self->CheckHeartbeat(); });
+    }
+
+    /*!
+    \fn CheckHeartbeat
+    \brief Close the socket if nothing has been read for the timeout, so 
+           MaintainConnections removes it, or send a heartbeat if nothing has 
+           been written for the interval.
+    \warning Called on the io_context by the TimerWheel.
+    \return void
+    */
+    void CheckHeartbeat()
+    {
+        if ((_heartbeat == nullptr) || !socket_.is_open())
+        {
+            return; // Closed, so the check ends.
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if ((_heartbeat->timeout.count() > 0) && (now - _lastRead >= _heartbeat->timeout))
+        {
+            LOG_WARNING("ConnectionTCP::CheckHeartbeat Nothing read for " << _heartbeat->timeout.count() << " ms, closing.");
+            boost::system::error_code ignored;
+            socket_.shutdown(tcp::socket::shutdown_both, ignored);
+            socket_.close(ignored);
+            ClearOutbox();
+            return;
+        }
+
+        if ((_heartbeat->interval.count() > 0) && (now - _lastWrite >= _heartbeat->interval))
+        {
+            _lastWrite = now; // Not again until the interval has passed, even if the write is slow.
+            SendMessage(_heartbeat->message, TrafficClass::Control);
+        }
+
+        ScheduleHeartbeat();
+    }
+
+    /*!
+    \fn WriteNext
+    \brief Write the oldest queued message of the highest class queued.
+    \warning Called on the io_context with a message queued and none being written.
+    \return void
+    */
+    void WriteNext()
+    {
+        std::deque<OutboundMessage>& lane = _outbox[static_cast<std::size_t>(TrafficClass::Control)].empty() ? 
+            _outbox[static_cast<std::size_t>(TrafficClass::Bulk)] : _outbox[static_cast<std::size_t>(TrafficClass::Control)];
+        _writing = std::move(lane.front());
+        lane.pop_front();
+        _writingMessage = true;
+
+        _gather.clear();
+        _writing.Gather(_gather);
+        boost::asio::async_write(socket_, _gather, MakeAllocatingHandler(_writeMemory,
+            boost::bind(&ConnectionTCP::HandleWrite, pointer(this),
+            boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred)));
+    }
 
     /*!
     \fn HandleWrite
@@ -129,23 +454,74 @@ private:
             if (error_code.value() == 32)
             {
                 socket_.close();
-                std::cout << "ConnectionTCP::handle_write Connection closed: " << error_code.value() << "::" << error_code.message() << std::endl;
+                LOG_WARNING("ConnectionTCP::handle_write Connection closed: " << error_code.value() << "::" << error_code.message());
             }
             else if (error_code.value() == 9)
             {
                 socket_.close();
-                std::cout << "ConnectionTCP::handle_write Connection awaiting removal: " << error_code.value() << "::" << error_code.message() << std::endl;
+                LOG_WARNING("ConnectionTCP::handle_write Connection awaiting removal: " << error_code.value() << "::" << error_code.message());
             }
             else
             {
                 socket_.close();
-                std::cout << "ConnectionTCP::handle_write ERROR: Unhandled socket error, closed connection: " << error_code.value() << "::" << error_code.message() << std::endl;
+                LOG_ERROR("ConnectionTCP::handle_write ERROR: Unhandled socket error, closed connection: " << error_code.value() << "::" << error_code.message());
+            }
+            ClearOutbox();
+            return;
+        }
+
+        _lastWrite = std::chrono::steady_clock::now();
+        _latency.Record(_writing.traffic, _lastWrite - _writing.queued);
+        _writing.Release(); // A shared message is freed once every connection has written it.
+        _writingMessage = false;
+        for (const std::deque<OutboundMessage>& lane : _outbox)
+        {
+            if (!lane.empty())
+            {
+                WriteNext();
+                break;
             }
         }
         return;
     }
 
+    /*!
+    \fn ClearOutbox
+    \brief Discard every queued message, e.g. once writing fails.
+    \return void
+    */
+    void ClearOutbox()
+    {
+        for (std::deque<OutboundMessage>& lane : _outbox)
+        {
+            lane.clear();
+        }
+        _writing.Release();
+        _writingMessage = false;
+    }
+
+    boost::asio::io_context& _io; //!< Runs the connection.
     tcp::socket socket_; //!< The active socket used with the client. 
+    std::array<std::deque<OutboundMessage>, TrafficClasses> _outbox; //!< Messages awaiting writing, by TrafficClass. Only used on the io_context.
+    OutboundMessage _writing; //!< The message being written, only used on the io_context.
+    std::vector<boost::asio::const_buffer> _gather; //!< The buffers of _writing, keeping their capacity, only used on the io_context.
+    bool _writingMessage = false; //!< If _writing is being written, only used on the io_context.
+    LaneLatency& _latency; //!< What each class's latency has been, owned by the ServerTCP.
+    boost::asio::streambuf _request; //!< Bytes read from the client, kept only while a resume request is partly read.
+    bool _reading = false; //!< If the client is being read from, only used on the io_context.
+    std::function<void(pointer, std::uint64_t)> _resumeHandler; //!< Called for each resume request, if the server has a resume history.
+    bool _sequenced = false; //!< If the client has asked to resume, so is sent sequence markers, guarded by the server's _connectionsMutex.
+    bool _awaitingResume = false; //!< If sequenced messages are withheld until the client asks to resume or the grace period ends, guarded by the server's _connectionsMutex.
+    std::uint64_t _registeredSequence = 0; //!< The server's last sequence number when the connection was registered, guarded by the server's _connectionsMutex.
+    std::vector<HeldMessage> _withheld; //!< Sequenced messages sent while awaiting a resume request, guarded by the server's _connectionsMutex.
+    HandlerMemory _writeMemory; //!< Recycled for each write.
+    HandlerMemory _postMemory; //!< Recycled for each message queued while no other is being posted.
+    HandlerMemory _readMemory; //!< Recycled for each read while heartbeats are started.
+
+    TimerWheel* _wheel = nullptr; //!< Drives heartbeats, if started.
+    const HeartbeatOptions* _heartbeat = nullptr; //!< The server's options, if heartbeats are started.
+    std::chrono::steady_clock::time_point _lastRead; //!< When the client last sent anything, only used on the io_context.
+    std::chrono::steady_clock::time_point _lastWrite; //!< When a write last completed, only used on the io_context.
 };
 
 
@@ -159,6 +535,21 @@ private:
     --------------
     Control connections by clients. 
 
+    Optionally each message is numbered and kept in a bounded history. A 
+    client reconnecting sends <Resume seq="N"/> with the last number it 
+    received and is sent the messages after N, so a brief loss of 
+    connection loses no messages. From then on each message it is sent is 
+    followed by <Seq n="k"/>. Until a new connection asks to resume, or 
+    ResumeGracePeriod passes, the numbered messages sent are withheld from 
+    it, so they follow those replayed; a client that never asks is then 
+    sent them, and every later message, unchanged. Control messages are 
+    neither numbered nor held, as they may overtake bulk ones and are stale 
+    once a client has reconnected.
+
+    Optionally each connection sends <Heartbeat/> when idle and is closed 
+    once the client has sent nothing for a timeout, e.g. its own heartbeats, 
+    all driven by one TimerWheel.
+
     Collaboration
     -------------
     Used by a connection manager to manage connections.
@@ -168,18 +559,25 @@ private:
 class ServerTCP
 {
 public:
+    static constexpr std::chrono::milliseconds ResumeGracePeriod{250}; //!< How long a new connection has to ask to resume, one round trip being expected.
 
     /*!
     \fn ServerTCP
     \brief A constructor for the server. 
     \param io_context the server context in which to create the connection.
+    \param resumeHistory the number of messages kept to resume clients, 0 to 
+           disable sequence numbers and resuming.
+    \param heartbeat when each connection sends heartbeats and times out, off by default.
     \return void
     */
-    ServerTCP(boost::asio::io_context& io_context, int port) : io_context_(io_context), acceptor_(io_context, tcp::endpoint(tcp::v4(), port))
+    ServerTCP(boost::asio::io_context& io_context, int port, std::size_t resumeHistory = 0, HeartbeatOptions heartbeat = HeartbeatOptions()) : io_context_(io_context), acceptor_(io_context, tcp::endpoint(tcp::v4(), port)),
+        _pool(SlabPool<ConnectionTCP>::Create([&io_context, this](void* where) { return new (where) ConnectionTCP(io_context, _latency); })),
+        _heartbeat(heartbeat), _wheel(io_context)
     {
+        _resumeHistory = resumeHistory;
         _threadMaintainConnections = std::thread(&ServerTCP::MaintainConnections, this);
         _port = port;
-        std::cout << "ServerTCP::ServerTCP Created. Port: " << _port << std::endl;
+        LOG_INFO("ServerTCP::ServerTCP Created. Port: " << _port);
 
         CreateAcceptHandler();
     }
@@ -203,39 +601,115 @@ public:
         
         _threadMaintainConnections.~thread();
 
-        std::cout << "ServerTCP::~ServerTCP Completed." << _port << std::endl;
+        LOG_INFO("ServerTCP::~ServerTCP Completed." << _port);
     }
 
     /*!
     \fn SendMessage
-    \brief Send a message to all connected clients. 
-    \param message the text desired to be sent to all connected parties.
+    \brief Send a message to all connected clients, sharing one copy of it. 
+    \param message the text desired to be sent to all connected parties, 
+           never copied if given as an rvalue.
+    \param traffic the message's class.
     \return void
     */
-    void SendMessage(std::string message)
+    void SendMessage(std::string message, TrafficClass traffic = TrafficClass::Bulk)
     {
         std::unique_lock<std::mutex> iterateGuard(_connectionsMutex);
-       
-        for (ConnectionTCP::pointer & connection : _connections)
-        {
-            connection->SendMessage(message);
-        }
+        SendLocked(std::make_shared<const std::string>(std::move(message)), traffic);
+    }
 
-        //if (_connections.size() > 0)
-        //{
-        //    std::cout << "ServerTCP::sendMessage Sent count: " << _connections.size() << std::endl;
-        //}
-        //else
-        //{
-        //    std::cout << "ServerTCP::sendMessage no active connections." << std::endl;
-        //}
+    /*!
+    \fn SendMessage
+    \brief Send a message shared with other senders to all connected clients, 
+           never copied. 
+    \param message left unchanged until written by every connection.
+    \param traffic the message's class.
+    \return void
+    */
+    void SendMessage(std::shared_ptr<const std::string> message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        std::unique_lock<std::mutex> iterateGuard(_connectionsMutex);
+        SendLocked(std::move(message), traffic);
+    }
 
-        iterateGuard.unlock();
+    /*!
+    \fn SendMessage
+    \brief Send a message given in several buffers to all connected clients, copied once. 
+    \param buffers the parts of the message, in order, only read during the call.
+    \param traffic the message's class.
+    \return void
+    */
+    void SendMessage(const std::vector<boost::asio::const_buffer>& buffers, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        SendMessage(GatherMessage(buffers), traffic);
+    }
 
-        return;
+    /*!
+    \fn Latency
+    \brief Gets how long the messages of a class waited to be written, across all connections. 
+    \return The statistics.
+    */
+    LatencyStatistics Latency(TrafficClass traffic)
+    {
+        return _latency.Snapshot(traffic);
     }
 
 private:
+
+    /*!
+    \fn SequenceMarker
+    \brief Gets the marker following a message, for clients to resume after it.
+    \return the marker.
+    */
+    static std::string SequenceMarker(std::uint64_t sequence)
+    {
+        return "<Seq n=\"" + std::to_string(sequence) + "\"/>";
+    }
+
+    /*!
+    \fn SendLocked
+    \brief Number and hold a Bulk message to resume clients, if there is a 
+           history, and queue it on every connection, with its marker to 
+           those that have asked to resume, or withhold it from those that 
+           may yet ask.
+    \warning _connectionsMutex must be held.
+    \return void
+    */
+    void SendLocked(std::shared_ptr<const std::string> message, TrafficClass traffic)
+    {
+        if ((_resumeHistory == 0) || (traffic != TrafficClass::Bulk))
+        {
+            for (ConnectionTCP::pointer & connection : _connections)
+            {
+                connection->SendMessage(message, traffic);
+            }
+            return;
+        }
+
+        _sequence++;
+        std::shared_ptr<const std::string> marker = std::make_shared<const std::string>(SequenceMarker(_sequence)); // After the message, so it is only seen once the message is complete.
+        _history.push_back(HeldMessage{_sequence, message, marker});
+        if (_history.size() > _resumeHistory)
+        {
+            _history.pop_front();
+        }
+
+        for (ConnectionTCP::pointer & connection : _connections)
+        {
+            if (connection->_awaitingResume)
+            {
+                connection->_withheld.push_back(HeldMessage{_sequence, message, marker});
+            }
+            else if (connection->_sequenced)
+            {
+                connection->SendSequenced(message, marker);
+            }
+            else
+            {
+                connection->SendMessage(message, traffic);
+            }
+        }
+    }
     
     /*!
     \fn CreateAcceptHandler
@@ -244,7 +718,7 @@ private:
     */
     void CreateAcceptHandler()
     {
-        ConnectionTCP::pointer new_connection = ConnectionTCP::create(io_context_);
+        ConnectionTCP::pointer new_connection = _pool->Acquire();
 
         // Create new conneciton handler
         acceptor_.async_accept(new_connection->socket(),
@@ -266,12 +740,127 @@ private:
             //new_connection->SendMessage("====================================\n");
             //new_connection->SendMessage("Connected to \"" + _serverName + "\"\n");
             //new_connection->SendMessage("====================================\n");
+            std::lock_guard<std::mutex> addGuard(_connectionsMutex);
+            new_connection->_registeredSequence = _sequence; // Messages after it are withheld until the client has had time to resume.
             _connections.push_back(new_connection);
+            if (_resumeHistory > 0)
+            {
+                new_connection->_awaitingResume = true;
+                new_connection->StartResume([this](ConnectionTCP::pointer connection, std::uint64_t sequence)
+                {
+                    std::lock_guard<std::mutex> resumeGuard(_connectionsMutex);
+                    ReplayLocked(connection, sequence);
+                });
+                _wheel.Schedule(ResumeGracePeriod, [this, new_connection]()
+                {
+                    std::lock_guard<std::mutex> graceGuard(_connectionsMutex);
+                    ReleaseWithheldLocked(new_connection);
+                });
+            }
+            if (_heartbeat.Enabled())
+            {
+                new_connection->StartHeartbeat(_wheel, _heartbeat);
+            }
         }
 
         CreateAcceptHandler();
     }
 
+    /*!
+    \fn ReplayLocked
+    \brief Send a resuming client, with their markers, the messages after 
+           the last it received up to its connection, then those withheld 
+           since, and send it markers from now on. 
+    \param connection the client's connection.
+    \param sequence the last sequence number the client received, 0 if none.
+    \warning _connectionsMutex must be held. 
+    \return void
+    */
+    void ReplayLocked(ConnectionTCP::pointer connection, std::uint64_t sequence)
+    {
+        if (!connection->_awaitingResume)
+        {
+            if (!connection->_sequenced)
+            {
+                LOG_WARNING("ServerTCP::ReplayLocked A client asked to resume after the grace period, only marking messages from now on.");
+                connection->_sequenced = true;
+            }
+            return; // Messages since its connection have been sent, so replaying would reorder them.
+        }
+
+        connection->_sequenced = true;
+        connection->_awaitingResume = false;
+        std::uint64_t registered = connection->_registeredSequence;
+        if ((sequence == 0) || (sequence >= registered))
+        {
+            SendWithheldLocked(connection); // Nothing missed, or the client predates a restart of this server.
+            return;
+        }
+
+        if (_history.empty() || (_history.front().sequence > sequence + 1))
+        {
+            LOG_WARNING("ServerTCP::ReplayLocked Messages after " << sequence << " are no longer held, resuming from the oldest held.");
+        }
+
+        std::size_t replayed = 0;
+        for (const HeldMessage& held : _history)
+        {
+            if ((held.sequence > sequence) && (held.sequence <= registered))
+            {
+                connection->SendSequenced(held.message, held.marker);
+                replayed++;
+            }
+        }
+
+        SendWithheldLocked(connection);
+
+        LOG_INFO("ServerTCP::ReplayLocked Resumed a client from " << sequence << ", replayed: " << replayed);
+    }
+
+    /*!
+    \fn ReleaseWithheldLocked
+    \brief Once the grace period has ended, send a client that has not 
+           asked to resume the messages withheld from it, unchanged, and 
+           every later message as it is sent. 
+    \param connection the client's connection.
+    \warning _connectionsMutex must be held. 
+    \return void
+    */
+    void ReleaseWithheldLocked(ConnectionTCP::pointer connection)
+    {
+        if (!connection->_awaitingResume)
+        {
+            return; // Resumed.
+        }
+
+        connection->_awaitingResume = false;
+        SendWithheldLocked(connection);
+    }
+
+    /*!
+    \fn SendWithheldLocked
+    \brief Queue the messages withheld from a connection, with their markers 
+           if it has asked to resume. 
+    \param connection the client's connection.
+    \warning _connectionsMutex must be held. 
+    \return void
+    */
+    void SendWithheldLocked(ConnectionTCP::pointer connection)
+    {
+        for (HeldMessage& held : connection->_withheld)
+        {
+            if (connection->_sequenced)
+            {
+                connection->SendSequenced(held.message, held.marker);
+            }
+            else
+            {
+                connection->SendMessage(held.message);
+            }
+        }
+        connection->_withheld.clear();
+    }
+
     /*!
     \fn MaintainConnections
     \brief Manages the list of current connections. 
@@ -294,14 +883,14 @@ private:
 
                 if (!socket.is_open())
                 {
-                    std::cout << "ServerTCP::sendMessages Connection closed, removing index: " << i << std::endl;
+                    LOG_WARNING("ServerTCP::sendMessages Connection closed, removing index: " << i);
                     _connections.remove(*it);
                 }
             }
 
             if (lastConnectionCount != _connections.size())
             {
-                std::cout << "ServerTCP::MaintainConnections Maintaining connections: " << _connections.size() << std::endl;
+                LOG_TRACE("ServerTCP::MaintainConnections Maintaining connections: " << _connections.size());
                 lastConnectionCount = _connections.size();
             }
 
@@ -314,12 +903,20 @@ private:
 
     boost::asio::io_context& io_context_; //!< The contect of the connection
     tcp::acceptor acceptor_; //!< The acceptor class used
+    LaneLatency _latency; //!< How long messages waited to be written, by class, across all connections.
+    std::shared_ptr<SlabPool<ConnectionTCP>> _pool; //!< Recycles connections once closed and released.
+    HeartbeatOptions _heartbeat; //!< Given to each connection.
+    TimerWheel _wheel; //!< Drives every connection's heartbeats, after _pool so destroyed first, releasing the connections it holds.
 
     std::list<ConnectionTCP::pointer> _connections; //!< List of current connections
     std::mutex _connectionsMutex; //!< Mutex for the connections list
     
     std::thread _threadMaintainConnections; //!< Thread container for the MaiantainConnections method
 
+    std::size_t _resumeHistory = 0; //!< The most messages held to resume clients, 0 if disabled.
+    std::deque<HeldMessage> _history; //!< Recent messages by sequence number, guarded by _connectionsMutex.
+    std::uint64_t _sequence = 0; //!< The sequence number of the last message sent, guarded by _connectionsMutex.
+
     int _port; //!< TODO: The port number ot listen on.
     std::string _serverName = "Boost.ASIO Test"; //!< TODO: Textual description of the server. 
 
@@ -346,18 +943,24 @@ private:
     
     bool _healthy;  //!< Store if the server is healthy.  
     int _port;
+    std::size_t _resumeHistory; //!< The number of messages kept to resume clients, 0 if disabled.
+    HeartbeatOptions _heartbeat; //!< When each connection sends heartbeats and times out.
 
 public: 
     /*!
     \fn ConnectionManager
     \brief A constructor for the connection manager class. 
+    \param resumeHistory the number of messages kept to resume clients, see ServerTCP.
+    \param heartbeat when each connection sends heartbeats and times out, see ServerTCP.
     \return void
     */
-    ConnectionManager(int port)
+    ConnectionManager(int port, std::size_t resumeHistory = 0, HeartbeatOptions heartbeat = HeartbeatOptions())
     {
         _healthy = true;
         _port = port;
-        std::cout << "main::createServer initialised." << std::endl;
+        _resumeHistory = resumeHistory;
+        _heartbeat = heartbeat;
+        LOG_INFO("main::createServer initialised.");
         _threadStart = std::thread(&ConnectionManager::Start, this);
         return;
     }
@@ -382,41 +985,72 @@ public:
     void Start()
     {
         boost::asio::io_context context;
-        ServerTCP server(context, _port);
+        ServerTCP server(context, _port, _resumeHistory, _heartbeat);
         _server = &(server);
         _healthy = true;
         context.run();
 
         //This will only run if the server fails....
         _healthy = false;
-        std::cout << "main::createServer SERVER FAILED." << std::endl;
+        LOG_ERROR("main::createServer SERVER FAILED.");
     }
 
     /*!
     \fn SendMessage
     \brief Send a message to all connected clients. 
     \param message the text desired to be sent to all connected parties.
+    \param traffic the message's class.
     \return void
     */
-    void SendMessage(std::string message)
+    void SendMessage(std::string message, TrafficClass traffic = TrafficClass::Bulk)
     {
-        _server->SendMessage(message);
+        _server->SendMessage(std::move(message), traffic);
     }
 
     /*!
-    \fn Healthy
-    \brief Returns if the connection manager is healthy. 
-    \return bool
+    \fn SendMessage
+    \brief Send a message shared with other senders to all connected clients, see ServerTCP. 
+    \return void
     */
-    bool Healthy()
+    void SendMessage(std::shared_ptr<const std::string> message, TrafficClass traffic = TrafficClass::Bulk)
     {
-        return _healthy;
+        _server->SendMessage(std::move(message), traffic);
     }
 
+    /*!
+    \fn SendMessage
+    \brief Send a message given in several buffers to all connected clients, copied once. 
+    \return void
+    */
+    void SendMessage(const std::vector<boost::asio::const_buffer>& buffers, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        _server->SendMessage(buffers, traffic);
+    }
 
-};
-
-/*!
+    /*!
+    \fn Latency
+    \brief Gets how long the messages of a class waited to be written, across all connections. 
+    \return The statistics.
+    */
+    LatencyStatistics Latency(TrafficClass traffic)
+    {
+        return _server->Latency(traffic);
+    }
+
+    /*!
+    \fn Healthy
+    \brief Returns if the connection manager is healthy. 
+    \return bool
+    */
+    bool Healthy()
+    {
+        return _healthy;
+    }
+
+
+};
+
+/*!
     \class ConnectionClient
     \brief Represents a client connection object
 
@@ -437,11 +1071,76 @@ private:
 
     std::queue<std::string> _buffer; //!< a queue of messages received.
     std::mutex _bufferMutex; //!< Mutex for the buffer
+    std::condition_variable _bufferCondition; //!< Signalled when a route receives a frame or the client stops.
     std::time_t _lastMessageReceived; //!< The time a message was last received.
 
+    typedef std::function<void(const boost::system::error_code&, const std::string&)> Waiter; //!< Completes one asynchronous receive.
+
+    /*!
+        \struct LatestSlot
+        \brief The most recent element of one tag name, optionally per key.
+    */
+    struct LatestSlot
+    {
+        std::string keyAttribute; //!< The attribute identifying elements, empty if not keyed, guarded by _bufferMutex.
+        std::shared_ptr<const std::string> value; //!< The latest element of any key, guarded by valueMutex.
+        std::map<std::string, std::shared_ptr<const std::string>> keyed; //!< The latest element per key, keys guarded by _latestMutex, values by valueMutex.
+        std::mutex valueMutex; //!< Held only to copy or replace a pointer.
+    };
+
+    /*!
+        \struct TagRoute
+        \brief The destination of complete elements of one tag name.
+    */
+    struct TagRoute
+    {
+        std::queue<std::string> frames; //!< Complete elements awaiting a consumer.
+        std::function<void(const std::string&)> handler; //!< If set, called instead of queueing.
+        std::queue<Waiter> waiters; //!< Asynchronous receives awaiting an element, served before the handler and queue.
+        bool consumed = false; //!< If elements are delivered, rather than only tracked as the latest.
+        LatestSlot* latest = nullptr; //!< If set, updated with every element.
+        bool text = false; //!< If elements are delivered as text, to a waiter, the handler or the queue.
+        bool parsed = false; //!< If elements are parsed on arrival and queued as documents.
+        std::queue<PooledXml> documents; //!< Parsed elements awaiting a consumer.
+    };
+
+    TagFramer _framer; //!< Frames the stream into top-level elements, guarded by _bufferMutex.
+    std::map<std::string, TagRoute> _routes; //!< Subscribed tags, guarded by _bufferMutex.
+    std::shared_ptr<XmlDocumentPool> _documentPool = XmlDocumentPool::Create(); //!< Documents for tags subscribed with SubscribeParsed.
+
+    std::map<std::string, LatestSlot> _latest; //!< Tracked tags, never erased, guarded by _latestMutex.
+    std::shared_mutex _latestMutex; //!< Held exclusively only to add a tag or key.
+
+    bool _linesSubscribed = false; //!< If \\r\\n terminated lines are framed, guarded by _bufferMutex.
+    std::string _lineFragment; //!< Bytes received after the last complete line, guarded by _bufferMutex.
+    std::queue<std::string> _lines; //!< Complete lines awaiting a consumer, guarded by _bufferMutex.
+
+    BufferLimits _limits; //!< Caps on everything buffered for consumers.
+    BufferCounters _counters; //!< What the caps have done.
+    std::size_t _bufferedBytes = 0; //!< Bytes held in _buffer, _lines and the tag routes, guarded by _bufferMutex.
+    std::size_t _bufferedMessages = 0; //!< Messages held in _buffer, _lines and the tag routes, guarded by _bufferMutex.
+
+    std::atomic<bool> _stopping{false}; //!< Set when the client is being destroyed.
+
+    ReconnectBackoff _backoff; //!< Delays between connection attempts, only used by the receive thread.
+    bool _resume = false; //!< If the server is asked to resume after the last sequence number received.
+    std::atomic<std::uint64_t> _lastSequence{0}; //!< The last <Seq n="k"/> received.
+    std::string _sequenceTail; //!< The end of the last read, in case a sequence number is split, only used by the receive thread.
+
+    std::unique_ptr<CaptureLog> _capture; //!< If set, records the input received, guarded by _captureMutex.
+    std::mutex _captureMutex; //!< Held by the receive thread only while capturing a read, never while a log is destroyed.
+
     boost::asio::io_context io_context;  //!< the client context in which to create the connection.
+    tcp::socket _socket{io_context}; //!< The socket, only opened and closed by the receive thread.
+
+    HeartbeatOptions _heartbeat; //!< When heartbeats are sent and the server given up on.
+    TimerWheel _wheel{io_context}; //!< Drives the heartbeat checks, run by the receive thread while reading.
+    std::chrono::steady_clock::time_point _lastRead; //!< When the server last sent anything, only used by the receive thread.
+    std::chrono::steady_clock::time_point _lastWrite; //!< When the client last wrote, only used by the receive thread.
+    bool _heartbeatWriting = false; //!< If a heartbeat is being written, only used by the receive thread.
 
     std::thread _threadMaintainConnection; //!< The thread used to maintain connection.
+    std::vector<std::thread> _workers; //!< Consumer group threads started by StartWorkers.
 
     /*!
     \fn MaintainConnection
@@ -451,74 +1150,590 @@ private:
     */
     void MaintainConnection()
     {
-        while(true)
+        while(!_stopping)
         {
             try
             {
-                std::cout << "ConnectionClient::MaintainConnection Attempting to open: " << _address << ":" << _port << std::endl;
-                tcp::socket s(io_context);
-                tcp::resolver resolver(io_context);
-                boost::asio::connect(s, resolver.resolve(_address, std::to_string(_port)));
-                std::cout << "ConnectionClient::MaintainConnection Connected." << std::endl;
+                LOG_INFO("ConnectionClient::MaintainConnection Attempting to open: " << _address << ":" << _port);
+                tcp::socket& s = _socket;
+                Connect();
+                LOG_INFO("ConnectionClient::MaintainConnection Connected.");
 
-                while(s.is_open())
+                if (_resume)
                 {
+                    boost::asio::write(s, boost::asio::buffer("<Resume seq=\"" + std::to_string(_lastSequence) + "\"/>"));
+                }
+                StartHeartbeat();
+
+                while(s.is_open() && !_stopping)
+                {
+                    AwaitSpace();
+                    _lastRead = std::chrono::steady_clock::now(); // Not reading while the consumers catch up is not the server's silence.
+
                     char replyC[_maxLength];
-                    boost::asio::read(s, boost::asio::buffer(replyC, _maxLength));
-                    //std::string replyS(replyC);  
-                    std::string replyS;
+                    std::size_t length = ReadSome(boost::asio::buffer(replyC, _maxLength));
+                    std::string replyS(replyC, length);
+                    _backoff.Reset(); // The connection works.
+                    if (_heartbeat.Enabled())
+                    {
+                        DiscardHeartbeats(replyS);
+                    }
 
-                    for (char c : replyC)
+                    if (_resume)
                     {
-                        if (c < 128)
-                        {
-                            replyS = replyS + c;
-                        }
+                        TrackSequence(replyS);
                     }
-                    
 
-                    std::unique_lock<std::mutex> pushGuard(_bufferMutex);
-                    _buffer.push(replyS);
-                    pushGuard.unlock();
+                    Dispatch(replyS);
 
+                    std::unique_lock<std::mutex> captureGuard(_captureMutex);
+                    if (_capture)
+                    {
+                        _capture->Capture(replyC, length); // Never blocks.
+                    }
+                    captureGuard.unlock();
+                }
+            }
+            catch (std::exception& e)
+            {
+                boost::system::error_code ignored;
+                _socket.close(ignored);
+                _wheel.Stop(); // The checks were for this connection.
+                _heartbeatWriting = false;
 
+                if (_stopping)
+                {
+                    break;
+                }
 
-                    bool logInput = false;
+                LOG_WARNING("ConnectionClient::MaintainConnection Exception @ " << _address << ":" << _port << " What: " << e.what());
 
-                    if (logInput)
-                    {
-                        const std::string _logPath = "./log";
+                std::chrono::milliseconds delay = _backoff.Next();
+                LOG_WARNING("ConnectionClient::MaintainConnection Retrying in " << delay.count() << " ms.");
+                _sequenceTail.clear();
 
-                        using namespace std::chrono;
-                        auto timepoint = system_clock::now();
-                        auto coarse = system_clock::to_time_t(timepoint);
-                        auto fine = time_point_cast<std::chrono::milliseconds>(timepoint);
+                std::unique_lock<std::mutex> clearGuard(_bufferMutex);
+                _framer.Clear(); // A partial element can not be completed by a new connection.
+                _lineFragment.clear();
+                _bufferCondition.wait_for(clearGuard, delay, [this] { return _stopping.load(); });
+                clearGuard.unlock();
+            }
+        }
 
-                        char buffer[sizeof "9999-12-31 23:59:59.999"];
-                        std::snprintf(buffer + std::strftime(buffer, sizeof buffer - 3,
-                                        "%F %T.", std::localtime(&coarse)),
-                                        4, "%03lu", fine.time_since_epoch().count() % 1000);
+    }
 
-                        std::string fileName = _logPath + "/" + buffer + "-ClientTCP.log";
+    /*!
+    \fn Connect
+    \brief Connect _socket to the first endpoint to answer, staggering the 
+           attempts, with endpoints cached so a slow DNS server does not delay 
+           a reconnect. 
+    \warning Called on the receive thread. Throws boost::system::system_error on failure.
+    \return void
+    */
+    void Connect()
+    {
+        std::string port = std::to_string(_port);
+        EndpointCache::Endpoints endpoints = EndpointCache::Shared()->Resolve(_address, port);
+
+        bool done = false;
+        boost::system::error_code error = boost::asio::error::operation_aborted;
+        io_context.restart();
+        AsyncConnectStaggered(_socket, endpoints, EndpointCache::ConnectionAttemptDelay,
+            [&done, &error](const boost::system::error_code& connectError, const tcp::endpoint&)
+            {
+                error = connectError;
+                done = true;
+            });
+        while (!done && !_stopping && (io_context.run_one() > 0)) // Stopped by the destructor.
+        {
+        }
 
-                        std::ofstream logFile;
-                        logFile.open (fileName, std::ios::app);
+        if (error) // Left as operation_aborted if the connect was abandoned, its handler never being called.
+        {
+            if (error != boost::asio::error::operation_aborted)
+            {
+                EndpointCache::Shared()->Expire(_address, port); // The host may have moved.
+            }
+            throw boost::system::system_error(error);
+        }
+    }
 
-                        logFile << replyS << std::endl;
+    /*!
+    \fn ReadSome
+    \brief Read what has arrived, waiting for at least a byte, running the 
+           heartbeat checks while waiting. 
+    \param buffer where to read into.
+    \warning Called on the receive thread. Throws boost::system::system_error on 
+             failure, including when a check has closed the socket.
+    \return the number of bytes read.
+    */
+    std::size_t ReadSome(boost::asio::mutable_buffer buffer)
+    {
+        bool done = false;
+        boost::system::error_code error = boost::asio::error::operation_aborted;
+        std::size_t length = 0;
+        if (io_context.stopped())
+        {
+            io_context.restart(); // Out of work once connected. Still stopped by the destructor, as it sets _stopping first.
+        }
+        _socket.async_read_some(buffer,
+            [&done, &error, &length](const boost::system::error_code& readError, std::size_t readLength)
+            {
+                error = readError;
+                length = readLength;
+                done = true;
+            });
+        while (!done && !_stopping && (io_context.run_one() > 0)) // Stopped by the destructor.
+        {
+        }
 
-                        logFile.close();
-                    }
+        if (error) // Left as operation_aborted if the read was abandoned, its handler never being called.
+        {
+            throw boost::system::system_error(error);
+        }
+        _lastRead = std::chrono::steady_clock::now();
+        return length;
+    }
+
+    /*!
+    \fn StartHeartbeat
+    \brief Start checking a new connection, if heartbeats are enabled. 
+    \warning Called on the receive thread once connected. 
+    \return void
+    */
+    void StartHeartbeat()
+    {
+        _lastRead = _lastWrite = std::chrono::steady_clock::now();
+        if (_heartbeat.Enabled())
+        {
+            ScheduleHeartbeat();
+        }
+    }
+
+    /*!
+    \fn ScheduleHeartbeat
+    \brief Check the connection again when the next heartbeat or timeout is due. 
+    \return void
+    */
+    void ScheduleHeartbeat()
+    {
+        std::chrono::steady_clock::time_point due = std::chrono::steady_clock::time_point::max();
+        if (_heartbeat.interval.count() > 0)
+        {
+            due = std::min(due, _lastWrite + _heartbeat.interval);
+        }
+        if (_heartbeat.timeout.count() > 0)
+        {
+            due = std::min(due, _lastRead + _heartbeat.timeout);
+        }
+        _wheel.Schedule(due - std::chrono::steady_clock::now(), [this]() { CheckHeartbeat(); });
+    }
+
+    /*!
+    \fn CheckHeartbeat
+    \brief Close the socket if nothing has been read for the timeout, failing 
+           the read so the connection is made again, or write a heartbeat if 
+           nothing has been written for the interval. 
+    \warning Called on the receive thread by the TimerWheel, while reading. 
+    \return void
+    */
+    void CheckHeartbeat()
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if ((_heartbeat.timeout.count() > 0) && (now - _lastRead >= _heartbeat.timeout))
+        {
+            LOG_WARNING("ConnectionClient::CheckHeartbeat Nothing read for " << _heartbeat.timeout.count() << " ms, closing.");
+            boost::system::error_code ignored;
+            _socket.shutdown(tcp::socket::shutdown_both, ignored);
+            _socket.close(ignored);
+            return;
+        }
+
+        if ((_heartbeat.interval.count() > 0) && (now - _lastWrite >= _heartbeat.interval) && !_heartbeatWriting)
+        {
+            _heartbeatWriting = true;
+            _lastWrite = now;
+            boost::asio::async_write(_socket, boost::asio::buffer(_heartbeat.message),
+                [this](const boost::system::error_code&, std::size_t)
+                {
+                    _heartbeatWriting = false; // A failure is left to the read to notice.
+                });
+        }
+
+        ScheduleHeartbeat();
+    }
+
+    /*!
+    \fn DiscardHeartbeats
+    \brief Remove the server's heartbeats from data received. A heartbeat 
+           split across reads is passed on, and ignored unless its tag is 
+           subscribed.
+    \param data the bytes received.
+    \return void
+    */
+    void DiscardHeartbeats(std::string& data)
+    {
+        std::size_t at = data.find(_heartbeat.message);
+        while (at != std::string::npos)
+        {
+            data.erase(at, _heartbeat.message.size());
+            at = data.find(_heartbeat.message, at);
+        }
+    }
+
+    /*!
+    \fn TrackSequence
+    \brief Note the last complete <Seq n="k"/> received, to resume from it. 
+    \param data the bytes received.
+    \warning Called on the receive thread. 
+    \return void
+    */
+    void TrackSequence(const std::string& data)
+    {
+        const std::string marker = "<Seq n=\"";
+
+        _sequenceTail.append(data);
+
+        std::size_t at = _sequenceTail.rfind(marker);
+        while (at != std::string::npos)
+        {
+            std::size_t close = _sequenceTail.find("\"/>", at + marker.size());
+            if (close != std::string::npos)
+            {
+                _lastSequence = std::strtoull(_sequenceTail.c_str() + at + marker.size(), nullptr, 10);
+                break;
+            }
+            at = (at == 0) ? std::string::npos : _sequenceTail.rfind(marker, at - 1); // The last is incomplete.
+        }
+
+        const std::size_t keep = 32; // Longer than a whole marker.
+        if (_sequenceTail.size() > keep)
+        {
+            _sequenceTail.erase(0, _sequenceTail.size() - keep);
+        }
+    }
+
+    /*!
+    \fn Dispatch
+    \brief Hands received data to the consumers. 
+    \param data the bytes received.
+    \warning Called on the receive thread. 
+    \return void
+    */
+    void Dispatch(const std::string& data)
+    {
+        std::vector<std::function<void()>> handled;
+
+        std::unique_lock<std::mutex> pushGuard(_bufferMutex);
+
+        if (_routes.empty() && !_linesSubscribed)
+        {
+            PushBounded(_buffer, data, _bufferedBytes, _bufferedMessages, _limits, _counters); // Nobody subscribed yet, hold until they do.
+        }
+        else
+        {
+            Route(data, handled);
+        }
 
+        pushGuard.unlock();
 
+        for (auto& item : handled)
+        {
+            item();
+        }
+    }
+
+    /*!
+    \fn Route
+    \brief Frames the data and delivers each element to its route. 
+    \param data the bytes received.
+    \param handled collects the deliveries to handlers and waiters, to be called without the lock held.
+    \warning _bufferMutex must be held. 
+    \return void
+    */
+    void Route(const std::string& data, std::vector<std::function<void()>>& handled)
+    {
+        bool queued = false;
+
+        if (_linesSubscribed)
+        {
+            queued = RouteLines(data);
+        }
+
+        if (_routes.empty())
+        {
+            if (queued)
+            {
+                _bufferCondition.notify_all();
+            }
+            return;
+        }
+
+        _framer.Append(data.data(), data.size());
+
+        std::string tag;
+        std::string frame;
+
+        while (_framer.Next(tag, frame))
+        {
+            auto route = _routes.find(tag);
+            if (route == _routes.end())
+            {
+                continue; // Nobody wants it.
+            }
+
+            if (route->second.latest != nullptr)
+            {
+                UpdateLatest(*route->second.latest, frame);
+            }
+
+            if (!route->second.consumed)
+            {
+                continue; // Only tracked as the latest.
+            }
+
+            if (route->second.parsed)
+            {
+                std::string copy;
+                if (route->second.text)
+                {
+                    copy = frame; // Also delivered as text below.
+                }
+                PooledXml document = _documentPool->Parse(route->second.text ? copy : frame); // Takes the text without copying.
+                if (document)
+                {
+                    queued |= PushBounded(route->second.documents, std::move(document), _bufferedBytes, _bufferedMessages, _limits, _counters);
+                }
+
+                if (!route->second.text)
+                {
+                    continue;
                 }
             }
-            catch (std::exception& e)
+
+            if (!route->second.waiters.empty())
+            {
+                Waiter waiter = std::move(route->second.waiters.front());
+                route->second.waiters.pop();
+                handled.emplace_back([waiter, frame]() { waiter(boost::system::error_code(), frame); });
+            }
+            else if (route->second.handler)
+            {
+                std::function<void(const std::string&)>& handler = route->second.handler;
+                handled.emplace_back([handler, frame]() { handler(frame); });
+            }
+            else
+            {
+                queued |= PushBounded(route->second.frames, std::move(frame), _bufferedBytes, _bufferedMessages, _limits, _counters);
+            }
+        }
+
+        if (queued)
+        {
+            _bufferCondition.notify_all();
+        }
+    }
+
+    /*!
+    \fn RouteLines
+    \brief Splits the data into \\r\\n terminated lines, queueing each non empty line. 
+    \param data the bytes received.
+    \warning _bufferMutex must be held. 
+    \return true if a line was queued.
+    */
+    bool RouteLines(const std::string& data)
+    {
+        bool queued = false;
+        std::size_t scan = (_lineFragment.empty()) ? 0 : _lineFragment.size() - 1; // "\r" may already be held.
+        _lineFragment.append(data);
+
+        std::size_t head = 0;
+        std::size_t end;
+        while ((end = _lineFragment.find("\r\n", scan)) != std::string::npos)
+        {
+            if (end > head)
             {
-                std::cout << "ConnectionClient::MaintainConnection Exception @ " << _address << ":" << _port << " What: " << e.what() << std::endl;
-                std::this_thread::sleep_for (std::chrono::seconds(5));
+                queued |= PushBounded(_lines, _lineFragment.substr(head, end - head), _bufferedBytes, _bufferedMessages, _limits, _counters);
             }
+            head = end + 2;
+            scan = head;
         }
 
+        _lineFragment.erase(0, head);
+        return queued;
+    }
+
+    /*!
+    \fn SubscribeLocked
+    \brief Gets the route for the tag, creating it if required. 
+    \param tag the tag without < and > to route.
+    \param parsed if elements are to be parsed, rather than delivered as text.
+    \warning _bufferMutex must be held. 
+    \return The route.
+    */
+    TagRoute& SubscribeLocked(const std::string& tag, bool parsed = false)
+    {
+        TagRoute& route = _routes[tag];
+        route.consumed = true;
+        if (parsed)
+        {
+            route.parsed = true;
+        }
+        else
+        {
+            route.text = true;
+        }
+        ReplayLocked();
+        return route;
+    }
+
+    /*!
+    \fn AttributeValue
+    \brief Gets the value of an attribute of an element's start tag. 
+    \param frame the whole element.
+    \param name the attribute's name.
+    \return The value, or empty if the attribute is not present.
+    */
+    static std::string AttributeValue(const std::string& frame, const std::string& name)
+    {
+        std::size_t startEnd = frame.find('>');
+        std::size_t at = frame.find(name, 1);
+
+        while ((at != std::string::npos) && (at < startEnd))
+        {
+            std::size_t equals = at + name.size();
+            if ((std::isspace(static_cast<unsigned char>(frame[at - 1])) != 0) && (equals + 1 < frame.size()) && (frame[equals] == '=')
+                && ((frame[equals + 1] == '"') || (frame[equals + 1] == '\'')))
+            {
+                std::size_t close = frame.find(frame[equals + 1], equals + 2);
+                if (close != std::string::npos)
+                {
+                    return frame.substr(equals + 2, close - equals - 2);
+                }
+            }
+            at = frame.find(name, at + 1);
+        }
+        return std::string();
+    }
+
+    /*!
+    \fn UpdateLatest
+    \brief Replace the latest element of a tracked tag. 
+    \param slot the tag's slot.
+    \param frame the whole element.
+    \return void
+    */
+    void UpdateLatest(LatestSlot& slot, const std::string& frame)
+    {
+        std::shared_ptr<const std::string> value = std::make_shared<const std::string>(frame);
+
+        if (!slot.keyAttribute.empty())
+        {
+            std::string key = AttributeValue(frame, slot.keyAttribute);
+
+            std::shared_lock<std::shared_mutex> readGuard(_latestMutex);
+            auto keyed = slot.keyed.find(key);
+            if (keyed != slot.keyed.end())
+            {
+                std::lock_guard<std::mutex> valueGuard(slot.valueMutex);
+                keyed->second = value;
+            }
+            else
+            {
+                readGuard.unlock();
+                std::unique_lock<std::shared_mutex> writeGuard(_latestMutex); // First element of this key.
+                std::lock_guard<std::mutex> valueGuard(slot.valueMutex);
+                slot.keyed[key] = value;
+            }
+        }
+
+        std::lock_guard<std::mutex> valueGuard(slot.valueMutex);
+        slot.value = value;
+    }
+
+    /*!
+    \fn ReplayLocked
+    \brief Frames anything received before the first subscription. 
+    \warning _bufferMutex must be held and a route subscribed. 
+    \return void
+    */
+    void ReplayLocked()
+    {
+        std::vector<std::function<void()>> handled;
+        while (!_buffer.empty())
+        {
+            Route(TakeLocked(_buffer), handled);
+        }
+    }
+
+    /*!
+    \fn TakeLocked
+    \brief Removes the oldest message of a buffer, releasing its share of the limits. 
+    \param buffer the buffer to take from, which must not be empty.
+    \warning _bufferMutex must be held. 
+    \return The message.
+    */
+    template <typename Message>
+    Message TakeLocked(std::queue<Message>& buffer)
+    {
+        Message message = std::move(buffer.front());
+        buffer.pop();
+
+        _bufferedBytes -= MessageSize(message);
+        _bufferedMessages--;
+
+        if (_limits.policy == OverflowPolicy::Backpressure)
+        {
+            _bufferCondition.notify_all(); // The receive thread may be waiting for space.
+        }
+
+        return message;
+    }
+
+    /*!
+    \fn AwaitSpace
+    \brief Under Backpressure, stop reading while the buffers are full, so 
+           TCP flow control slows the sender. 
+    \warning Called on the receive thread. 
+    \return void
+    */
+    void AwaitSpace()
+    {
+        if (_limits.policy != OverflowPolicy::Backpressure)
+        {
+            return;
+        }
+
+        std::unique_lock<std::mutex> spaceGuard(_bufferMutex);
+        if (_limits.Full(_bufferedBytes, _bufferedMessages))
+        {
+            _counters.readsPaused++;
+            _bufferCondition.wait(spaceGuard, [this] { return !_limits.Full(_bufferedBytes, _bufferedMessages) || _stopping; });
+        }
+    }
+
+    /*!
+    \fn WaitFrame
+    \brief Waits for the next element of the tag. 
+    \param tag the tag without < and > to wait for.
+    \param content set to the whole element.
+    \warning Blocks until an element is available or the client stops.  
+    \return false if the client stopped before an element was available.
+    */
+    bool WaitFrame(const std::string& tag, std::string& content)
+    {
+        std::unique_lock<std::mutex> processGuard(_bufferMutex);
+        TagRoute& route = SubscribeLocked(tag);
+
+        _bufferCondition.wait(processGuard, [this, &route] { return !route.frames.empty() || _stopping; });
+
+        if (route.frames.empty())
+        {
+            return false;
+        }
+
+        content = TakeLocked(route.frames);
+        return true;
     }
 
 protected:
@@ -528,16 +1743,28 @@ public:
     /*!
     \fn ConnectionClient
     \brief A constructor for the connection client class. 
+    \param limits caps on the data buffered for consumers, unlimited by default.
+    \param backoff the delays between connection attempts.
+    \param resume if, on reconnecting, a ServerTCP with a resume history is asked 
+           to send the messages missed. Its <Seq n="k"/> elements are discarded 
+           unless subscribed.
+    \param heartbeat when heartbeats are sent, and the connection made again 
+           once the server has sent nothing, e.g. a ServerTCP's heartbeats, 
+           which are discarded. Off by default.
     \return void
     */
-    ConnectionClient(std::string address, int port)
+    ConnectionClient(std::string address, int port, BufferLimits limits = BufferLimits(), ReconnectBackoff backoff = ReconnectBackoff(), bool resume = false, HeartbeatOptions heartbeat = HeartbeatOptions())
     {
         _address = address;
         _port = port;
+        _limits = limits;
+        _backoff = backoff;
+        _resume = resume;
+        _heartbeat = heartbeat;
 
         _threadMaintainConnection = std::thread(&ConnectionClient::MaintainConnection, this);
 
-        std::cout << "ConnectionClient::ConnectionClient Initialised." << std::endl;
+        LOG_INFO("ConnectionClient::ConnectionClient Initialised.");
     }
 
     /*!
@@ -547,7 +1774,38 @@ public:
     */
     ~ConnectionClient()
     {
-        _threadMaintainConnection.~thread();
+        std::vector<Waiter> aborted;
+        std::unique_lock<std::mutex> stopGuard(_bufferMutex);
+        _stopping = true;
+        _bufferCondition.notify_all();
+        for (auto& route : _routes)
+        {
+            while (!route.second.waiters.empty())
+            {
+                aborted.push_back(std::move(route.second.waiters.front()));
+                route.second.waiters.pop();
+            }
+        }
+        stopGuard.unlock();
+
+        for (Waiter& waiter : aborted)
+        {
+            waiter(boost::asio::error::operation_aborted, std::string());
+        }
+
+        boost::asio::post(io_context, [this]()
+        {
+            boost::system::error_code ignored; // Run by the receive thread, the only one to use the socket.
+            _socket.shutdown(tcp::socket::shutdown_both, ignored);
+            _socket.close(ignored);
+        });
+        io_context.stop(); // Wakes a connect or read. If the shutdown is not run, the receive thread closes the socket as it stops.
+
+        _threadMaintainConnection.join();
+        for (std::thread& worker : _workers)
+        {
+            worker.join();
+        }
         //io_context.~io_context();
 
         std::unique_lock<std::mutex> clearGuard(_bufferMutex);
@@ -557,7 +1815,7 @@ public:
         }
         clearGuard.unlock();
 
-        std::cout << "ConnectionClient::ConnectionClient destroyed." << std::endl;
+        LOG_INFO("ConnectionClient::ConnectionClient destroyed.");
     }
 
     /*!
@@ -569,203 +1827,394 @@ public:
     {
         int bufferSize;
         std::unique_lock<std::mutex> sizeGuard(_bufferMutex);
-        bufferSize = _buffer.size();
+        bufferSize = _buffer.size() + _lines.size();
+        for (auto& route : _routes)
+        {
+            bufferSize += route.second.frames.size() + route.second.documents.size();
+        }
         sizeGuard.unlock();
         return bufferSize;
 
     }
 
     /*!
-    \fn AwaitTag
-    \brief Gets the next content in the buffer enclosed in the tag. 
-    \param the Tag without < and > tags to look for.
-    \warning Blocks until tag found in buffer.  
-    \return The whole content, including tags with < > within the tag name.
+    \fn Statistics
+    \brief Gets the buffer limit counters and the data currently buffered. 
+    \return The statistics.
     */
-    std::string AwaitTag(std::string tag)
+    BufferStatistics Statistics()
     {
-        std::string fragment;
-
-        std::string tagStart = "<" + tag;
-        std::string tagEnd = "</" + tag + ">";
-
-        while (true)
-        {
-
-            while (!_buffer.empty())
-            {
-                bool partialMessageReceived = false;
-                std::string tagContent;
-
-                std::unique_lock<std::mutex> processGuard(_bufferMutex);
+        std::lock_guard<std::mutex> statisticsGuard(_bufferMutex);
+        return _counters.Snapshot(_bufferedBytes, _bufferedMessages);
+    }
 
-                std::string front = _buffer.front();
-                _buffer.pop();
+    /*!
+    \fn LastSequence
+    \brief Gets the sequence number of the last complete message received from 
+           a server with a resume history. 
+    \return The number, 0 if none.
+    */
+    std::uint64_t LastSequence()
+    {
+        return _lastSequence;
+    }
 
-                fragment = fragment + front;
+    /*!
+    \fn StartCapture
+    \brief Record everything received to a rotating capture file, without 
+           blocking the receive thread. 
+    \param path the file to write, rotated to path.1, path.2...
+    \param fileSize the size at which the file is rotated.
+    \param files the number of files kept.
+    \note Data received while the writer is behind is not recorded, see 
+           CaptureLog::Dropped.
+    \return void
+    */
+    void StartCapture(std::string path = "./log/ClientTCP.capture", std::size_t fileSize = 64 * 1024 * 1024, int files = 4)
+    {
+        std::unique_ptr<CaptureLog> capture(new CaptureLog(path, fileSize, files));
 
-                size_t start = fragment.find(tagStart);
-                size_t end = fragment.find(tagEnd);
+        std::unique_lock<std::mutex> captureGuard(_captureMutex);
+        _capture.swap(capture);
+        captureGuard.unlock();
+        // Any previous log is written and closed here, rather than on the receive thread.
+    }
 
-                if ((start == std::string::npos) && (end == std::string::npos)) // Nothing there of value
-                {
-                    fragment = "";
-                    partialMessageReceived = true;
-                    //std::cout << "ConnectionClient::AwaitTag No Start Tag Received." << std::endl;
-                }
-                else if ((start != std::string::npos) && (end != std::string::npos)) //Extract out data, sort out buffer and return.
-                {
-                    int bufferSize = _buffer.size();
-                    end = end + tagEnd.size();
+    /*!
+    \fn StopCapture
+    \brief Stop recording, once everything captured so far is written.
+    \warning Blocks until the log is written, on the calling thread.
+    \return void
+    */
+    void StopCapture()
+    {
+        std::unique_ptr<CaptureLog> capture;
 
-                    std::string leftOver = fragment.substr(end, (fragment.size() - end));
+        std::unique_lock<std::mutex> captureGuard(_captureMutex);
+        _capture.swap(capture);
+        captureGuard.unlock();
+    }
 
-                    
-                    if (start < end)
-                    {
-                        tagContent = fragment.substr(start, end);
-                    }
-                    else
-                    {
-                        std::cout << "------------------------------" << std::endl;
-                        std::cout << "BUFFER ERROR" << std::endl;
-                        std::cout << "------------------------------" << std::endl;
-                        std::cout << "Fragment:" << start << " " << end << std::endl;
-                        std::cout << fragment << std::endl;
+    /*!
+    \fn TrackLatest
+    \brief Keep the latest element of the tag, so it can be read with GetLatest 
+           without consuming a queue. 
+    \param tag the Tag without < and > tags to track.
+    \param keyAttribute if set, the latest element is also kept per value of 
+           this attribute, e.g. "id".
+    \note Tracking alone does not queue elements of the tag. 
+    \return void
+    */
+    void TrackLatest(std::string tag, std::string keyAttribute = "")
+    {
+        std::unique_lock<std::mutex> subscribeGuard(_bufferMutex); // Taken before _latestMutex, as by the receive thread.
+        std::unique_lock<std::shared_mutex> writeGuard(_latestMutex);
+        LatestSlot& slot = _latest[tag];
+        slot.keyAttribute = keyAttribute;
+        writeGuard.unlock();
+
+        _routes[tag].latest = &slot;
+        ReplayLocked();
+        subscribeGuard.unlock();
+    }
 
-                        std::cout << "Content:" << std::endl;
-                        std::cout << tagContent << std::endl;
+    /*!
+    \fn GetLatest
+    \brief Gets the latest element of a tag tracked with TrackLatest. 
+    \param tag the Tag without < and > tags.
+    \note Returns immediately; readers only share a lock with the receive 
+          thread, which holds it exclusively just to add a new key, and hold 
+          the slot's lock only to copy the pointer.
+    \return The whole element, or nullptr if none has been received.
+    */
+    std::shared_ptr<const std::string> GetLatest(const std::string& tag)
+    {
+        std::shared_lock<std::shared_mutex> readGuard(_latestMutex);
+        auto slot = _latest.find(tag);
+        if (slot == _latest.end())
+        {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> valueGuard(slot->second.valueMutex);
+        return slot->second.value;
+    }
 
-                        std::cout << "LeftOvers: " << std::endl;
-                        std::cout << leftOver << std::endl;
+    /*!
+    \fn GetLatest
+    \brief Gets the latest element of a tag and key tracked with TrackLatest. 
+    \param tag the Tag without < and > tags.
+    \param key the value of the key attribute.
+    \return The whole element, or nullptr if none has been received.
+    */
+    std::shared_ptr<const std::string> GetLatest(const std::string& tag, const std::string& key)
+    {
+        std::shared_lock<std::shared_mutex> readGuard(_latestMutex);
+        auto slot = _latest.find(tag);
+        if (slot == _latest.end())
+        {
+            return nullptr;
+        }
 
-                        std::cout << "Buffer: " << std::endl;
+        auto keyed = slot->second.keyed.find(key);
+        if (keyed == slot->second.keyed.end())
+        {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> valueGuard(slot->second.valueMutex);
+        return keyed->second;
+    }
 
-                        for (unsigned long i = 0; i < _buffer.size(); i++)
-                        {
-                            std::string message = _buffer.front();
-                            _buffer.pop();
-                            _buffer.push(message);
-                            std::cout << "\t["<< i << "] " << message << std::endl;
-                        }
-                        std::cout << "------------------------------" << std::endl;
+    /*!
+    \fn Subscribe
+    \brief Start queueing complete elements of the tag. 
+    \param tag the Tag without < and > tags to queue.
+    \note Once any tag is subscribed the stream is framed on the receive thread 
+           and elements of tags nobody subscribed to are discarded.  
+    \return void
+    */
+    void Subscribe(std::string tag)
+    {
+        std::unique_lock<std::mutex> subscribeGuard(_bufferMutex);
+        SubscribeLocked(tag);
+        subscribeGuard.unlock();
+    }
 
+    /*!
+    \fn RegisterHandler
+    \brief Deliver complete elements of the tag to a handler instead of a queue. 
+    \param tag the Tag without < and > tags to handle.
+    \param handler called on the receive thread with the whole element. 
+    \warning The handler delays receipt of further data until it returns.
+    \return void
+    */
+    void RegisterHandler(std::string tag, std::function<void(const std::string&)> handler)
+    {
+        std::unique_lock<std::mutex> subscribeGuard(_bufferMutex);
+        TagRoute& route = SubscribeLocked(tag);
+        route.handler = handler;
+        std::queue<std::string> queued;
+        while (!route.frames.empty())
+        {
+            queued.push(TakeLocked(route.frames));
+        }
+        subscribeGuard.unlock();
 
-                        fragment = "";
-                    }
+        while (!queued.empty())
+        {
+            handler(queued.front());
+            queued.pop();
+        }
+    }
 
-                    if (leftOver.size() > 0)
-                    {
-                        _buffer.push(leftOver);
-                    }
+    /*!
+    \fn AwaitTag
+    \brief Gets the next content in the buffer enclosed in the tag. 
+    \param the Tag without < and > tags to look for.
+    \warning Blocks until tag found in buffer. Subscribes to the tag on first use. 
+             Safe to call from several threads, each element is returned once.  
+    \return The whole content, including tags with < > within the tag name, 
+            or empty if the client is destroyed while waiting.
+    */
+    std::string AwaitTag(std::string tag)
+    {
+        std::string tagContent;
+        WaitFrame(tag, tagContent);
+        return tagContent;
+    }
 
-                    for (int i = 0; i < bufferSize; i++)
-                    {
-                        std::string message = _buffer.front();
-                        _buffer.pop();
-                        _buffer.push(message);
-                    }
+    /*!
+    \fn SubscribeParsed
+    \brief Parse complete elements of the tag on arrival, queueing them as 
+           documents for AwaitParsed. 
+    \param tag the Tag without < and > tags to parse.
+    \note Each element is parsed in situ in a document recycled from a pool, 
+           so neither the text nor the document is copied or allocated per 
+           element. Elements that are not well formed are discarded. If the 
+           tag is also consumed as text, e.g. with AwaitTag or a handler, each 
+           element is delivered both ways, its text then being copied.
+    \return void
+    */
+    void SubscribeParsed(std::string tag)
+    {
+        std::unique_lock<std::mutex> subscribeGuard(_bufferMutex);
+        SubscribeLocked(tag, true);
+        subscribeGuard.unlock();
+    }
 
-                }
-                else //Partial message received.
-                {
-                    //std::cout << "ConnectionClient::AwaitTag Partial Message Received." << std::endl;
-                    partialMessageReceived = true;
-                }
+    /*!
+    \fn AwaitParsed
+    \brief Gets the next parsed element of the tag. 
+    \param tag the Tag without < and > tags to look for.
+    \warning Blocks until an element is available. Subscribes to the tag with 
+             SubscribeParsed on first use. Safe to call from several threads.  
+    \return The element, returned to the pool when the handle is dropped, or 
+            an empty handle if the client is destroyed while waiting.
+    */
+    PooledXml AwaitParsed(std::string tag)
+    {
+        std::unique_lock<std::mutex> processGuard(_bufferMutex);
+        TagRoute& route = _routes[tag];
+        if (!route.parsed)
+        {
+            SubscribeLocked(tag, true);
+        }
 
-                int bufferSize = _buffer.size();
-                processGuard.unlock();
+        _bufferCondition.wait(processGuard, [this, &route] { return !route.documents.empty() || _stopping; });
 
-                if (!tagContent.empty())
-                {
-                    //std::cout << "ConnectionClient::AwaitTag Returning content." << std::endl;
-                    return tagContent;
-                }
-                else if (partialMessageReceived && (bufferSize < 5))
-                {
-                    //std::cout << "ConnectionClient::AwaitTag  Partial Message Received SLEEPING LONG." << std::endl;
-                    std::this_thread::sleep_for (std::chrono::milliseconds(10)); // awaiting end of tag to flush through
-                }
-                else if (partialMessageReceived)
-                {
-                    //std::cout << "ConnectionClient::AwaitTag  Partial Message Received SLEEPING SHORT." << std::endl;
-                    std::this_thread::sleep_for (std::chrono::milliseconds(5)); // awaiting end of tag to flush through
-                }
-            }
-            std::this_thread::sleep_for (std::chrono::milliseconds(200)); // nothing to process
+        if (route.documents.empty())
+        {
+            return PooledXml();
         }
+
+        return TakeLocked(route.documents);
     }
 
-    std::string AwaitTag()
+    /*!
+    \fn AwaitTags
+    \brief Gets up to max contents in the buffer enclosed in the tag, in one pass. 
+    \param tag the Tag without < and > tags to look for.
+    \param max the most elements to return.
+    \param timeout the longest time to wait for the first element.
+    \note The buffer lock is taken once for the whole batch. Subscribes to the 
+          tag on first use. Safe to call from several threads.  
+    \return The elements available, oldest first, or none if the timeout expired 
+            or the client is destroyed.
+    */
+    std::vector<std::string> AwaitTags(std::string tag, std::size_t max, std::chrono::milliseconds timeout)
     {
-        std::string fragment;
+        std::vector<std::string> tagContents;
 
-        while (true)
-        {
+        std::unique_lock<std::mutex> processGuard(_bufferMutex);
+        TagRoute& route = SubscribeLocked(tag);
 
-            while (!_buffer.empty())
-            {
-                bool partialMessageReceived = false;
-                std::string tagContent;
+        _bufferCondition.wait_for(processGuard, timeout, [this, &route] { return !route.frames.empty() || _stopping; });
 
-                std::unique_lock<std::mutex> processGuard(_bufferMutex);
+        std::size_t count = std::min(max, route.frames.size());
+        tagContents.reserve(count);
+        for (std::size_t i = 0; i < count; i++)
+        {
+            tagContents.push_back(TakeLocked(route.frames));
+        }
+        processGuard.unlock();
 
-                std::string front = _buffer.front();
-                _buffer.pop();
+        return tagContents;
+    }
 
-                fragment = fragment + front;
+    /*!
+    \fn async_next_tag
+    \brief Asynchronously gets the next content in the buffer enclosed in the tag. 
+    \param tag the Tag without < and > tags to look for.
+    \param token the completion token, e.g. a callback, boost::asio::use_future 
+           or boost::asio::use_awaitable, with signature 
+           void(boost::system::error_code, std::string).
+    \note Completes on the handler's associated executor, so no thread is held 
+          while waiting. Completes with operation_aborted if the client is destroyed.
+    \return As determined by the completion token.
+    */
+    template <typename CompletionToken>
+    auto async_next_tag(std::string tag, CompletionToken&& token)
+    {
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, std::string)>(
+            [this](auto handler, std::string tag)
+            {
+                typedef typename std::decay<decltype(handler)>::type Handler;
 
-                size_t end = fragment.find("\r\n");
+                auto work = boost::asio::make_work_guard(boost::asio::get_associated_executor(handler));
+                auto shared = std::make_shared<Handler>(std::move(handler));
 
-                if (end != std::string::npos) //Extract out data, sort out buffer and return.
+                Waiter waiter = [shared, work](const boost::system::error_code& error, const std::string& frame)
                 {
-                    tagContent = fragment.substr(0, end);
-                    end = end + 2;
+                    boost::asio::post(work.get_executor(), [shared, error, frame]() { (*shared)(error, frame); });
+                };
 
-                    std::string leftOver = fragment.substr(end, (fragment.size() - end));
-                    int bufferSize = _buffer.size();
-
-                    if (leftOver.size() > 0)
-                    {
-                        _buffer.push(leftOver);
-                    }
-
-                    for (int i = 0; i < bufferSize; i++)
-                    {
-                        std::string message = _buffer.front();
-                        _buffer.pop();
-                        _buffer.push(message);
-                    }
+                std::unique_lock<std::mutex> processGuard(_bufferMutex);
+                TagRoute& route = SubscribeLocked(tag);
 
-                }
-                else //Partial message received.
+                if (_stopping)
                 {
-                    //std::cout << "ConnectionClient::AwaitTag Partial Message Received." << std::endl;
-                    partialMessageReceived = true;
+                    processGuard.unlock();
+                    waiter(boost::asio::error::operation_aborted, std::string());
                 }
-
-                int bufferSize = _buffer.size();
-                processGuard.unlock();
-
-                if (!tagContent.empty())
+                else if (!route.frames.empty())
                 {
-                    //std::cout << "ConnectionClient::AwaitTag Returning content." << std::endl;
-                    return tagContent;
+                    std::string tagContent = TakeLocked(route.frames);
+                    processGuard.unlock();
+                    waiter(boost::system::error_code(), tagContent);
                 }
-                else if (partialMessageReceived && (bufferSize < 5))
+                else
                 {
-                    //std::cout << "ConnectionClient::AwaitTag  Partial Message Received SLEEPING LONG." << std::endl;
-                    std::this_thread::sleep_for (std::chrono::milliseconds(10)); // awaiting end of tag to flush through
+                    route.waiters.push(std::move(waiter));
                 }
-                else if (partialMessageReceived)
+            },
+            token, std::move(tag));
+    }
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+    /*!
+    \fn next_tag
+    \brief Awaitable form of async_next_tag, e.g. co_await client.next_tag("Vision"). 
+    \param tag the Tag without < and > tags to look for.
+    \warning Throws boost::system::system_error if the client is destroyed while waiting.
+    \return The whole content, including tags with < > within the tag name.
+    */
+    boost::asio::awaitable<std::string> next_tag(std::string tag)
+    {
+        return async_next_tag(std::move(tag), boost::asio::use_awaitable);
+    }
+#endif
+
+    /*!
+    \fn StartWorkers
+    \brief Start a consumer group of threads sharing the elements of the tag. 
+    \param tag the Tag without < and > tags to consume.
+    \param count the number of worker threads to start.
+    \param handler called on a worker thread with each whole element. Each 
+           element is given to exactly one worker.
+    \note Workers stop when the client is destroyed.
+    \return void
+    */
+    void StartWorkers(std::string tag, int count, std::function<void(const std::string&)> handler)
+    {
+        Subscribe(tag);
+
+        for (int i = 0; i < count; i++)
+        {
+            _workers.emplace_back([this, tag, handler]
+            {
+                std::string content;
+                while (WaitFrame(tag, content))
                 {
-                    //std::cout << "ConnectionClient::AwaitTag  Partial Message Received SLEEPING SHORT." << std::endl;
-                    std::this_thread::sleep_for (std::chrono::milliseconds(5)); // awaiting end of tag to flush through
+                    handler(content);
                 }
-            }
-            std::this_thread::sleep_for (std::chrono::milliseconds(200)); // nothing to process
+            });
         }
     }
+
+    /*!
+    \fn AwaitTag
+    \brief Gets the next content in the buffer terminated by \\r\\n. 
+    \warning Blocks until a line is found in buffer. Safe to call from several 
+             threads, each line is returned once.
+    \return The content, without the terminator, or empty if the client is 
+            destroyed while waiting.
+    */
+    std::string AwaitTag()
+    {
+        std::unique_lock<std::mutex> processGuard(_bufferMutex);
+        _linesSubscribed = true;
+        ReplayLocked();
+
+        _bufferCondition.wait(processGuard, [this] { return !_lines.empty() || _stopping; });
+
+        std::string tagContent;
+        if (!_lines.empty())
+        {
+            tagContent = TakeLocked(_lines);
+        }
+        processGuard.unlock();
+
+        return tagContent;
+    }
 };
 
 
@@ -0,0 +1,485 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ENDPOINTCACHE_H
+#define ENDPOINTCACHE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "Log.cpp"
+
+using boost::asio::ip::tcp;
+
+/*!
+    \class EndpointCache
+    \brief Resolved endpoints kept for a time to live, so reconnecting does not
+           wait for DNS.
+
+    Responsability
+    --------------
+    A host resolved within the TTL is answered at once. Once the TTL has
+    passed, the endpoints last resolved are still answered at once, and the
+    host is resolved again on a thread of its own, so a slow or missing DNS
+    server never delays a reconnect to a host resolved before. Only the
+    first resolution of a host waits for DNS.
+
+    Endpoints are ordered for a staggered connect, alternating address
+    families starting with the family resolved first, as RFC 8305 describes.
+
+    Collaboration
+    -------------
+    Shared() is used by asyncClientTCP, ConnectionClient and FanInClient,
+    which connect with AsyncConnectStaggered.
+    \sa AsyncConnectStaggered()
+*/
+class EndpointCache : public std::enable_shared_from_this<EndpointCache>
+{
+public:
+    typedef std::vector<tcp::endpoint> Endpoints;
+    static constexpr std::chrono::milliseconds ConnectionAttemptDelay{250}; //!< The stagger RFC 8305 recommends.
+
+    /*!
+    \fn Create
+    \brief Create a cache.
+    \param ttl how long endpoints are answered without resolving again.
+    \return the cache.
+    */
+    static std::shared_ptr<EndpointCache> Create(std::chrono::seconds ttl = std::chrono::seconds(60))
+    {
+        return std::shared_ptr<EndpointCache>(new EndpointCache(ttl));
+    }
+
+    /*!
+    \fn Shared
+    \brief Gets the cache shared by the clients of the process.
+    \return the cache.
+    */
+    static const std::shared_ptr<EndpointCache>& Shared()
+    {
+        static const std::shared_ptr<EndpointCache> shared = Create();
+        return shared;
+    }
+
+    /*!
+    \fn AsyncResolve
+    \brief Gets a host's endpoints, from the cache if it has them.
+    \param executor runs the resolution if the host is not cached, and the handler.
+    \param handler called with (error, Endpoints).
+    \return void
+    */
+    template <typename Executor, typename Handler>
+    void AsyncResolve(const Executor& executor, const std::string& host, const std::string& port, Handler handler)
+    {
+        Endpoints endpoints;
+        bool fresh;
+        if (Lookup(host, port, endpoints, fresh))
+        {
+            if (!fresh)
+            {
+                Refresh(host, port);
+            }
+            boost::asio::post(executor, [handler = std::move(handler), endpoints = std::move(endpoints)]() mutable
+            {
+                handler(boost::system::error_code(), endpoints);
+            });
+            return;
+        }
+
+        _misses++;
+        std::shared_ptr<EndpointCache> self = shared_from_this();
+        auto resolver = std::make_shared<tcp::resolver>(executor);
+        resolver->async_resolve(host, port,
+            [self, resolver, host, port, handler = std::move(handler)](const boost::system::error_code& error, tcp::resolver::results_type results) mutable
+            {
+                Endpoints endpoints;
+                if (!error)
+                {
+                    endpoints = self->Store(host, port, results);
+                }
+                handler(error, endpoints);
+            });
+    }
+
+    /*!
+    \fn Resolve
+    \brief Gets a host's endpoints, from the cache if it has them.
+    \warning Blocks while resolving a host not cached. Throws boost::system::system_error on failure.
+    \return the endpoints.
+    */
+    Endpoints Resolve(const std::string& host, const std::string& port)
+    {
+        Endpoints endpoints;
+        bool fresh;
+        if (Lookup(host, port, endpoints, fresh))
+        {
+            if (!fresh)
+            {
+                Refresh(host, port);
+            }
+            return endpoints;
+        }
+
+        _misses++;
+        boost::asio::io_context io_context;
+        tcp::resolver resolver(io_context);
+        return Store(host, port, resolver.resolve(host, port));
+    }
+
+    /*!
+    \fn Expire
+    \brief Resolve a host again on its next lookup, still answering its endpoints 
+           meanwhile, e.g. once none of them answered a connect.
+    \return void
+    */
+    void Expire(const std::string& host, const std::string& port)
+    {
+        std::lock_guard<std::mutex> expireGuard(_mutex);
+        auto found = _entries.find(Key(host, port));
+        if (found != _entries.end())
+        {
+            found->second.expires = std::chrono::steady_clock::now();
+        }
+    }
+
+    /*!
+    \fn SetTtl
+    \brief Set how long endpoints are answered without resolving again.
+    \return void
+    */
+    void SetTtl(std::chrono::seconds ttl)
+    {
+        std::lock_guard<std::mutex> ttlGuard(_mutex);
+        _ttl = ttl;
+    }
+
+    /*!
+    \fn Hits
+    \brief Gets the number of lookups answered from the cache, fresh or not.
+    \return the count.
+    */
+    std::uint64_t Hits() const
+    {
+        return _hits;
+    }
+
+    /*!
+    \fn Misses
+    \brief Gets the number of lookups that waited for DNS.
+    \return the count.
+    */
+    std::uint64_t Misses() const
+    {
+        return _misses;
+    }
+
+    /*!
+    \fn Interleave
+    \brief Order endpoints alternating address families, starting with the first's.
+    \return the endpoints ordered.
+    */
+    static Endpoints Interleave(const Endpoints& endpoints)
+    {
+        Endpoints first;
+        Endpoints other;
+        for (const tcp::endpoint& endpoint : endpoints)
+        {
+            if (endpoint.protocol() == endpoints.front().protocol())
+            {
+                first.push_back(endpoint);
+            }
+            else
+            {
+                other.push_back(endpoint);
+            }
+        }
+
+        Endpoints ordered;
+        for (std::size_t i = 0; (i < first.size()) || (i < other.size()); i++)
+        {
+            if (i < first.size())
+            {
+                ordered.push_back(first[i]);
+            }
+            if (i < other.size())
+            {
+                ordered.push_back(other[i]);
+            }
+        }
+        return ordered;
+    }
+
+private:
+
+    /*!
+        \struct Entry
+        \brief The endpoints of one host and port.
+    */
+    struct Entry
+    {
+        Endpoints endpoints; //!< Ordered for a staggered connect.
+        std::chrono::steady_clock::time_point expires; //!< When to resolve again.
+        bool refreshing = false; //!< If being resolved again.
+    };
+
+    std::map<std::string, Entry> _entries; //!< By host and port, guarded by _mutex.
+    std::chrono::seconds _ttl; //!< How long entries are fresh, guarded by _mutex.
+    std::mutex _mutex;
+    std::atomic<std::uint64_t> _hits{0};
+    std::atomic<std::uint64_t> _misses{0};
+
+    explicit EndpointCache(std::chrono::seconds ttl)
+        : _ttl(ttl)
+    {
+    }
+
+    static std::string Key(const std::string& host, const std::string& port)
+    {
+        return host + ":" + port;
+    }
+
+    /*!
+    \fn Lookup
+    \brief Gets the endpoints cached for a host, if any.
+    \param fresh set if within the TTL. If not, the caller refreshes the entry.
+    \return false if the host is not cached.
+    */
+    bool Lookup(const std::string& host, const std::string& port, Endpoints& endpoints, bool& fresh)
+    {
+        std::lock_guard<std::mutex> lookupGuard(_mutex);
+        auto found = _entries.find(Key(host, port));
+        if (found == _entries.end())
+        {
+            return false;
+        }
+
+        endpoints = found->second.endpoints;
+        fresh = (std::chrono::steady_clock::now() < found->second.expires) || found->second.refreshing;
+        if (!fresh)
+        {
+            found->second.refreshing = true; // Only one refresh at a time.
+        }
+        _hits++;
+        return true;
+    }
+
+    /*!
+    \fn Store
+    \brief Cache the endpoints resolved for a host.
+    \return the endpoints, ordered.
+    */
+    Endpoints Store(const std::string& host, const std::string& port, const tcp::resolver::results_type& results)
+    {
+        Endpoints resolved;
+        for (const auto& result : results)
+        {
+            resolved.push_back(result.endpoint());
+        }
+        if (resolved.empty())
+        {
+            return resolved;
+        }
+        resolved = Interleave(resolved);
+
+        std::lock_guard<std::mutex> storeGuard(_mutex);
+        Entry& entry = _entries[Key(host, port)];
+        entry.endpoints = resolved;
+        entry.expires = std::chrono::steady_clock::now() + _ttl;
+        entry.refreshing = false;
+        return resolved;
+    }
+
+    /*!
+    \fn Refresh
+    \brief Resolve a host again on a thread of its own, keeping its endpoints
+           until it succeeds.
+    \return void
+    */
+    void Refresh(const std::string& host, const std::string& port)
+    {
+        std::shared_ptr<EndpointCache> self = shared_from_this();
+        std::thread([self, host, port]()
+        {
+            boost::asio::io_context io_context;
+            tcp::resolver resolver(io_context);
+            boost::system::error_code error;
+            tcp::resolver::results_type results = resolver.resolve(host, port, error);
+
+            if (!error)
+            {
+                self->Store(host, port, results);
+                return;
+            }
+
+            LOG_WARNING("EndpointCache::Refresh " << host << ":" << port << " What: " << error.message());
+            std::lock_guard<std::mutex> retryGuard(self->_mutex);
+            auto found = self->_entries.find(Key(host, port));
+            if (found != self->_entries.end())
+            {
+                found->second.refreshing = false; // Tried again on the next lookup.
+            }
+        }).detach();
+    }
+};
+
+/*!
+    \class StaggeredConnect
+    \brief Connects a socket to the first endpoint of several to answer,
+           starting a new attempt each stagger while earlier ones are pending.
+
+    Responsability
+    --------------
+    The first endpoint is tried at once. Each further endpoint is tried once
+    the previous attempt fails, or after the stagger if it has not answered,
+    as in RFC 8305 "Happy Eyeballs". The first attempt to connect wins and
+    the others are closed, so an unreachable address costs at most a
+    stagger, rather than the whole TCP connect timeout.
+
+    Collaboration
+    -------------
+    Started by AsyncConnectStaggered.
+*/
+template <typename Handler>
+class StaggeredConnect : public std::enable_shared_from_this<StaggeredConnect<Handler>>
+{
+public:
+    StaggeredConnect(tcp::socket& socket, EndpointCache::Endpoints endpoints, std::chrono::milliseconds stagger, Handler handler)
+        : _socket(socket), _endpoints(std::move(endpoints)), _stagger(stagger), _timer(socket.get_executor()), _handler(std::move(handler))
+    {
+    }
+
+    /*!
+    \fn Start
+    \brief Make the first attempt.
+    \return void
+    */
+    void Start()
+    {
+        if (_endpoints.empty())
+        {
+            Complete(boost::asio::error::host_not_found, tcp::endpoint());
+            return;
+        }
+        Attempt();
+    }
+
+private:
+    tcp::socket& _socket; //!< Connected to the winner.
+    EndpointCache::Endpoints _endpoints; //!< Tried in order.
+    std::chrono::milliseconds _stagger; //!< The wait for an attempt before starting the next.
+    boost::asio::steady_timer _timer; //!< Waits the stagger.
+    Handler _handler; //!< Called once with (error, endpoint).
+
+    std::vector<std::unique_ptr<tcp::socket>> _attempts; //!< One per endpoint tried.
+    std::size_t _failed = 0; //!< Attempts that failed.
+    bool _done = false; //!< If the handler has been called.
+
+    /*!
+    \fn Attempt
+    \brief Connect to the next endpoint, and wait the stagger before the one after.
+    \return void
+    */
+    void Attempt()
+    {
+        std::size_t index = _attempts.size();
+        _attempts.emplace_back(new tcp::socket(_socket.get_executor()));
+
+        auto self = this->shared_from_this();
+        _attempts[index]->async_connect(_endpoints[index], [self, index](const boost::system::error_code& error)
+        {
+            self->Connected(index, error);
+        });
+
+        std::size_t started = _attempts.size();
+        if (started < _endpoints.size())
+        {
+            _timer.expires_after(_stagger);
+            _timer.async_wait([self, started](const boost::system::error_code& error)
+            {
+                // A cancel is too late once the wait has completed, so check no attempt was started since.
+                if (!error && !self->_done && (self->_attempts.size() == started))
+                {
+                    self->Attempt();
+                }
+            });
+        }
+    }
+
+    /*!
+    \fn Connected
+    \brief Take the first attempt to connect, or try the next endpoint once one fails.
+    \return void
+    */
+    void Connected(std::size_t index, const boost::system::error_code& error)
+    {
+        if (_done)
+        {
+            return;
+        }
+
+        if (!error)
+        {
+            _socket = std::move(*_attempts[index]);
+            Complete(error, _endpoints[index]);
+            return;
+        }
+
+        _failed++;
+        if (_failed == _endpoints.size())
+        {
+            Complete(error, tcp::endpoint());
+        }
+        else if ((_attempts.size() < _endpoints.size()) && (_failed == _attempts.size())) // Nothing pending, so do not wait the stagger.
+        {
+            _timer.cancel();
+            Attempt();
+        }
+    }
+
+    /*!
+    \fn Complete
+    \brief Close the other attempts and call the handler.
+    \return void
+    */
+    void Complete(const boost::system::error_code& error, const tcp::endpoint& endpoint)
+    {
+        _done = true;
+        _timer.cancel();
+        for (auto& attempt : _attempts)
+        {
+            boost::system::error_code ignored;
+            attempt->close(ignored);
+        }
+        _handler(error, endpoint);
+    }
+};
+
+/*!
+\fn AsyncConnectStaggered
+\brief Connect a socket to the first of the endpoints to answer, staggering the attempts.
+\param socket connected on success, used for its executor.
+\param endpoints ordered, e.g. by EndpointCache.
+\param stagger the wait for an attempt before starting the next; RFC 8305 recommends 250 ms.
+\param handler called with (error, endpoint) on the socket's executor.
+\return void
+*/
+template <typename Handler>
+inline void AsyncConnectStaggered(tcp::socket& socket, EndpointCache::Endpoints endpoints, std::chrono::milliseconds stagger, Handler handler)
+{
+    std::make_shared<StaggeredConnect<Handler>>(socket, std::move(endpoints), stagger, std::move(handler))->Start();
+}
+
+#endif
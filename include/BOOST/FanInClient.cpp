@@ -0,0 +1,508 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef FANINCLIENT_H
+#define FANINCLIENT_H
+
+#include <utility>
+
+#include <boost/asio.hpp>
+
+#include <iostream>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TagFramer.cpp"
+#include "BufferLimits.cpp"
+#include "ReconnectBackoff.cpp"
+#include "EndpointCache.cpp"
+#include "Log.cpp"
+
+using boost::asio::ip::tcp;
+
+/*!
+    \struct SourceEndpoint
+    \brief The address and port of one server a FanInClient subscribes to.
+*/
+struct SourceEndpoint
+{
+    std::string address; //!< The address to connect to.
+    int port; //!< The port number to connect to.
+};
+
+/*!
+    \struct SourcedFrame
+    \brief A complete top-level element and the source it was received from.
+*/
+struct SourcedFrame
+{
+    std::size_t source = 0; //!< Index of the source in the endpoints given to the FanInClient.
+    std::string tag; //!< The element's name, without < and >.
+    std::string frame; //!< The whole element, including its start and end tags.
+};
+
+/*!
+    \fn MessageSize
+    \brief Gets the bytes a SourcedFrame counts against BufferLimits::maxBytes.
+    \return the size.
+*/
+inline std::size_t MessageSize(const SourcedFrame& frame) { return frame.frame.size(); }
+
+/*!
+    \struct SourceStatistics
+    \brief A snapshot of the counters of one FanInClient source.
+*/
+struct SourceStatistics
+{
+    SourceEndpoint endpoint; //!< The source.
+    bool connected = false; //!< If the source is currently connected.
+    std::uint64_t connects = 0; //!< Connections made.
+    std::uint64_t disconnects = 0; //!< Connections lost or failed.
+    std::uint64_t bytesReceived = 0; //!< Bytes read from the source.
+    std::uint64_t framesReceived = 0; //!< Complete elements framed.
+    BufferStatistics buffer; //!< The source's share of the merged queue.
+};
+
+/*!
+    \class FanInClient
+    \brief Subscribes to several servers on one event loop and merges their
+           elements into one queue.
+
+    Responsability
+    --------------
+    Connect to every endpoint, reconnecting as required, frame each stream
+    into top-level elements and queue them tagged with their source. All
+    sources share one io_context run by a small pool of threads, rather than
+    a thread per connection as with ConnectionClient. Consumers are served
+    round-robin across sources, oldest first within a source, so a busy
+    source can not starve a quiet one.
+
+    Collaboration
+    -------------
+    Used by objects requiring elements from several servers, such as one
+    intersection controller subscribed to many camera nodes.
+    \sa ConnectionClient()
+*/
+class FanInClient
+{
+private:
+
+    /*!
+        \struct Source
+        \brief The connection, framing and queue of one endpoint.
+    */
+    struct Source
+    {
+        Source(boost::asio::io_context& io_context, std::size_t index, SourceEndpoint endpoint, const ReconnectBackoff& backoff)
+            : index(index), endpoint(endpoint), strand(boost::asio::make_strand(io_context)),
+              socket(strand), retry(strand), backoff(backoff)
+        {
+        }
+
+        std::size_t index; //!< Position in the endpoints given.
+        SourceEndpoint endpoint; //!< The server to connect to.
+        boost::asio::strand<boost::asio::io_context::executor_type> strand; //!< Serialises the source's handlers.
+        tcp::socket socket; //!< The connection to the server.
+        boost::asio::steady_timer retry; //!< Waits before reconnecting.
+        ReconnectBackoff backoff; //!< Delays between connection attempts, only used on the strand.
+        std::array<char, 4096> readBuffer; //!< Bytes read from the socket.
+        TagFramer framer; //!< Frames the stream, only used on the strand.
+
+        std::deque<SourcedFrame> frames; //!< Elements awaiting a consumer, guarded by FanInClient::_mutex.
+        std::size_t bufferedBytes = 0; //!< Bytes held in frames, guarded by FanInClient::_mutex.
+        std::size_t bufferedMessages = 0; //!< Elements held in frames, guarded by FanInClient::_mutex.
+        bool readPaused = false; //!< Reading stopped under Backpressure, guarded by FanInClient::_mutex.
+        BufferCounters counters; //!< What the limits have done.
+
+        std::atomic<bool> connected{false}; //!< If the source is currently connected.
+        std::atomic<std::uint64_t> connects{0}; //!< Connections made.
+        std::atomic<std::uint64_t> disconnects{0}; //!< Connections lost or failed.
+        std::atomic<std::uint64_t> bytesReceived{0}; //!< Bytes read.
+        std::atomic<std::uint64_t> framesReceived{0}; //!< Elements framed.
+    };
+
+    boost::asio::io_context _io_context; //!< Runs every source.
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> _work; //!< Keeps the threads running while idle.
+    std::vector<std::unique_ptr<Source>> _sources; //!< One per endpoint, in the order given.
+    std::vector<std::thread> _threads; //!< The pool running _io_context.
+
+    BufferLimits _limits; //!< Caps applied to each source's queue.
+    std::set<std::string> _tags; //!< Tags to queue, all if empty, guarded by _mutex.
+
+    std::mutex _mutex; //!< Guards the source queues.
+    std::condition_variable _frameQueued; //!< Signalled when an element is queued or the client stops.
+    std::size_t _nextSource = 0; //!< The source to serve first on the next take, guarded by _mutex.
+    std::atomic<bool> _stopping{false}; //!< Set when the client is being destroyed.
+
+    /*!
+    \fn Connect
+    \brief Resolve and connect to the source.
+    \warning Called on the source's strand.
+    \return void
+    */
+    void Connect(Source& source)
+    {
+        LOG_INFO("FanInClient::Connect Attempting to open: " << source.endpoint.address << ":" << source.endpoint.port);
+
+        std::string port = std::to_string(source.endpoint.port);
+        EndpointCache::Shared()->AsyncResolve(source.strand, source.endpoint.address, port,
+            [this, &source, port](const boost::system::error_code& error, const EndpointCache::Endpoints& endpoints)
+            {
+                if (error)
+                {
+                    Disconnected(source, error);
+                    return;
+                }
+
+                AsyncConnectStaggered(source.socket, endpoints, EndpointCache::ConnectionAttemptDelay,
+                    [this, &source, port](const boost::system::error_code& error, const tcp::endpoint&)
+                    {
+                        if (error)
+                        {
+                            EndpointCache::Shared()->Expire(source.endpoint.address, port); // The host may have moved.
+                            Disconnected(source, error);
+                            return;
+                        }
+
+                        LOG_INFO("FanInClient::Connect Connected: " << source.endpoint.address << ":" << source.endpoint.port);
+                        source.connected = true;
+                        source.connects++;
+                        Read(source);
+                    });
+            });
+    }
+
+    /*!
+    \fn Disconnected
+    \brief Close the source and retry after a backoff.
+    \warning Called on the source's strand.
+    \return void
+    */
+    void Disconnected(Source& source, const boost::system::error_code& error)
+    {
+        if (_stopping)
+        {
+            return;
+        }
+
+        LOG_WARNING("FanInClient::Disconnected " << source.endpoint.address << ":" << source.endpoint.port << " What: " << error.message());
+
+        boost::system::error_code ignored;
+        source.socket.close(ignored);
+        source.framer.Clear(); // A partial element can not be completed by a new connection.
+        source.connected = false;
+        source.disconnects++;
+
+        source.retry.expires_after(source.backoff.Next());
+        source.retry.async_wait([this, &source](const boost::system::error_code& error)
+        {
+            if (!error)
+            {
+                Connect(source);
+            }
+        });
+    }
+
+    /*!
+    \fn Read
+    \brief Read the next bytes from the source.
+    \warning Called on the source's strand.
+    \return void
+    */
+    void Read(Source& source)
+    {
+        source.socket.async_read_some(boost::asio::buffer(source.readBuffer),
+            [this, &source](const boost::system::error_code& error, std::size_t length)
+            {
+                if (error)
+                {
+                    Disconnected(source, error);
+                    return;
+                }
+
+                source.bytesReceived += length;
+                source.backoff.Reset(); // The connection works.
+                source.framer.Append(source.readBuffer.data(), length);
+
+                if (Queue(source))
+                {
+                    Read(source);
+                }
+            });
+    }
+
+    /*!
+    \fn Queue
+    \brief Queue the source's complete elements.
+    \warning Called on the source's strand.
+    \return false if reading is paused under Backpressure.
+    */
+    bool Queue(Source& source)
+    {
+        bool queued = false;
+        SourcedFrame frame;
+        frame.source = source.index;
+
+        std::unique_lock<std::mutex> queueGuard(_mutex);
+        while (source.framer.Next(frame.tag, frame.frame))
+        {
+            source.framesReceived++;
+            if (_tags.empty() || (_tags.count(frame.tag) > 0))
+            {
+                queued |= PushBounded(source.frames, frame, source.bufferedBytes, source.bufferedMessages, _limits, source.counters);
+            }
+        }
+
+        bool paused = (_limits.policy == OverflowPolicy::Backpressure) && _limits.Full(source.bufferedBytes, source.bufferedMessages);
+        if (paused)
+        {
+            source.readPaused = true; // Resumed by the consumer taking an element.
+            source.counters.readsPaused++;
+        }
+        queueGuard.unlock();
+
+        if (queued)
+        {
+            _frameQueued.notify_all();
+        }
+        return !paused;
+    }
+
+    /*!
+    \fn TakeLocked
+    \brief Take the next element, round-robin across sources.
+    \param frame set to the element.
+    \param resume set to the source to resume reading, if any.
+    \warning _mutex must be held.
+    \return false if no source has an element.
+    */
+    bool TakeLocked(SourcedFrame& frame, Source*& resume)
+    {
+        for (std::size_t i = 0; i < _sources.size(); i++)
+        {
+            Source& source = *_sources[(_nextSource + i) % _sources.size()];
+            if (source.frames.empty())
+            {
+                continue;
+            }
+
+            frame = std::move(source.frames.front());
+            source.frames.pop_front();
+            source.bufferedBytes -= frame.frame.size();
+            source.bufferedMessages--;
+
+            if (source.readPaused && !_limits.Full(source.bufferedBytes, source.bufferedMessages))
+            {
+                source.readPaused = false;
+                resume = &source;
+            }
+
+            _nextSource = (_nextSource + i + 1) % _sources.size();
+            return true;
+        }
+        return false;
+    }
+
+    /*!
+    \fn Resume
+    \brief Restart reading a source paused under Backpressure.
+    \return void
+    */
+    void Resume(Source* source)
+    {
+        if (source != nullptr)
+        {
+            boost::asio::post(source->strand, [this, source]() { Read(*source); });
+        }
+    }
+
+public:
+
+    /*!
+    \fn FanInClient
+    \brief Connect to every endpoint.
+    \param endpoints the servers to subscribe to.
+    \param threads the number of threads to run the event loop on.
+    \param limits caps applied to each source's queue, unlimited by default.
+    \param backoff the delays between connection attempts, applied to each source.
+    \return void
+    */
+    FanInClient(std::vector<SourceEndpoint> endpoints, int threads = 1, BufferLimits limits = BufferLimits(), ReconnectBackoff backoff = ReconnectBackoff())
+        : _work(boost::asio::make_work_guard(_io_context)), _limits(limits)
+    {
+        for (SourceEndpoint& endpoint : endpoints)
+        {
+            _sources.emplace_back(new Source(_io_context, _sources.size(), endpoint, backoff));
+        }
+
+        for (auto& source : _sources)
+        {
+            Source* start = source.get();
+            boost::asio::post(start->strand, [this, start]() { Connect(*start); });
+        }
+
+        for (int i = 0; i < threads; i++)
+        {
+            _threads.emplace_back([this]() { _io_context.run(); });
+        }
+
+        LOG_INFO("FanInClient::FanInClient Initialised " << _sources.size() << " sources on " << threads << " threads.");
+    }
+
+    /*!
+    \fn ~FanInClient
+    \brief Close every source and wake waiting consumers.
+    \return void
+    */
+    ~FanInClient()
+    {
+        std::unique_lock<std::mutex> stopGuard(_mutex);
+        _stopping = true;
+        _frameQueued.notify_all();
+        stopGuard.unlock();
+
+        _work.reset();
+        _io_context.stop();
+        for (std::thread& thread : _threads)
+        {
+            thread.join();
+        }
+
+        LOG_INFO("FanInClient::FanInClient destroyed.");
+    }
+
+    /*!
+    \fn Subscribe
+    \brief Queue only elements of the subscribed tags. All elements are
+           queued until a tag is subscribed.
+    \param tag the Tag without < and > tags to queue.
+    \return void
+    */
+    void Subscribe(std::string tag)
+    {
+        std::lock_guard<std::mutex> subscribeGuard(_mutex);
+        _tags.insert(tag);
+    }
+
+    /*!
+    \fn AwaitFrame
+    \brief Gets the next element from any source.
+    \param frame set to the element and its source.
+    \warning Blocks until an element is available. Safe to call from several
+             threads, each element is returned once.
+    \return false if the client is destroyed while waiting.
+    */
+    bool AwaitFrame(SourcedFrame& frame)
+    {
+        Source* resume = nullptr;
+        bool taken = false;
+
+        std::unique_lock<std::mutex> takeGuard(_mutex);
+        _frameQueued.wait(takeGuard, [this, &frame, &resume, &taken] { taken = TakeLocked(frame, resume); return taken || _stopping; });
+        takeGuard.unlock();
+
+        Resume(resume);
+        return taken;
+    }
+
+    /*!
+    \fn AwaitFrames
+    \brief Gets up to max elements, round-robin across sources, in one pass.
+    \param max the most elements to return.
+    \param timeout the longest time to wait for the first element.
+    \return The elements available, or none if the timeout expired.
+    */
+    std::vector<SourcedFrame> AwaitFrames(std::size_t max, std::chrono::milliseconds timeout)
+    {
+        std::vector<SourcedFrame> frames;
+        std::vector<Source*> resumes;
+
+        std::unique_lock<std::mutex> takeGuard(_mutex);
+        _frameQueued.wait_for(takeGuard, timeout, [this] { return (BufferedLocked() > 0) || _stopping; });
+
+        SourcedFrame frame;
+        Source* resume = nullptr;
+        while ((frames.size() < max) && TakeLocked(frame, resume))
+        {
+            frames.push_back(std::move(frame));
+            if (resume != nullptr)
+            {
+                resumes.push_back(resume);
+                resume = nullptr;
+            }
+        }
+        takeGuard.unlock();
+
+        for (Source* source : resumes)
+        {
+            Resume(source);
+        }
+        return frames;
+    }
+
+    /*!
+    \fn SourceCount
+    \brief Gets the number of sources.
+    \return The count.
+    */
+    std::size_t SourceCount()
+    {
+        return _sources.size();
+    }
+
+    /*!
+    \fn Statistics
+    \brief Gets the counters of one source.
+    \param source the index of the source in the endpoints given.
+    \return The statistics.
+    */
+    SourceStatistics Statistics(std::size_t source)
+    {
+        Source& s = *_sources.at(source);
+
+        SourceStatistics statistics;
+        statistics.endpoint = s.endpoint;
+        statistics.connected = s.connected;
+        statistics.connects = s.connects;
+        statistics.disconnects = s.disconnects;
+        statistics.bytesReceived = s.bytesReceived;
+        statistics.framesReceived = s.framesReceived;
+
+        std::lock_guard<std::mutex> statisticsGuard(_mutex);
+        statistics.buffer = s.counters.Snapshot(s.bufferedBytes, s.bufferedMessages);
+        return statistics;
+    }
+
+private:
+
+    /*!
+    \fn BufferedLocked
+    \brief Gets the number of elements queued across all sources.
+    \warning _mutex must be held.
+    \return The count.
+    */
+    std::size_t BufferedLocked()
+    {
+        std::size_t buffered = 0;
+        for (auto& source : _sources)
+        {
+            buffered += source->bufferedMessages;
+        }
+        return buffered;
+    }
+};
+
+#endif
@@ -0,0 +1,494 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef FRAMING_H
+#define FRAMING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <boost/asio.hpp>
+
+#include "TrafficClass.cpp"
+
+/*
+    Framing policies for the async TCP classes, e.g. basic_asyncClientTCP<LengthPrefixFraming>.
+
+    Each policy provides:
+      AsyncRead(stream, buffer, handler) read until a whole frame is at the start of buffer,
+                                         completing with handler(error, length).
+      Take(buffer, length, message)      copy the frame's message out once and consume only the frame.
+      Frame(message)                     set an OutboundMessage's prefix or suffix, leaving its 
+                                         payload untouched, safe to call from any thread.
+      Matches(received, message)         if a message taken is the given message as sent, e.g. a heartbeat.
+      Reset()                            forget any partly read frame, e.g. to reuse a connection.
+
+    The classes are specialized for their policy, so the read loop is inlined
+    with no indirection per byte.
+*/
+
+/*!
+    \class DelimiterFraming
+    \brief Messages ended by a delimiter, "\r\n" by default.
+
+    Responsability
+    --------------
+    The cheapest framing for text: asio searches the buffer for the delimiter.
+    Messages are received with their delimiter, as before policies existed.
+    Delimiters are interned, so each is stored once for the process and 
+    written from there after each message.
+
+    Collaboration
+    -------------
+    The default policy of the async TCP classes.
+*/
+class DelimiterFraming
+{
+public:
+
+    /*!
+    \fn DelimiterFraming
+    \brief Set the delimiter.
+    \param delimiter ends each message.
+    \return void
+    */
+    explicit DelimiterFraming(const std::string& delimiter = "\r\n")
+        : _delimiter(Intern(delimiter))
+    {
+    }
+
+    template <typename Stream, typename Handler>
+    void AsyncRead(Stream& stream, boost::asio::streambuf& buffer, Handler&& handler)
+    {
+        boost::asio::async_read_until(stream, buffer, *_delimiter, std::forward<Handler>(handler));
+    }
+
+    /*!
+    \fn Take
+    \brief Take a frame from the front of a buffer.
+    \param length the frame's bytes, including the delimiter.
+    \param message set to the frame, including the delimiter.
+    \return void
+    */
+    void Take(boost::asio::streambuf& buffer, std::size_t length, std::string& message)
+    {
+        message.assign(static_cast<const char*>(buffer.data().data()), length); // The streambuf's data is contiguous.
+        buffer.consume(length);
+    }
+
+    /*!
+    \fn Frame
+    \brief Write the delimiter after the message, unless it already ends with it.
+    \return void
+    */
+    void Frame(OutboundMessage& message) const
+    {
+        if (!EndsWithDelimiter(message.Payload()))
+        {
+            message.suffix = boost::asio::buffer(*_delimiter);
+        }
+    }
+
+    /*!
+    \fn Matches
+    \brief Gets if a message taken is a message as sent, i.e. with the 
+           delimiter written after it by Frame.
+    \return bool
+    */
+    bool Matches(const std::string& received, const std::string& message) const
+    {
+        if (EndsWithDelimiter(message))
+        {
+            return received == message;
+        }
+        return (received.size() == message.size() + _delimiter->size())
+            && (received.compare(0, message.size(), message) == 0)
+            && (received.compare(message.size(), _delimiter->size(), *_delimiter) == 0);
+    }
+
+    /*!
+    \fn Reset
+    \brief Nothing is kept between reads.
+    \return void
+    */
+    void Reset()
+    {
+    }
+
+private:
+    const std::string* _delimiter; //!< Ends each message, interned.
+
+    bool EndsWithDelimiter(const std::string& message) const
+    {
+        return (message.size() >= _delimiter->size())
+            && (message.compare(message.size() - _delimiter->size(), _delimiter->size(), *_delimiter) == 0);
+    }
+
+    /*!
+    \fn Intern
+    \brief Gets the process's copy of a delimiter, kept until exit.
+    \return the copy.
+    */
+    static const std::string* Intern(const std::string& delimiter)
+    {
+        static std::mutex internMutex;
+        static std::set<std::string> interned; // Nodes never move, so the copies never move.
+        std::lock_guard<std::mutex> internGuard(internMutex);
+        return &*interned.insert(delimiter).first;
+    }
+};
+
+/*!
+    \class LengthPrefixFraming
+    \brief Messages preceded by their length, as 4 bytes in network byte order.
+
+    Responsability
+    --------------
+    Frames are found without examining their contents, so messages may hold
+    any bytes, including binary. Received messages do not include the
+    prefix. A prefix above the maximum length fails the read with
+    message_size, rather than buffering whatever a broken peer claims.
+
+    Collaboration
+    -------------
+    A policy of the async TCP classes.
+*/
+class LengthPrefixFraming
+{
+public:
+    static constexpr std::size_t HeaderSize = 4; //!< Bytes of the prefix.
+
+    /*!
+    \fn LengthPrefixFraming
+    \brief Set the maximum length.
+    \param maxLength the longest message accepted.
+    \return void
+    */
+    explicit LengthPrefixFraming(std::uint32_t maxLength = 16 * 1024 * 1024)
+        : _maxLength(maxLength)
+    {
+    }
+
+    /*!
+        \struct Match
+        \brief Finds the end of the frame at the start of the buffer.
+    */
+    struct Match
+    {
+        typedef boost::asio::buffers_iterator<boost::asio::streambuf::const_buffers_type> Iterator;
+        typedef std::pair<Iterator, bool> result_type; //!< Marks this as a match condition for async_read_until.
+
+        std::uint32_t maxLength; //!< The longest message accepted.
+
+        result_type operator()(Iterator begin, Iterator end) const
+        {
+            if (static_cast<std::size_t>(end - begin) < HeaderSize)
+            {
+                return result_type(begin, false);
+            }
+
+            std::uint32_t length = Decode(begin);
+            if (length > maxLength) // Reported by AsyncRead.
+            {
+                return result_type(begin + HeaderSize, true);
+            }
+
+            if (static_cast<std::size_t>(end - begin) < HeaderSize + length)
+            {
+                return result_type(begin, false); // Searched again from the prefix.
+            }
+            return result_type(begin + HeaderSize + length, true);
+        }
+    };
+
+    /*!
+        \struct CheckLength
+        \brief Completes a read with message_size if the prefix was above the maximum.
+    */
+    template <typename Handler>
+    struct CheckLength
+    {
+        typedef typename boost::asio::associated_allocator<Handler>::type allocator_type; //!< The handler's, so its memory is still used.
+
+        Handler handler; //!< Completes the read.
+        boost::asio::streambuf* buffer; //!< Holds the prefix.
+        std::uint32_t maxLength; //!< The longest message accepted.
+
+        allocator_type get_allocator() const noexcept
+        {
+            return boost::asio::get_associated_allocator(handler);
+        }
+
+        void operator()(const boost::system::error_code& error, std::size_t length)
+        {
+            if (!error && (Decode(static_cast<const char*>(buffer->data().data())) > maxLength))
+            {
+                handler(boost::asio::error::message_size, 0);
+                return;
+            }
+            handler(error, length);
+        }
+    };
+
+    template <typename Stream, typename Handler>
+    void AsyncRead(Stream& stream, boost::asio::streambuf& buffer, Handler&& handler)
+    {
+        typedef typename std::decay<Handler>::type Decayed;
+        boost::asio::async_read_until(stream, buffer, Match{_maxLength},
+            CheckLength<Decayed>{std::forward<Handler>(handler), &buffer, _maxLength});
+    }
+
+    /*!
+    \fn Take
+    \brief Take a frame from the front of a buffer.
+    \param length the frame's bytes, including the prefix.
+    \param message set to the message, without the prefix.
+    \return void
+    */
+    void Take(boost::asio::streambuf& buffer, std::size_t length, std::string& message)
+    {
+        message.assign(static_cast<const char*>(buffer.data().data()) + HeaderSize, length - HeaderSize);
+        buffer.consume(length);
+    }
+
+    /*!
+    \fn Frame
+    \brief Write the prefix before the message.
+    \return void
+    */
+    void Frame(OutboundMessage& message) const
+    {
+        std::uint32_t length = static_cast<std::uint32_t>(message.Payload().size());
+        message.prefix[0] = static_cast<char>(length >> 24);
+        message.prefix[1] = static_cast<char>(length >> 16);
+        message.prefix[2] = static_cast<char>(length >> 8);
+        message.prefix[3] = static_cast<char>(length);
+        message.prefixSize = HeaderSize;
+    }
+
+    /*!
+    \fn Matches
+    \brief Gets if a message taken is a message as sent, which it is unchanged.
+    \return bool
+    */
+    bool Matches(const std::string& received, const std::string& message) const
+    {
+        return received == message;
+    }
+
+    /*!
+    \fn Reset
+    \brief Nothing is kept between reads.
+    \return void
+    */
+    void Reset()
+    {
+    }
+
+private:
+    std::uint32_t _maxLength; //!< The longest message accepted.
+
+    /*!
+    \fn Decode
+    \brief Gets the length from a prefix.
+    \return the length.
+    */
+    template <typename Iterator>
+    static std::uint32_t Decode(Iterator prefix)
+    {
+        std::uint32_t length = 0;
+        for (std::size_t i = 0; i < HeaderSize; i++, ++prefix)
+        {
+            length = (length << 8) | static_cast<unsigned char>(*prefix);
+        }
+        return length;
+    }
+};
+
+/*!
+    \class XmlElementFraming
+    \brief Messages that are whole top-level XML elements, e.g. <Vision ...>...</Vision> or <Phase/>.
+
+    Responsability
+    --------------
+    Follows element nesting as bytes arrive, remembering where it got to, so
+    bytes already examined are not scanned again while waiting for the rest
+    of an element. Quoted attribute values may contain '>'. Text between
+    elements, declarations (<?...?>), comments (<!...>) and stray end tags
+    are discarded, as TagFramer does for ConnectionClient.
+
+    Collaboration
+    -------------
+    A policy of the async TCP classes.
+    \sa TagFramer()
+*/
+class XmlElementFraming
+{
+public:
+
+    /*!
+        \struct Scan
+        \brief How far the current frame has been examined.
+    */
+    struct Scan
+    {
+        enum Mode { Text, Open, Tag, Skip };
+
+        std::size_t scanned = 0; //!< Bytes examined from the start of the buffer.
+        std::size_t start = 0; //!< Where the top-level element starts.
+        int depth = 0; //!< Elements open.
+        Mode mode = Text; //!< What is being examined.
+        char quote = 0; //!< The quote of an attribute value being examined, if any.
+        bool closing = false; //!< If the tag is an end tag.
+        bool slash = false; //!< If the last character in the tag was '/'.
+    };
+
+    /*!
+        \struct Match
+        \brief Finds the end of the element at the start of the buffer, continuing a Scan.
+    */
+    struct Match
+    {
+        typedef boost::asio::buffers_iterator<boost::asio::streambuf::const_buffers_type> Iterator;
+        typedef std::pair<Iterator, bool> result_type; //!< Marks this as a match condition for async_read_until.
+
+        Scan* scan; //!< Kept by the policy between reads.
+
+        result_type operator()(Iterator begin, Iterator end) const
+        {
+            Scan& s = *scan;
+            std::size_t size = end - begin;
+            Iterator it = begin + s.scanned;
+
+            for (; s.scanned < size; ++s.scanned, ++it)
+            {
+                char c = *it;
+                switch (s.mode)
+                {
+                case Scan::Text:
+                    if (c == '<')
+                    {
+                        s.mode = Scan::Open;
+                    }
+                    break;
+
+                case Scan::Open:
+                    s.slash = false;
+                    s.closing = (c == '/');
+                    s.mode = ((c == '?') || (c == '!')) ? Scan::Skip : Scan::Tag;
+                    if ((s.mode == Scan::Tag) && !s.closing && (s.depth == 0))
+                    {
+                        s.start = s.scanned - 1;
+                    }
+                    break;
+
+                case Scan::Skip:
+                    if (c == '>')
+                    {
+                        s.mode = Scan::Text;
+                    }
+                    break;
+
+                case Scan::Tag:
+                    if (s.quote != 0)
+                    {
+                        if (c == s.quote)
+                        {
+                            s.quote = 0;
+                        }
+                    }
+                    else if ((c == '"') || (c == '\''))
+                    {
+                        s.quote = c;
+                    }
+                    else if (c == '>')
+                    {
+                        s.mode = Scan::Text;
+                        bool complete = false;
+                        if (s.closing)
+                        {
+                            complete = (s.depth > 0) && (--s.depth == 0); // A stray end tag is ignored.
+                        }
+                        else if (s.slash)
+                        {
+                            complete = (s.depth == 0);
+                        }
+                        else
+                        {
+                            s.depth++;
+                        }
+
+                        if (complete)
+                        {
+                            return result_type(begin + (s.scanned + 1), true);
+                        }
+                    }
+                    s.slash = (c == '/');
+                    break;
+                }
+            }
+            return result_type(begin, false); // Searched again from the start, skipping what was scanned.
+        }
+    };
+
+    template <typename Stream, typename Handler>
+    void AsyncRead(Stream& stream, boost::asio::streambuf& buffer, Handler&& handler)
+    {
+        boost::asio::async_read_until(stream, buffer, Match{&_scan}, std::forward<Handler>(handler));
+    }
+
+    /*!
+    \fn Take
+    \brief Take a frame from the front of a buffer.
+    \param length the frame's bytes, including any text before the element.
+    \param message set to the element.
+    \return void
+    */
+    void Take(boost::asio::streambuf& buffer, std::size_t length, std::string& message)
+    {
+        message.assign(static_cast<const char*>(buffer.data().data()) + _scan.start, length - _scan.start);
+        buffer.consume(length);
+        _scan = Scan();
+    }
+
+    /*!
+    \fn Frame
+    \brief Elements frame themselves, so nothing is added.
+    \return void
+    */
+    void Frame(OutboundMessage& /*message*/) const
+    {
+    }
+
+    /*!
+    \fn Matches
+    \brief Gets if a message taken is a message as sent, which it is unchanged.
+    \return bool
+    */
+    bool Matches(const std::string& received, const std::string& message) const
+    {
+        return received == message;
+    }
+
+    /*!
+    \fn Reset
+    \brief Forget the frame being read.
+    \return void
+    */
+    void Reset()
+    {
+        _scan = Scan();
+    }
+
+private:
+    Scan _scan; //!< The frame being read, only used on the io thread.
+};
+
+#endif
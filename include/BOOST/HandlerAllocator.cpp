@@ -0,0 +1,241 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef HANDLERALLOCATOR_H
+#define HANDLERALLOCATOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+
+/*!
+    \class HandlerMemory
+    \brief One recycled block for the state of an asynchronous operation.
+
+    Responsability
+    --------------
+    Asio allocates each operation's state, including its handler, when the
+    operation starts and frees it just before the handler runs. A connection
+    has at most one read, and one write, in flight at a time, so a block per
+    kind of operation serves every message without the heap. A request that
+    does not fit, or arrives while the block is in use, falls back to the heap.
+
+    Must outlive the operations using it, e.g. as a member of the connection
+    their handlers keep alive.
+
+    Collaboration
+    -------------
+    Used through HandlerAllocator by ConnectionTCP, asyncConnectionTCP and
+    asyncClientTCP. Posts go to their io_context's own executor, as the
+    socket's polymorphic executor does not pass the allocator on.
+*/
+class HandlerMemory
+{
+public:
+    static constexpr std::size_t Size = 512; //!< Bytes in the block, enough for a composed read or write.
+
+    HandlerMemory() = default;
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    /*!
+    \fn Allocate
+    \brief Gets the block if it is free and large enough, otherwise heap memory.
+    \note Safe to call from any thread, e.g. when posting from a sender.
+    \return the memory.
+    */
+    void* Allocate(std::size_t size)
+    {
+        if ((size <= Size) && !_inUse.exchange(true, std::memory_order_acquire))
+        {
+            _reused++;
+            return &_storage;
+        }
+        _heap++;
+        return ::operator new(size);
+    }
+
+    /*!
+    \fn Deallocate
+    \brief Free memory given by Allocate.
+    \return void
+    */
+    void Deallocate(void* pointer)
+    {
+        if (pointer == &_storage)
+        {
+            _inUse.store(false, std::memory_order_release);
+        }
+        else
+        {
+            ::operator delete(pointer);
+        }
+    }
+
+    /*!
+    \fn Reused
+    \brief Gets the number of allocations served by the block.
+    \return the count.
+    */
+    std::size_t Reused() const
+    {
+        return _reused;
+    }
+
+    /*!
+    \fn Heap
+    \brief Gets the number of allocations that fell back to the heap.
+    \return the count.
+    */
+    std::size_t Heap() const
+    {
+        return _heap;
+    }
+
+private:
+    std::aligned_storage<Size, alignof(std::max_align_t)>::type _storage; //!< The block.
+    std::atomic<bool> _inUse{false}; //!< If the block is allocated.
+    std::atomic<std::size_t> _reused{0}; //!< Allocations served by the block.
+    std::atomic<std::size_t> _heap{0}; //!< Allocations that fell back to the heap.
+};
+
+/*!
+    \class HandlerAllocator
+    \brief A standard allocator drawing from a HandlerMemory, as found by
+           boost::asio::associated_allocator.
+*/
+template <typename T>
+class HandlerAllocator
+{
+public:
+    typedef T value_type;
+
+    explicit HandlerAllocator(HandlerMemory& memory)
+        : _memory(&memory)
+    {
+    }
+
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept
+        : _memory(other._memory)
+    {
+    }
+
+    T* allocate(std::size_t n) const
+    {
+        return static_cast<T*>(_memory->Allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* pointer, std::size_t /*n*/) const
+    {
+        _memory->Deallocate(pointer);
+    }
+
+    bool operator==(const HandlerAllocator& other) const noexcept
+    {
+        return _memory == other._memory;
+    }
+
+    bool operator!=(const HandlerAllocator& other) const noexcept
+    {
+        return _memory != other._memory;
+    }
+
+private:
+    template <typename> friend class HandlerAllocator;
+
+    HandlerMemory* _memory; //!< Where memory comes from.
+};
+
+/*!
+    \class AllocatingHandler
+    \brief Wraps a handler, giving its operation a HandlerAllocator.
+*/
+template <typename Handler>
+class AllocatingHandler
+{
+public:
+    typedef HandlerAllocator<Handler> allocator_type; //!< Found by boost::asio::associated_allocator.
+
+    AllocatingHandler(HandlerMemory& memory, Handler handler)
+        : _memory(memory), _handler(std::move(handler))
+    {
+    }
+
+    allocator_type get_allocator() const noexcept
+    {
+        return allocator_type(_memory);
+    }
+
+    template <typename... Args>
+    void operator()(Args&&... args)
+    {
+        _handler(std::forward<Args>(args)...);
+    }
+
+private:
+    HandlerMemory& _memory; //!< The operation's memory.
+    Handler _handler; //!< The wrapped handler.
+};
+
+/*!
+    \fn MakeAllocatingHandler
+    \brief Wrap a handler so its operation's state is kept in memory.
+    \param memory outlives the operation.
+    \param handler the handler.
+    \return the wrapped handler.
+*/
+template <typename Handler>
+inline AllocatingHandler<typename std::decay<Handler>::type> MakeAllocatingHandler(HandlerMemory& memory, Handler&& handler)
+{
+    return AllocatingHandler<typename std::decay<Handler>::type>(memory, std::forward<Handler>(handler));
+}
+
+/*!
+    \class BufferSequenceView
+    \brief Refers to a vector of buffers as a buffer sequence without copying it.
+
+    Responsability
+    --------------
+    A composed write keeps its own copy of the buffer sequence it is given, so
+    a gathered write of a vector would allocate a copy each time. The view
+    is copied instead; the vector must be left unchanged until the write
+    completes.
+
+    Collaboration
+    -------------
+    Used for the gathered writes of asyncConnectionTCP and asyncClientTCP.
+*/
+class BufferSequenceView
+{
+public:
+    typedef boost::asio::const_buffer value_type;
+    typedef std::vector<boost::asio::const_buffer>::const_iterator const_iterator;
+
+    explicit BufferSequenceView(const std::vector<boost::asio::const_buffer>& buffers)
+        : _buffers(&buffers)
+    {
+    }
+
+    const_iterator begin() const
+    {
+        return _buffers->begin();
+    }
+
+    const_iterator end() const
+    {
+        return _buffers->end();
+    }
+
+private:
+    const std::vector<boost::asio::const_buffer>* _buffers; //!< The buffers, owned by the writer.
+};
+
+#endif
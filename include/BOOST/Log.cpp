@@ -0,0 +1,507 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RingBuffer.cpp"
+
+/*!
+    \def TSAI_LOG_COMPILED_LEVEL
+    \brief The lowest LogLevel compiled in, 0 (Trace) to 5 (Off). Calls below
+           it compile to nothing, their arguments never evaluated.
+*/
+#ifndef TSAI_LOG_COMPILED_LEVEL
+#define TSAI_LOG_COMPILED_LEVEL 0
+#endif
+
+/*!
+    \enum LogLevel
+    \brief The severity of a log record.
+*/
+enum class LogLevel : int
+{
+    Trace = 0,      //!< Every message, e.g. each read and write.
+    Debug = 1,      //!< Each connection, e.g. accepted and released.
+    Info = 2,       //!< Servers and clients starting, connecting and stopping.
+    Warning = 3,    //!< Connections lost, retried or timed out.
+    Error = 4,      //!< Something failed that should not have.
+    Off = 5         //!< Nothing.
+};
+
+/*!
+    \struct LogRecord
+    \brief One line of the log, formatted in place in a thread's buffer.
+*/
+struct LogRecord
+{
+    static constexpr std::size_t Capacity = 240; //!< Longer lines are truncated.
+
+    LogLevel level = LogLevel::Info;
+    std::chrono::steady_clock::time_point time; //!< When it was logged, to merge the threads' records in order.
+    std::size_t size = 0; //!< The bytes of text used.
+    bool truncated = false; //!< If the line was longer than Capacity.
+    std::array<char, Capacity> text; //!< Not terminated.
+};
+
+/*!
+    \struct LogStatistics
+    \brief What the logger has done.
+*/
+struct LogStatistics
+{
+    std::uint64_t written = 0; //!< Records written to the output.
+    std::uint64_t dropped = 0; //!< Records dropped as their thread's buffer was full.
+    std::size_t threads = 0; //!< Threads with a buffer.
+};
+
+/*!
+    \class Logger
+    \brief A leveled log, formatted by each thread into a lock-free buffer of
+           its own and written by a background thread.
+
+    Responsability
+    --------------
+    The library logs through the LOG_TRACE ... LOG_ERROR macros. A call below
+    the runtime level costs one relaxed atomic load, and one below
+    TSAI_LOG_COMPILED_LEVEL nothing at all; in neither is the message
+    formatted, nor its arguments evaluated.
+
+    Otherwise the message is formatted straight into the next slot of the
+    calling thread's SpscRing, so logging never takes a lock, allocates or
+    flushes. A thread's first record allocates its ring. If the ring is full
+    the record is dropped and counted, rather than blocking the thread.
+
+    A background thread drains every ring each 10ms, or sooner when one is
+    half full, merges the records by time, and writes them to the output,
+    std::cout by default, flushing once per drain. Records still buffered at
+    exit are written by an atexit handler.
+
+    The runtime level starts as Info, or as the LOG_LEVEL environment
+    variable (trace, debug, info, warning, error or off), and can be changed
+    at any time with SetLevel.
+
+    Collaboration
+    -------------
+    Used by every class of the library in place of std::cout.
+*/
+class Logger
+{
+public:
+    static constexpr std::size_t RecordsPerThread = 256; //!< Each thread's buffer, about 64KB.
+    static constexpr std::chrono::milliseconds DrainInterval{10}; //!< The longest a record waits to be written.
+
+    /*!
+    \fn Instance
+    \brief Gets the process's logger, starting it on first use. It is never
+           destroyed, so threads still running at exit may log.
+    \return the logger.
+    */
+    static Logger& Instance()
+    {
+        static Logger* logger = new Logger();
+        return *logger;
+    }
+
+    /*!
+    \fn Enabled
+    \brief Gets if records of a level are written.
+    \return bool
+    */
+    static bool Enabled(LogLevel level)
+    {
+        return static_cast<int>(level) >= _level.load(std::memory_order_relaxed);
+    }
+
+    /*!
+    \fn SetLevel
+    \brief Set the lowest level written, from any thread.
+    \return void
+    */
+    static void SetLevel(LogLevel level)
+    {
+        _level.store(static_cast<int>(level), std::memory_order_relaxed);
+    }
+
+    /*!
+    \fn Level
+    \brief Gets the lowest level written.
+    \return the level.
+    */
+    static LogLevel Level()
+    {
+        return static_cast<LogLevel>(_level.load(std::memory_order_relaxed));
+    }
+
+    /*!
+    \fn ParseLevel
+    \brief Gets a level from its name, e.g. "debug".
+    \param name the name, in lower case.
+    \param level set to the level if the name is known.
+    \return false if the name is unknown.
+    */
+    static bool ParseLevel(const std::string& name, LogLevel& level)
+    {
+        static const char* names[] = { "trace", "debug", "info", "warning", "error", "off" };
+        for (int i = 0; i <= static_cast<int>(LogLevel::Off); i++)
+        {
+            if (name == names[i])
+            {
+                level = static_cast<LogLevel>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*!
+    \fn Write
+    \brief Format a record into the calling thread's buffer.
+    \param format called with a stream writing into the record.
+    \note Called by the LOG_ macros once the level is enabled.
+    \return void
+    */
+    template <typename Format>
+    static void Write(LogLevel level, Format&& format)
+    {
+        ThreadLog& local = Local();
+        bool pushed = local.buffer->ring.TryPush([&local, level, &format](LogRecord& record)
+        {
+            local.writer.Reset(record);
+            format(local.stream);
+            record.level = level;
+            record.time = std::chrono::steady_clock::now();
+            record.size = local.writer.Size();
+            record.truncated = local.writer.Truncated();
+        });
+
+        if (!pushed)
+        {
+            local.buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (local.buffer->ring.Size() == RecordsPerThread / 2)
+        {
+            Instance()._wake.notify_one(); // Drain before it fills.
+        }
+    }
+
+    /*!
+    \fn SetOutput
+    \brief Write records to a stream instead of std::cout.
+    \param output left in use until replaced, so must outlive the logger's use.
+    \return void
+    */
+    void SetOutput(std::ostream& output)
+    {
+        std::lock_guard<std::mutex> drainGuard(_drainMutex);
+        _output = &output;
+    }
+
+    /*!
+    \fn Flush
+    \brief Write every record buffered so far, e.g. before reading the output.
+    \return void
+    */
+    void Flush()
+    {
+        Drain();
+    }
+
+    /*!
+    \fn Statistics
+    \brief Gets what the logger has done.
+    \return the statistics.
+    */
+    LogStatistics Statistics()
+    {
+        LogStatistics statistics;
+        statistics.written = _written;
+        std::lock_guard<std::mutex> buffersGuard(_buffersMutex);
+        statistics.dropped = _droppedExited;
+        for (const std::shared_ptr<ThreadBuffer>& buffer : _buffers)
+        {
+            statistics.dropped += buffer->dropped;
+        }
+        statistics.threads = _buffers.size();
+        return statistics;
+    }
+
+private:
+
+    /*!
+        \class RecordWriter
+        \brief A streambuf writing into a LogRecord's text, dropping what does not fit.
+    */
+    class RecordWriter : public std::streambuf
+    {
+    public:
+        void Reset(LogRecord& record)
+        {
+            setp(record.text.data(), record.text.data() + record.text.size());
+            _truncated = false;
+        }
+
+        std::size_t Size() const
+        {
+            return static_cast<std::size_t>(pptr() - pbase());
+        }
+
+        bool Truncated() const
+        {
+            return _truncated;
+        }
+
+    protected:
+        std::streamsize xsputn(const char* text, std::streamsize count) override
+        {
+            std::streamsize room = epptr() - pptr();
+            std::streamsize copied = std::min(room, count);
+            std::memcpy(pptr(), text, static_cast<std::size_t>(copied));
+            pbump(static_cast<int>(copied));
+            _truncated |= (copied < count);
+            return count; // What does not fit is dropped, not an error.
+        }
+
+        int_type overflow(int_type character) override
+        {
+            _truncated = true;
+            return traits_type::not_eof(character);
+        }
+
+    private:
+        bool _truncated = false;
+    };
+
+    /*!
+        \struct ThreadBuffer
+        \brief A thread's records, shared by the thread and the logger until
+               the thread has exited and its records are written.
+    */
+    struct ThreadBuffer
+    {
+        SpscRing<LogRecord> ring{RecordsPerThread}; //!< Filled by the thread, drained by the logger.
+        std::atomic<std::uint64_t> dropped{0}; //!< Records dropped as the ring was full.
+        std::atomic<bool> exited{false}; //!< Set as the thread exits.
+    };
+
+    /*!
+        \struct ThreadLog
+        \brief What a thread formats its records with.
+    */
+    struct ThreadLog
+    {
+        std::shared_ptr<ThreadBuffer> buffer;
+        RecordWriter writer;
+        std::ostream stream{&writer};
+
+        explicit ThreadLog(std::shared_ptr<ThreadBuffer> threadBuffer)
+            : buffer(std::move(threadBuffer))
+        {
+        }
+
+        ~ThreadLog()
+        {
+            buffer->exited = true;
+        }
+    };
+
+    std::mutex _buffersMutex; //!< Guards _buffers and _droppedExited.
+    std::vector<std::shared_ptr<ThreadBuffer>> _buffers; //!< Every thread's buffer.
+    std::uint64_t _droppedExited = 0; //!< Records dropped by threads since exited.
+
+    std::mutex _drainMutex; //!< Held while draining, so the rings have one consumer.
+    std::ostream* _output = &std::cout; //!< Where records are written, guarded by _drainMutex.
+    std::vector<std::shared_ptr<ThreadBuffer>> _draining; //!< The buffers being drained, guarded by _drainMutex.
+    std::vector<const LogRecord*> _order; //!< The records drained, by time, guarded by _drainMutex.
+    std::vector<LogRecord> _drained; //!< The records drained, guarded by _drainMutex.
+    std::atomic<std::uint64_t> _written{0}; //!< Records written.
+
+    std::mutex _wakeMutex; //!< Pairs with _wake.
+    std::condition_variable _wake; //!< Signalled when a ring is half full.
+    std::thread _thread; //!< Drains the rings, never stopped.
+
+    Logger()
+    {
+        _drained.reserve(RecordsPerThread);
+        _thread = std::thread([this]()
+        {
+            while (true)
+            {
+                std::unique_lock<std::mutex> wakeGuard(_wakeMutex);
+                _wake.wait_for(wakeGuard, DrainInterval);
+                wakeGuard.unlock();
+                Drain();
+            }
+        });
+        _thread.detach();
+        std::atexit([]() { Logger::Instance().Flush(); });
+    }
+
+    /*!
+    \fn InitialLevel
+    \brief Gets the level named by the LOG_LEVEL environment variable, or Info.
+    \return the level.
+    */
+    static int InitialLevel()
+    {
+        LogLevel level = LogLevel::Info;
+        const char* name = std::getenv("LOG_LEVEL");
+        if (name != nullptr)
+        {
+            ParseLevel(name, level);
+        }
+        return static_cast<int>(level);
+    }
+
+    static inline std::atomic<int> _level{InitialLevel()}; //!< The lowest level written.
+
+    /*!
+    \fn Local
+    \brief Gets the calling thread's buffer, registering it on first use.
+    \return the thread's log.
+    */
+    static ThreadLog& Local()
+    {
+        thread_local ThreadLog local(Instance().Register());
+        return local;
+    }
+
+    std::shared_ptr<ThreadBuffer> Register()
+    {
+        std::shared_ptr<ThreadBuffer> buffer = std::make_shared<ThreadBuffer>();
+        std::lock_guard<std::mutex> buffersGuard(_buffersMutex);
+        _buffers.push_back(buffer);
+        return buffer;
+    }
+
+    /*!
+    \fn Drain
+    \brief Write every record buffered, oldest first, and forget the buffers
+           of threads that have exited once empty.
+    \return void
+    */
+    void Drain()
+    {
+        std::lock_guard<std::mutex> drainGuard(_drainMutex);
+        {
+            std::lock_guard<std::mutex> buffersGuard(_buffersMutex);
+            _draining.assign(_buffers.begin(), _buffers.end());
+        }
+
+        _drained.clear();
+        for (const std::shared_ptr<ThreadBuffer>& buffer : _draining)
+        {
+            bool exited = buffer->exited; // Before draining, so nothing is pushed after the last drain.
+            while (buffer->ring.TryPop([this](LogRecord& record) { _drained.push_back(record); }))
+            {
+            }
+            if (exited)
+            {
+                Forget(buffer);
+            }
+        }
+        _draining.clear();
+
+        if (_drained.empty())
+        {
+            return;
+        }
+
+        _order.clear();
+        for (const LogRecord& record : _drained)
+        {
+            _order.push_back(&record);
+        }
+        // Ties keep the order drained, which is each thread's own order. Not 
+        // stable_sort, which allocates.
+        std::sort(_order.begin(), _order.end(), [](const LogRecord* a, const LogRecord* b)
+        {
+            return (a->time < b->time) || ((a->time == b->time) && (a < b));
+        });
+
+        for (const LogRecord* record : _order)
+        {
+            _output->write(record->text.data(), static_cast<std::streamsize>(record->size));
+            if (record->truncated)
+            {
+                _output->write("...", 3);
+            }
+            _output->put('\n');
+        }
+        _output->flush();
+        _written += _drained.size();
+    }
+
+    void Forget(const std::shared_ptr<ThreadBuffer>& buffer)
+    {
+        std::lock_guard<std::mutex> buffersGuard(_buffersMutex);
+        _droppedExited += buffer->dropped;
+        _buffers.erase(std::remove(_buffers.begin(), _buffers.end(), buffer), _buffers.end());
+    }
+};
+
+/*!
+    \def LOG_AT
+    \brief Log a record at a level, e.g. LOG_AT(LogLevel::Info, "Connected to " << address),
+           formatting it only if the level is enabled.
+*/
+#define LOG_AT(level, ...) \
+    do \
+    { \
+        if (Logger::Enabled(level)) \
+        { \
+            Logger::Write(level, [&](std::ostream& logStream) { logStream << __VA_ARGS__; }); \
+        } \
+    } while (false)
+
+#if TSAI_LOG_COMPILED_LEVEL <= 0
+#define LOG_TRACE(...) LOG_AT(LogLevel::Trace, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) do { } while (false)
+#endif
+
+#if TSAI_LOG_COMPILED_LEVEL <= 1
+#define LOG_DEBUG(...) LOG_AT(LogLevel::Debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do { } while (false)
+#endif
+
+#if TSAI_LOG_COMPILED_LEVEL <= 2
+#define LOG_INFO(...) LOG_AT(LogLevel::Info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do { } while (false)
+#endif
+
+#if TSAI_LOG_COMPILED_LEVEL <= 3
+#define LOG_WARNING(...) LOG_AT(LogLevel::Warning, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) do { } while (false)
+#endif
+
+#if TSAI_LOG_COMPILED_LEVEL <= 4
+#define LOG_ERROR(...) LOG_AT(LogLevel::Error, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do { } while (false)
+#endif
+
+#endif
@@ -0,0 +1,526 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MESSAGEQUEUES_H
+#define MESSAGEQUEUES_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "RingBuffer.cpp"
+#include "BufferLimits.cpp"
+#include "TrafficClass.cpp"
+
+/*!
+    \class ReceiveQueue
+    \brief Hands received messages from an io thread to consumers, applying
+           BufferLimits.
+
+    Responsability
+    --------------
+    The io thread pushes each message into an SpscRing without taking a
+    lock. Consumers take turns as the ring's single consumer under a consumer
+    lock, which the io thread only takes to wake a sleeping consumer, or to
+    discard the oldest message under DropOldest.
+
+    Push() says when reading should stop: under Backpressure once full, and
+    under any policy once the ring itself is full, so an unlimited queue
+    slows the sender rather than losing messages. Exactly one of the io
+    thread and the consumers is told to resume reading.
+
+    Collaboration
+    -------------
+    Used by asyncClientTCP and asyncConnectionTCP.
+    \sa SendQueue()
+*/
+class ReceiveQueue
+{
+public:
+
+    /*!
+    \fn ReceiveQueue
+    \brief Allocate the ring.
+    \param limits the caps and policy. The ring holds one more than 
+           limits.maxMessages, so the cap's policy applies before the ring 
+           is full, or capacity if that is unlimited.
+    \param counters updated with what the limits do.
+    \param capacity the ring size if limits.maxMessages is unlimited.
+    \return void
+    */
+    ReceiveQueue(const BufferLimits& limits, BufferCounters& counters, std::size_t capacity = 4096)
+        : _limits(limits), _counters(counters), _ring((limits.maxMessages > 0) ? limits.maxMessages + 1 : capacity)
+    {
+    }
+
+    /*!
+    \fn Push
+    \brief Queue a received message.
+    \param message the message, swapped with a recycled string.
+    \warning Only call from the io thread.
+    \return false if reading must stop until a consumer resumes it.
+    */
+    bool Push(std::string& message)
+    {
+        std::size_t size = message.size();
+
+        if (_limits.Exceeded(_bytes + size, _ring.Size() + 1))
+        {
+            if (_limits.policy == OverflowPolicy::DropNewest)
+            {
+                _counters.messagesDroppedNewest++;
+                _counters.bytesDropped += size;
+                return true;
+            }
+
+            if (_limits.policy == OverflowPolicy::DropOldest)
+            {
+                std::lock_guard<std::mutex> dropGuard(_consumerMutex);
+                std::string dropped;
+                while (_limits.Exceeded(_bytes + size, _ring.Size() + 1) && TakeLocked(dropped))
+                {
+                    _counters.messagesDroppedOldest++;
+                    _counters.bytesDropped += dropped.size();
+                }
+
+                if (_limits.Exceeded(_bytes + size, _ring.Size() + 1)) // Larger than the cap alone.
+                {
+                    _counters.messagesDroppedNewest++;
+                    _counters.bytesDropped += size;
+                    return true;
+                }
+            }
+        }
+
+        _bytes += size;
+        bool queued = _ring.TryPush([&message](std::string& slot) { slot.swap(message); });
+        if (!queued)
+        {
+            _bytes -= size; // Only if pushed while paused.
+            _counters.messagesDroppedNewest++;
+            _counters.bytesDropped += size;
+            return false;
+        }
+        _counters.messagesBuffered++;
+
+        std::atomic_thread_fence(std::memory_order_seq_cst); // Pairs with Pop, so a sleeping consumer is seen.
+        if (_sleeping.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> wakeGuard(_consumerMutex);
+            _ready.notify_one();
+        }
+
+        if (!MustPause())
+        {
+            return true;
+        }
+
+        _paused.store(true);
+        _counters.readsPaused++;
+        return !(MustPause() || !_paused.exchange(false)); // A consumer may have made room meanwhile.
+    }
+
+    /*!
+    \fn TryPop
+    \brief Take the oldest message, if any.
+    \param message set to the message.
+    \param resume set if reading must be resumed.
+    \return false if the queue is empty.
+    */
+    bool TryPop(std::string& message, bool& resume)
+    {
+        std::unique_lock<std::mutex> popGuard(_consumerMutex);
+        bool taken = TakeLocked(message);
+        popGuard.unlock();
+
+        resume = taken && ResumeIfRoom();
+        return taken;
+    }
+
+    /*!
+    \fn Pop
+    \brief Take the oldest message, waiting for one.
+    \param message set to the message.
+    \param resume set if reading must be resumed.
+    \return false if the queue was stopped while waiting.
+    */
+    bool Pop(std::string& message, bool& resume)
+    {
+        std::unique_lock<std::mutex> popGuard(_consumerMutex);
+        while (!TakeLocked(message))
+        {
+            if (_stopping)
+            {
+                resume = false;
+                return false;
+            }
+
+            _sleeping++;
+            std::atomic_thread_fence(std::memory_order_seq_cst); // Pairs with Push.
+            _ready.wait(popGuard, [this] { return (_ring.Size() > 0) || _stopping; });
+            _sleeping--;
+        }
+        popGuard.unlock();
+
+        resume = ResumeIfRoom();
+        return true;
+    }
+
+    /*!
+    \fn Clear
+    \brief Discard every queued message.
+    \return true if reading must be resumed.
+    */
+    bool Clear()
+    {
+        std::unique_lock<std::mutex> clearGuard(_consumerMutex);
+        std::string message;
+        while (TakeLocked(message))
+        {
+        }
+        clearGuard.unlock();
+
+        return ResumeIfRoom();
+    }
+
+    /*!
+    \fn Stop
+    \brief Wake every waiting consumer, whose Pop returns false once the queue is empty.
+    \return void
+    */
+    void Stop()
+    {
+        std::lock_guard<std::mutex> stopGuard(_consumerMutex);
+        _stopping = true;
+        _ready.notify_all();
+    }
+
+    /*!
+    \fn Reset
+    \brief Discard every queued message and clear the paused and stopped states, 
+           e.g. to reuse a connection.
+    \warning Only call with no io thread or consumer using the queue.
+    \return void
+    */
+    void Reset()
+    {
+        std::lock_guard<std::mutex> resetGuard(_consumerMutex);
+        std::string message;
+        while (TakeLocked(message))
+        {
+        }
+        _paused = false;
+        _stopping = false;
+    }
+
+    /*!
+    \fn Size
+    \brief Gets the number of messages queued.
+    \return the count.
+    */
+    std::size_t Size() const
+    {
+        return _ring.Size();
+    }
+
+    /*!
+    \fn Statistics
+    \brief Gets the limit counters and the data currently queued.
+    \return the statistics.
+    */
+    BufferStatistics Statistics() const
+    {
+        return _counters.Snapshot(_bytes, _ring.Size());
+    }
+
+    /*!
+    \fn Buffered
+    \brief Gets the data currently queued.
+    \param bytes set to the bytes held.
+    \param messages set to the messages held.
+    \return void
+    */
+    void Buffered(std::size_t& bytes, std::size_t& messages) const
+    {
+        bytes = _bytes;
+        messages = _ring.Size();
+    }
+
+private:
+
+    /*!
+    \fn TakeLocked
+    \brief Take the oldest message, releasing its share of the limits.
+    \warning _consumerMutex must be held.
+    \return false if the queue is empty.
+    */
+    bool TakeLocked(std::string& message)
+    {
+        return _ring.TryPop([this, &message](std::string& slot)
+        {
+            message.swap(slot);
+            _bytes -= message.size();
+        });
+    }
+
+    /*!
+    \fn MustPause
+    \brief Returns if reading must stop, as the ring or, under Backpressure, a cap is full.
+    \return bool
+    */
+    bool MustPause() const
+    {
+        std::size_t messages = _ring.Size();
+        return (messages >= _ring.Capacity())
+            || ((_limits.policy == OverflowPolicy::Backpressure) && _limits.Full(_bytes, messages));
+    }
+
+    /*!
+    \fn ResumeIfRoom
+    \brief After taking, claim the right to resume reading if it is paused and there is room.
+    \return true if the caller must resume reading.
+    */
+    bool ResumeIfRoom()
+    {
+        return _paused.load() && !MustPause() && _paused.exchange(false);
+    }
+
+    BufferLimits _limits; //!< Caps on the queue.
+    BufferCounters& _counters; //!< What the caps have done, owned by whoever outlives the connection.
+    SpscRing<std::string> _ring; //!< The messages, filled by the io thread.
+
+    std::atomic<std::size_t> _bytes{0}; //!< Bytes queued.
+    std::atomic<bool> _paused{false}; //!< Reading stopped until a consumer makes room.
+    std::atomic<int> _sleeping{0}; //!< Consumers waiting in Pop.
+    bool _stopping = false; //!< Set by Stop, guarded by _consumerMutex.
+
+    std::mutex _consumerMutex; //!< Makes one consumer at a time the ring's consumer.
+    std::condition_variable _ready; //!< Signalled when a message is queued to a sleeping consumer.
+};
+
+/*!
+    \class SendQueue
+    \brief Hands messages to send from any thread to an io thread, a lane per
+           TrafficClass.
+
+    Responsability
+    --------------
+    Senders push into the MpscRing of their message's class without taking
+    a lock. The first sender to find the queue idle is told to start the
+    writer on the io thread, which takes one batch per gathered write: every
+    Control message queued first, then Bulk messages up to a byte budget,
+    so a control message waits behind at most one budget of bulk data
+    rather than everything queued. The writer stops once it finds the queue
+    empty.
+
+    A message is never dropped: once a lane's ring is full, its messages
+    wait in the lane's overflow deque, under a lock, until the writer has
+    taken everything queued before them. So a burst beyond the ring's
+    capacity costs a lock per message rather than messages.
+
+    Written() counts each message's latency, from being queued to being
+    written, by class.
+
+    Collaboration
+    -------------
+    Used by asyncClientTCP and asyncConnectionTCP.
+    \sa ReceiveQueue()
+*/
+class SendQueue
+{
+public:
+    static constexpr std::size_t BulkBytesPerWrite = 64 * 1024; //!< The bulk data a control message can wait behind.
+
+    /*!
+    \fn SendQueue
+    \brief Allocate the rings.
+    \param latency updated with the latency of each message written.
+    \param capacity the most messages queued in each lane.
+    \return void
+    */
+    explicit SendQueue(LaneLatency& latency, std::size_t capacity = 4096)
+        : _latency(latency), _control(capacity), _bulk(capacity)
+    {
+    }
+
+    /*!
+    \fn Push
+    \brief Queue a framed message to send, in the lane of its class.
+    \param message swapped into the queue, so left with the storage of an 
+           earlier message.
+    \param start set if the caller must start the writer on the io thread.
+    \note Safe to call from any thread. Takes the lane's overflow lock only 
+          while its ring is full or its overflow is not yet written.
+    \return void
+    */
+    void Push(OutboundMessage& message, bool& start)
+    {
+        message.queued = std::chrono::steady_clock::now();
+        SendLane& lane = Lane(message.traffic);
+        if ((lane.overflowed.load() > 0) || !lane.ring.TryPush([&message](OutboundMessage& slot) { std::swap(slot, message); }))
+        {
+            std::lock_guard<std::mutex> overflowGuard(lane.overflowMutex); // Behind everything in the ring.
+            lane.overflow.emplace_back();
+            std::swap(lane.overflow.back(), message);
+            lane.overflowed++;
+        }
+
+        start = !_writing.exchange(true);
+    }
+
+    /*!
+    \fn Overflowed
+    \brief Gets the number of messages waiting in the overflow of both lanes.
+    \return the count.
+    */
+    std::size_t Overflowed() const
+    {
+        return _control.overflowed.load() + _bulk.overflowed.load();
+    }
+
+    /*!
+    \fn Take
+    \brief Take the next batch, control messages first, or stop the writer if nothing is queued.
+    \param batch cleared and filled with the messages to write.
+    \warning Only call from the io thread, while the writer is started.
+    \return false if nothing is queued and the writer has stopped.
+    */
+    bool Take(std::vector<OutboundMessage>& batch)
+    {
+        batch.clear();
+
+        while (true)
+        {
+            OutboundMessage message;
+
+            while (TakeOne(_control, message))
+            {
+                batch.push_back(std::move(message));
+            }
+
+            std::size_t bulkBytes = 0;
+            while ((bulkBytes < BulkBytesPerWrite) && TakeOne(_bulk, message))
+            {
+                bulkBytes += message.Size();
+                batch.push_back(std::move(message));
+            }
+
+            if (!batch.empty())
+            {
+                return true;
+            }
+
+            _writing.store(false);
+            if ((_control.Empty() && _bulk.Empty()) || _writing.exchange(true)) // A sender may have pushed without starting us.
+            {
+                return false;
+            }
+        }
+    }
+
+    /*!
+    \fn Written
+    \brief Count the latency of each message of a batch once written, and 
+           release the payloads, so a shared one is freed once every 
+           connection has written it.
+    \return void
+    */
+    void Written(std::vector<OutboundMessage>& batch)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        for (OutboundMessage& message : batch)
+        {
+            _latency.Record(message.traffic, now - message.queued);
+            message.Release();
+        }
+    }
+
+    /*!
+    \fn Reset
+    \brief Discard every queued message and stop the writer, e.g. to reuse a connection.
+    \warning Only call with no sender or writer using the queue.
+    \return void
+    */
+    void Reset()
+    {
+        OutboundMessage message;
+        while (TakeOne(_control, message) || TakeOne(_bulk, message))
+        {
+            message.Release();
+        }
+        _writing = false;
+    }
+
+private:
+
+    /*!
+        \struct SendLane
+        \brief The messages of one class awaiting the writer.
+    */
+    struct SendLane
+    {
+        explicit SendLane(std::size_t capacity) : ring(capacity)
+        {
+        }
+
+        bool Empty() const
+        {
+            return (ring.Size() == 0) && (overflowed.load() == 0);
+        }
+
+        MpscRing<OutboundMessage> ring; //!< Queued without a lock while there is room and no overflow.
+        std::deque<OutboundMessage> overflow; //!< Queued once the ring was full, all newer than those in the ring, guarded by overflowMutex.
+        std::mutex overflowMutex; //!< Guards overflow.
+        std::atomic<std::size_t> overflowed{0}; //!< The size of overflow, read without the lock.
+    };
+
+    LaneLatency& _latency; //!< What each class's latency has been, owned by whoever outlives the connection.
+    SendLane _control; //!< Control messages awaiting the writer.
+    SendLane _bulk; //!< Bulk messages awaiting the writer.
+    std::atomic<bool> _writing{false}; //!< If the writer is started.
+
+    SendLane& Lane(TrafficClass traffic)
+    {
+        return (traffic == TrafficClass::Control) ? _control : _bulk;
+    }
+
+    /*!
+    \fn TakeOne
+    \brief Take the oldest message of a lane, from its ring, or once that is 
+           empty from its overflow.
+    \param lane the lane.
+    \param message set to the message taken.
+    \return false if the lane is empty.
+    */
+    bool TakeOne(SendLane& lane, OutboundMessage& message)
+    {
+        if (lane.ring.TryPop([&message](OutboundMessage& slot) { std::swap(message, slot); }))
+        {
+            return true;
+        }
+        if (lane.overflowed.load() == 0)
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> overflowGuard(lane.overflowMutex);
+        if (lane.overflow.empty())
+        {
+            return false;
+        }
+        std::swap(message, lane.overflow.front());
+        lane.overflow.pop_front();
+        lane.overflowed--;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,92 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef RECONNECTBACKOFF_H
+#define RECONNECTBACKOFF_H
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+/*!
+    \class ReconnectBackoff
+    \brief Jittered exponential delays between reconnection attempts.
+
+    Responsability
+    --------------
+    The first retry follows a blip within milliseconds. Each further failure
+    doubles the delay up to a maximum. Every delay is drawn at random from
+    the upper half of the current step, so a fleet of clients losing the same
+    server does not reconnect in lock-step. Reset() once a connection proves
+    healthy, i.e. delivers data, so a server that accepts and immediately
+    drops connections still backs off.
+
+    Collaboration
+    -------------
+    Used by ConnectionClient, asyncClientTCPManager and FanInClient.
+*/
+class ReconnectBackoff
+{
+public:
+
+    /*!
+    \fn ReconnectBackoff
+    \brief Set the range of delays.
+    \param initial the delay before the first retry.
+    \param maximum the longest delay.
+    \return void
+    */
+    ReconnectBackoff(std::chrono::milliseconds initial = std::chrono::milliseconds(50), std::chrono::milliseconds maximum = std::chrono::seconds(5))
+        : _initial(initial), _maximum(std::max(initial, maximum))
+    {
+    }
+
+    /*!
+    \fn Next
+    \brief Gets the delay before the next attempt and lengthens the following one.
+    \return the delay.
+    */
+    std::chrono::milliseconds Next()
+    {
+        std::chrono::milliseconds step = _initial;
+        for (unsigned i = 0; (i < _attempts) && (step < _maximum); i++)
+        {
+            step *= 2;
+        }
+        step = std::min(step, _maximum);
+        _attempts++;
+
+        static thread_local std::mt19937 generator(std::random_device{}());
+        std::uniform_int_distribution<long> jitter(step.count() / 2, step.count());
+        return std::chrono::milliseconds(jitter(generator));
+    }
+
+    /*!
+    \fn Reset
+    \brief Start again from the initial delay.
+    \return void
+    */
+    void Reset()
+    {
+        _attempts = 0;
+    }
+
+    /*!
+    \fn Attempts
+    \brief Gets the number of delays given since the last reset.
+    \return the count.
+    */
+    unsigned Attempts() const
+    {
+        return _attempts;
+    }
+
+private:
+    std::chrono::milliseconds _initial; //!< The delay before the first retry.
+    std::chrono::milliseconds _maximum; //!< The longest delay.
+    unsigned _attempts = 0; //!< Delays given since the last reset.
+};
+
+#endif
@@ -0,0 +1,290 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+static constexpr std::size_t CacheLineSize = 64; //!< Separates indices written by different threads.
+
+/*!
+    \class SpscRing
+    \brief A bounded, lock-free, single producer single consumer queue.
+
+    Responsability
+    --------------
+    Hand items from exactly one producer thread to exactly one consumer
+    thread without locks. The slots are allocated once; items are filled and
+    consumed in place, so slot members such as std::string keep their
+    capacity and steady state use does not allocate. The producer and
+    consumer indices sit on separate cache lines, and each side caches the
+    other's index to avoid touching its line on every call.
+
+    Collaboration
+    -------------
+    Used to move data off the network threads, e.g. by CaptureLog and
+    ReceiveQueue.
+*/
+template <typename T>
+class SpscRing
+{
+public:
+
+    /*!
+    \fn SpscRing
+    \brief Allocate the slots.
+    \param capacity the most items held, rounded up to a power of two.
+    \return void
+    */
+    explicit SpscRing(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        _slots.resize(size);
+        _mask = size - 1;
+    }
+
+    /*!
+    \fn TryPush
+    \brief Fill the next free slot in place.
+    \param fill called with the slot to fill.
+    \warning Only call from the producer thread.
+    \return false if the ring is full.
+    */
+    template <typename Fill>
+    bool TryPush(Fill&& fill)
+    {
+        std::size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _cachedHead > _mask)
+        {
+            _cachedHead = _head.load(std::memory_order_acquire);
+            if (tail - _cachedHead > _mask)
+            {
+                return false;
+            }
+        }
+
+        fill(_slots[tail & _mask]);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*!
+    \fn TryPop
+    \brief Consume the oldest item in place.
+    \param consume called with the slot to consume.
+    \warning Only call from the consumer thread.
+    \return false if the ring is empty.
+    */
+    template <typename Consume>
+    bool TryPop(Consume&& consume)
+    {
+        std::size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _cachedTail)
+        {
+            _cachedTail = _tail.load(std::memory_order_acquire);
+            if (head == _cachedTail)
+            {
+                return false;
+            }
+        }
+
+        consume(_slots[head & _mask]);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*!
+    \fn Size
+    \brief Gets the number of items held. Only a snapshot when called while
+           the other thread is active.
+    \return the count.
+    */
+    std::size_t Size() const
+    {
+        return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+    }
+
+    /*!
+    \fn Capacity
+    \brief Gets the most items held.
+    \return the count.
+    */
+    std::size_t Capacity() const
+    {
+        return _mask + 1;
+    }
+
+private:
+    std::vector<T> _slots; //!< The items, allocated once.
+    std::size_t _mask; //!< Capacity - 1, mapping an index to its slot.
+
+    alignas(CacheLineSize) std::atomic<std::size_t> _head{0}; //!< Next slot to consume, written by the consumer.
+    std::size_t _cachedTail = 0; //!< The consumer's last view of _tail.
+
+    alignas(CacheLineSize) std::atomic<std::size_t> _tail{0}; //!< Next slot to fill, written by the producer.
+    std::size_t _cachedHead = 0; //!< The producer's last view of _head.
+};
+
+/*!
+    \class MpscRing
+    \brief A bounded, lock-free, multiple producer single consumer queue.
+
+    Responsability
+    --------------
+    Hand items from any number of producer threads to one consumer thread.
+    Producers claim a slot with a compare and swap on the shared tail; each
+    slot carries a sequence number that tells the consumer, and later
+    producers, whether it has been filled or consumed, so no producer waits
+    for another to finish filling. Slots are filled and consumed in place and
+    sit on their own cache lines, so producers filling neighbouring slots do
+    not contend.
+
+    Collaboration
+    -------------
+    Used to queue messages from any thread to an io thread, e.g. by SendQueue.
+*/
+template <typename T>
+class MpscRing
+{
+public:
+
+    /*!
+    \fn MpscRing
+    \brief Allocate the slots.
+    \param capacity the most items held, rounded up to a power of two.
+    \return void
+    */
+    explicit MpscRing(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        _slots.reset(new Slot[size]);
+        _mask = size - 1;
+
+        for (std::size_t i = 0; i < size; i++)
+        {
+            _slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /*!
+    \fn TryPush
+    \brief Claim and fill the next free slot in place.
+    \param fill called with the slot to fill.
+    \note Safe to call from any thread.
+    \return false if the ring is full.
+    */
+    template <typename Fill>
+    bool TryPush(Fill&& fill)
+    {
+        std::size_t tail = _tail.load(std::memory_order_relaxed);
+        Slot* slot;
+
+        while (true)
+        {
+            slot = &_slots[tail & _mask];
+            std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(tail);
+
+            if (difference == 0)
+            {
+                if (_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+                {
+                    break; // Claimed.
+                }
+            }
+            else if (difference < 0)
+            {
+                return false; // Not yet consumed, so full.
+            }
+            else
+            {
+                tail = _tail.load(std::memory_order_relaxed); // Claimed by another producer.
+            }
+        }
+
+        fill(slot->value);
+        slot->sequence.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*!
+    \fn TryPop
+    \brief Consume the oldest item in place.
+    \param consume called with the slot to consume.
+    \warning Only call from one consumer thread at a time.
+    \return false if the ring is empty, or the oldest item is still being filled.
+    */
+    template <typename Consume>
+    bool TryPop(Consume&& consume)
+    {
+        std::size_t head = _head.load(std::memory_order_relaxed);
+        Slot& slot = _slots[head & _mask];
+
+        if (slot.sequence.load(std::memory_order_acquire) != head + 1)
+        {
+            return false;
+        }
+
+        consume(slot.value);
+        slot.sequence.store(head + _mask + 1, std::memory_order_release);
+        _head.store(head + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /*!
+    \fn Size
+    \brief Gets the number of items claimed and not yet consumed. Only a snapshot.
+    \return the count.
+    */
+    std::size_t Size() const
+    {
+        std::size_t head = _head.load(std::memory_order_relaxed);
+        std::size_t tail = _tail.load(std::memory_order_relaxed);
+        return (tail > head) ? tail - head : 0;
+    }
+
+    /*!
+    \fn Capacity
+    \brief Gets the most items held.
+    \return the count.
+    */
+    std::size_t Capacity() const
+    {
+        return _mask + 1;
+    }
+
+private:
+
+    /*!
+        \struct Slot
+        \brief An item and the sequence number saying who may use it next.
+    */
+    struct alignas(CacheLineSize) Slot
+    {
+        std::atomic<std::size_t> sequence; //!< Index it may be filled at, or one more once filled.
+        T value; //!< The item.
+    };
+
+    std::unique_ptr<Slot[]> _slots; //!< The items, allocated once.
+    std::size_t _mask; //!< Capacity - 1, mapping an index to its slot.
+
+    alignas(CacheLineSize) std::atomic<std::size_t> _tail{0}; //!< Next index to claim, shared by the producers.
+    alignas(CacheLineSize) std::atomic<std::size_t> _head{0}; //!< Next index to consume, written by the consumer.
+};
+
+#endif
@@ -0,0 +1,275 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef SLABPOOL_H
+#define SLABPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <boost/intrusive_ptr.hpp>
+
+template <typename T> class SlabPool;
+
+/*!
+    \class Pooled
+    \brief An intrusive reference count, for use with boost::intrusive_ptr,
+           returning the object to its SlabPool when the last reference goes.
+
+    Responsability
+    --------------
+    Derive T from Pooled<T>. An object drawn from a pool goes back to it, and
+    is recycled for reuse; an object created alone with new is deleted.
+    Unlike boost::shared_ptr no control block is allocated, and the count is
+    in the object, so taking a pointer from `this` is always safe.
+
+    Collaboration
+    -------------
+    Used by ConnectionTCP and asyncConnectionTCP.
+    \sa SlabPool()
+*/
+template <typename T>
+class Pooled
+{
+public:
+
+    /*!
+    \fn References
+    \brief Gets the number of pointers to the object.
+    \return the count.
+    */
+    std::size_t References() const
+    {
+        return _references.load(std::memory_order_relaxed);
+    }
+
+protected:
+    Pooled() = default;
+    Pooled(const Pooled&) = delete;
+    Pooled& operator=(const Pooled&) = delete;
+
+private:
+    friend class SlabPool<T>;
+
+    std::atomic<std::size_t> _references{0}; //!< Pointers to the object.
+    std::shared_ptr<SlabPool<T>> _pool; //!< The pool while the object is in use, null if created alone.
+
+    friend void intrusive_ptr_add_ref(Pooled* object)
+    {
+        object->_references.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    friend void intrusive_ptr_release(Pooled* object)
+    {
+        if (object->_references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            Release(object);
+        }
+    }
+
+    /*!
+    \fn Release
+    \brief Return an object no longer referenced to its pool, or delete it.
+    \return void
+    */
+    static void Release(Pooled* object)
+    {
+        if (object->_pool)
+        {
+            std::shared_ptr<SlabPool<T>> pool = std::move(object->_pool); // May be the last owner of the pool.
+            pool->Return(static_cast<T*>(object));
+        }
+        else
+        {
+            delete static_cast<T*>(object);
+        }
+    }
+};
+
+/*!
+    \class SlabPool
+    \brief Objects kept in slabs of contiguous storage and reused, rather than
+           allocated one at a time.
+
+    Responsability
+    --------------
+    Storage is allocated a slab of objects at a time, starting with one, and
+    grows by whole slabs. An object is constructed the first time its slot is
+    used. When its last reference goes it is recycled, i.e. T::recycle()
+    returns it to the state it was constructed in, and it is kept for the
+    next Acquire(), together with everything it allocated, e.g. its buffers.
+    So after a burst of connections, later bursts of the same size allocate
+    nothing, and long-running processes do not fragment the heap.
+
+    Objects are destroyed with the pool, which lives until the last object
+    drawn from it has been returned.
+
+    Collaboration
+    -------------
+    Used by ServerTCP and asyncServerTCP for their connections.
+    \sa Pooled()
+*/
+template <typename T>
+class SlabPool : public std::enable_shared_from_this<SlabPool<T>>
+{
+public:
+    typedef std::function<T*(void*)> Constructor; //!< Constructs an object at the storage given, e.g. with placement new.
+
+    /*!
+    \fn Create
+    \brief Create a pool, allocating its first slab.
+    \param construct constructs each object the first time its slot is used.
+    \param slabSize the objects in each slab.
+    \return the pool.
+    */
+    static std::shared_ptr<SlabPool> Create(Constructor construct, std::size_t slabSize = 32)
+    {
+        return std::shared_ptr<SlabPool>(new SlabPool(std::move(construct), slabSize));
+    }
+
+    /*!
+    \fn ~SlabPool
+    \brief Destroy every object and free the slabs.
+    \return void
+    */
+    ~SlabPool()
+    {
+        for (std::size_t i = 0; i < _constructed; i++)
+        {
+            Slot(i)->~T();
+        }
+    }
+
+    /*!
+    \fn Acquire
+    \brief Gets a recycled object, constructing one only if none is free.
+    \return the object.
+    */
+    boost::intrusive_ptr<T> Acquire()
+    {
+        std::lock_guard<std::mutex> acquireGuard(_freeMutex);
+
+        T* object;
+        if (!_free.empty())
+        {
+            object = _free.back();
+            _free.pop_back();
+            _reused++;
+        }
+        else
+        {
+            if (_constructed == _slabs.size() * _slabSize)
+            {
+                Grow();
+            }
+            object = _construct(Slot(_constructed));
+            _constructed++;
+        }
+
+        object->_pool = this->shared_from_this();
+        return boost::intrusive_ptr<T>(object);
+    }
+
+    /*!
+    \fn Constructed
+    \brief Gets the number of objects constructed, i.e. the most in use at once.
+    \return the count.
+    */
+    std::size_t Constructed()
+    {
+        std::lock_guard<std::mutex> countGuard(_freeMutex);
+        return _constructed;
+    }
+
+    /*!
+    \fn Reused
+    \brief Gets the number of times a recycled object was acquired.
+    \return the count.
+    */
+    std::uint64_t Reused()
+    {
+        std::lock_guard<std::mutex> countGuard(_freeMutex);
+        return _reused;
+    }
+
+    /*!
+    \fn Slabs
+    \brief Gets the number of slabs allocated.
+    \return the count.
+    */
+    std::size_t Slabs()
+    {
+        std::lock_guard<std::mutex> countGuard(_freeMutex);
+        return _slabs.size();
+    }
+
+private:
+    friend class Pooled<T>;
+
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+
+    Constructor _construct; //!< Constructs each object.
+    std::size_t _slabSize; //!< Objects in each slab.
+    std::vector<std::unique_ptr<Storage[]>> _slabs; //!< The storage, guarded by _freeMutex.
+    std::size_t _constructed = 0; //!< Objects constructed, filling the slabs in order, guarded by _freeMutex.
+    std::vector<T*> _free; //!< Recycled objects, guarded by _freeMutex.
+    std::uint64_t _reused = 0; //!< Recycled objects acquired, guarded by _freeMutex.
+    std::mutex _freeMutex;
+
+    /*!
+    \fn SlabPool
+    \brief Use Create, as objects in use share ownership of the pool.
+    \return void
+    */
+    SlabPool(Constructor construct, std::size_t slabSize)
+        : _construct(std::move(construct)), _slabSize((slabSize > 0) ? slabSize : 1)
+    {
+        Grow();
+    }
+
+    /*!
+    \fn Grow
+    \brief Allocate another slab.
+    \warning _freeMutex must be held, except when constructing.
+    \return void
+    */
+    void Grow()
+    {
+        _slabs.emplace_back(new Storage[_slabSize]);
+        _free.reserve(_slabs.size() * _slabSize); // So Return never allocates.
+    }
+
+    /*!
+    \fn Slot
+    \brief Gets the storage of the i-th object.
+    \return the storage.
+    */
+    T* Slot(std::size_t i)
+    {
+        return reinterpret_cast<T*>(&_slabs[i / _slabSize][i % _slabSize]);
+    }
+
+    /*!
+    \fn Return
+    \brief Recycle an object no longer referenced and keep it for reuse.
+    \return void
+    */
+    void Return(T* object)
+    {
+        object->recycle();
+
+        std::lock_guard<std::mutex> returnGuard(_freeMutex);
+        _free.push_back(object);
+    }
+};
+
+#endif
@@ -0,0 +1,216 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef SLOTMAP_H
+#define SLOTMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*!
+    \struct SlotKey
+    \brief Identifies a value in a SlotMap. A key whose value was removed
+           never finds the value later stored in the same slot.
+*/
+struct SlotKey
+{
+    std::uint32_t index = 0; //!< The slot.
+    std::uint32_t generation = 0; //!< The slot's generation when the value was inserted, odd for a valid key.
+
+    /*!
+    \fn Pack
+    \brief Gets the key as one number, e.g. to identify a connection.
+    \return the number, 0 for a default key.
+    */
+    std::uint64_t Pack() const
+    {
+        return (static_cast<std::uint64_t>(generation) << 32) | index;
+    }
+
+    /*!
+    \fn Unpack
+    \brief Gets a key from a number given by Pack.
+    \return the key.
+    */
+    static SlotKey Unpack(std::uint64_t packed)
+    {
+        SlotKey key;
+        key.index = static_cast<std::uint32_t>(packed);
+        key.generation = static_cast<std::uint32_t>(packed >> 32);
+        return key;
+    }
+};
+
+/*!
+    \class SlotMap
+    \brief Values with stable, generation-checked keys, stored densely.
+
+    Responsability
+    --------------
+    Insert, find and remove in constant time, and iterate over only the
+    values present. Values live contiguously; removing one moves the last
+    value into its place. Each slot maps a key to its value's position and
+    counts how often it has been reused, so a stale key is rejected rather
+    than finding a newer value. A slot's generation is odd while it holds a
+    value and even while free, so no key finds a free slot. Free slots are
+    reused, so the map only grows with the most values held at once.
+
+    Collaboration
+    -------------
+    Used by asyncServerTCP as its registry of connections.
+*/
+template <typename T>
+class SlotMap
+{
+public:
+    typedef typename std::vector<T>::iterator iterator;
+    typedef typename std::vector<T>::const_iterator const_iterator;
+
+    /*!
+    \fn Insert
+    \brief Store a value.
+    \param value the value.
+    \return its key.
+    */
+    SlotKey Insert(T value)
+    {
+        std::uint32_t index;
+        if (_freeHead != NoSlot)
+        {
+            index = _freeHead;
+            _freeHead = _slots[index].position;
+        }
+        else
+        {
+            index = static_cast<std::uint32_t>(_slots.size());
+            _slots.push_back(Slot());
+        }
+
+        Slot& slot = _slots[index];
+        slot.generation++; // Odd, so held.
+        slot.position = static_cast<std::uint32_t>(_values.size());
+        _values.push_back(std::move(value));
+        _owners.push_back(index);
+
+        SlotKey key;
+        key.index = index;
+        key.generation = slot.generation;
+        return key;
+    }
+
+    /*!
+    \fn Remove
+    \brief Remove a value.
+    \param key the value's key.
+    \return false if the key is stale or unknown.
+    */
+    bool Remove(SlotKey key)
+    {
+        if (!Contains(key))
+        {
+            return false;
+        }
+
+        Slot& slot = _slots[key.index];
+        std::uint32_t last = static_cast<std::uint32_t>(_values.size() - 1);
+
+        if (slot.position != last)
+        {
+            _values[slot.position] = std::move(_values[last]);
+            _owners[slot.position] = _owners[last];
+            _slots[_owners[slot.position]].position = slot.position;
+        }
+        _values.pop_back();
+        _owners.pop_back();
+
+        slot.generation++; // Even, so free, invalidating every key to the old value. Wraps from UINT32_MAX to 0, still even.
+        slot.position = _freeHead;
+        _freeHead = key.index;
+        return true;
+    }
+
+    /*!
+    \fn Contains
+    \brief Returns if the key's value is present.
+    \return bool
+    */
+    bool Contains(SlotKey key) const
+    {
+        return (key.index < _slots.size()) && ((key.generation & 1) != 0) && (_slots[key.index].generation == key.generation);
+    }
+
+    /*!
+    \fn Get
+    \brief Gets the key's value.
+    \return the value, or nullptr if the key is stale or unknown.
+    */
+    T* Get(SlotKey key)
+    {
+        return Contains(key) ? &_values[_slots[key.index].position] : nullptr;
+    }
+
+    /*!
+    \fn Size
+    \brief Gets the number of values.
+    \return the count.
+    */
+    std::size_t Size() const
+    {
+        return _values.size();
+    }
+
+    /*!
+    \fn Slots
+    \brief Gets the number of slots allocated, i.e. the most values held at once.
+    \return the count.
+    */
+    std::size_t Slots() const
+    {
+        return _slots.size();
+    }
+
+    /*!
+    \fn Clear
+    \brief Remove every value, invalidating every key.
+    \return void
+    */
+    void Clear()
+    {
+        while (!_owners.empty())
+        {
+            SlotKey key;
+            key.index = _owners.back();
+            key.generation = _slots[key.index].generation;
+            Remove(key);
+        }
+    }
+
+    iterator begin() { return _values.begin(); } //!< The first value, in no particular order.
+    iterator end() { return _values.end(); } //!< \sa begin
+    const_iterator begin() const { return _values.begin(); } //!< \sa begin
+    const_iterator end() const { return _values.end(); } //!< \sa begin
+
+private:
+    static constexpr std::uint32_t NoSlot = UINT32_MAX; //!< Ends the free list.
+
+    /*!
+        \struct Slot
+        \brief Where a key's value is, or the next free slot.
+    */
+    struct Slot
+    {
+        std::uint32_t generation = 0; //!< Incremented on each insertion and removal, odd while a value is held.
+        std::uint32_t position = 0; //!< The value's position, or the next free slot while free.
+    };
+
+    std::vector<Slot> _slots; //!< Indexed by SlotKey::index.
+    std::vector<T> _values; //!< The values, contiguous.
+    std::vector<std::uint32_t> _owners; //!< The slot of each value.
+    std::uint32_t _freeHead = NoSlot; //!< The first free slot.
+};
+
+#endif
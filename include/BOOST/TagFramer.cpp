@@ -0,0 +1,281 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TAGFRAMER_H
+#define TAGFRAMER_H
+
+#include <cstddef>
+#include <string>
+
+/*!
+    \class TagFramer
+    \brief Splits a byte stream into complete top-level XML elements.
+
+    Responsability
+    --------------
+    Accumulate received bytes and emit each complete top-level element, e.g.
+    <Vision ...>...</Vision> or <Phase/>, together with its tag name. Text
+    between elements, declarations (<?...?>), comments (<!...>) and stray
+    end tags are discarded.
+
+    The scan position is remembered between calls, so bytes already examined
+    are never scanned again while waiting for the rest of an element.
+
+    Collaboration
+    -------------
+    Used by ConnectionClient to frame the stream once on the receive thread.
+*/
+class TagFramer
+{
+public:
+
+    /*!
+    \fn Append
+    \brief Add received bytes to the end of the pending data.
+    \param data the bytes received.
+    \param length the number of bytes received.
+    \return void
+    */
+    void Append(const char* data, std::size_t length)
+    {
+        if (_head > 0)
+        {
+            Compact();
+        }
+        _pending.append(data, length);
+    }
+
+    /*!
+    \fn Next
+    \brief Extract the next complete top-level element, if one is available.
+    \param tag set to the name of the element found.
+    \param frame set to the whole element, including its start and end tags.
+    \return true if an element was extracted, false if more data is required.
+    */
+    bool Next(std::string& tag, std::string& frame)
+    {
+        while (true)
+        {
+            if (_tag.empty())
+            {
+                if (!FindStart())
+                {
+                    return false;
+                }
+
+                if (_tag.empty()) // Skipped a declaration, comment or stray end tag.
+                {
+                    continue;
+                }
+            }
+
+            std::size_t end = FindEnd();
+            if (end == std::string::npos)
+            {
+                return false;
+            }
+
+            tag = _tag;
+            frame.assign(_pending, _start, end - _start);
+
+            _head = end;
+            _scan = end;
+            _tag.clear();
+            return true;
+        }
+    }
+
+    /*!
+    \fn Pending
+    \brief Gets the number of bytes held waiting for the rest of an element.
+    \return the number of bytes.
+    */
+    std::size_t Pending() const
+    {
+        return _pending.size() - _head;
+    }
+
+    /*!
+    \fn Clear
+    \brief Discard all pending data, e.g. after the connection is lost.
+    \return void
+    */
+    void Clear()
+    {
+        _pending.clear();
+        _head = 0;
+        _scan = 0;
+        _start = 0;
+        _depth = 0;
+        _tag.clear();
+    }
+
+private:
+
+    /*!
+    \fn IsNameEnd
+    \brief Returns if the character terminates an element name.
+    \return bool
+    */
+    static bool IsNameEnd(char c)
+    {
+        return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n') || (c == '/') || (c == '>');
+    }
+
+    /*!
+    \fn Compact
+    \brief Remove consumed bytes from the front of the pending data.
+    \return void
+    */
+    void Compact()
+    {
+        _pending.erase(0, _head);
+        _scan -= _head;
+        if (_start >= _head)
+        {
+            _start -= _head;
+        }
+        _head = 0;
+    }
+
+    /*!
+    \fn FindStart
+    \brief Locate the start tag of the next top-level element.
+    \return false if more data is required, otherwise true with _tag set,
+            or empty if a non element was skipped.
+    */
+    bool FindStart()
+    {
+        std::size_t open = _pending.find('<', _scan);
+        if (open == std::string::npos)
+        {
+            _head = _pending.size(); // Nothing of value.
+            _scan = _head;
+            return false;
+        }
+
+        _head = open;
+        _scan = open;
+
+        if (open + 1 >= _pending.size())
+        {
+            return false;
+        }
+
+        char first = _pending[open + 1];
+        if ((first == '?') || (first == '!') || (first == '/'))
+        {
+            std::size_t close = _pending.find('>', open);
+            if (close == std::string::npos)
+            {
+                return false;
+            }
+            _head = close + 1;
+            _scan = _head;
+            return true;
+        }
+
+        std::size_t nameEnd = open + 1;
+        while ((nameEnd < _pending.size()) && !IsNameEnd(_pending[nameEnd]))
+        {
+            nameEnd++;
+        }
+
+        if (nameEnd >= _pending.size())
+        {
+            return false;
+        }
+
+        _tag.assign(_pending, open + 1, nameEnd - open - 1);
+        _start = open;
+        _scan = nameEnd;
+        _depth = 0;
+        return true;
+    }
+
+    /*!
+    \fn FindEnd
+    \brief Locate the end of the element currently open, allowing for nested
+           elements of the same name.
+    \return the offset one past the final '>', or npos if more data is required.
+    */
+    std::size_t FindEnd()
+    {
+        if (_depth == 0) // Still within the start tag.
+        {
+            std::size_t close = _pending.find('>', _scan);
+            if (close == std::string::npos)
+            {
+                _scan = _pending.size();
+                return std::string::npos;
+            }
+
+            if (_pending[close - 1] == '/')
+            {
+                return close + 1;
+            }
+
+            _depth = 1;
+            _scan = close + 1;
+        }
+
+        while (true)
+        {
+            std::size_t open = _pending.find('<', _scan);
+            if (open == std::string::npos)
+            {
+                _scan = _pending.size();
+                return std::string::npos;
+            }
+
+            bool isEnd = (open + 1 < _pending.size()) && (_pending[open + 1] == '/');
+            std::size_t nameStart = open + (isEnd ? 2 : 1);
+            std::size_t nameEnd = nameStart + _tag.size();
+
+            if (nameEnd >= _pending.size())
+            {
+                _scan = open;
+                return std::string::npos;
+            }
+
+            if ((_pending.compare(nameStart, _tag.size(), _tag) != 0) || !IsNameEnd(_pending[nameEnd]))
+            {
+                _scan = open + 1;
+                continue;
+            }
+
+            std::size_t close = _pending.find('>', nameEnd);
+            if (close == std::string::npos)
+            {
+                _scan = open;
+                return std::string::npos;
+            }
+
+            _scan = close + 1;
+
+            if (isEnd)
+            {
+                _depth--;
+                if (_depth == 0)
+                {
+                    return close + 1;
+                }
+            }
+            else if (_pending[close - 1] != '/')
+            {
+                _depth++;
+            }
+        }
+    }
+
+    std::string _pending; //!< Bytes received but not yet returned as an element.
+    std::size_t _head = 0; //!< Offset of the first byte not yet consumed.
+    std::size_t _scan = 0; //!< Offset from which scanning resumes.
+    std::size_t _start = 0; //!< Offset of the '<' of the element currently open.
+    int _depth = 0; //!< Nesting depth of same named elements, 0 while in the start tag.
+    std::string _tag; //!< Name of the element currently open, empty if none.
+};
+
+#endif
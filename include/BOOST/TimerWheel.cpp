@@ -0,0 +1,276 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+/*!
+    \struct HeartbeatOptions
+    \brief When a connection sends heartbeats, and when it gives up on a peer
+           it has not heard from.
+
+    Both are off by default. A peer lost without closing, e.g. behind a NAT
+    that has dropped the mapping, is noticed within timeout plus one tick of
+    the TimerWheel, so timeout must be longer than the peer's interval.
+*/
+struct HeartbeatOptions
+{
+    std::chrono::milliseconds interval{0}; //!< Send a heartbeat once nothing has been sent for this long, 0 to send none.
+    std::chrono::milliseconds timeout{0}; //!< Close the connection once nothing has been received for this long, 0 to wait forever.
+    std::string message = "<Heartbeat/>"; //!< The heartbeat, framed as any message and discarded by receivers.
+
+    /*!
+    \fn Enabled
+    \brief Gets if heartbeats are sent or received.
+    \return bool
+    */
+    bool Enabled() const
+    {
+        return (interval.count() > 0) || (timeout.count() > 0);
+    }
+};
+
+/*!
+    \class TimerWheel
+    \brief Many coarse timers on an io_context, driven by one steady_timer.
+
+    Responsability
+    --------------
+    Timers are kept in hierarchical wheels of 64 slots: the first wheel has
+    a slot per tick, each further wheel a slot per turn of the one below.
+    Scheduling puts a timer in the slot of its expiry, and each tick fires
+    the next slot of the first wheel, moving a slot of a higher wheel down
+    as the wheel below completes a turn. So scheduling and firing are O(1)
+    per timer, whatever the number of timers, where a steady_timer per
+    connection costs O(log n) in the io_context's timer queue each time it
+    is rescheduled.
+
+    There is no cancel: a deadline that moves with activity, e.g. an idle
+    timeout, records the time of the activity, and its callback checks it
+    and schedules itself again for the time left. So activity costs only
+    storing a time, and each connection is visited once per deadline.
+
+    The steady_timer only runs while timers are scheduled. Timers fire up
+    to one tick late, never early.
+
+    Collaboration
+    -------------
+    Used for heartbeats by asyncConnectionTCP, asyncClientTCP, ConnectionTCP
+    and ConnectionClient.
+    \sa HeartbeatOptions()
+*/
+class TimerWheel
+{
+public:
+    typedef std::function<void()> Callback; //!< Called on the io_context when a timer fires.
+
+    static constexpr std::size_t SlotBits = 6; //!< Each wheel has 2^SlotBits slots.
+    static constexpr std::size_t Slots = std::size_t(1) << SlotBits;
+    static constexpr std::size_t Wheels = 4; //!< Spanning 2^24 ticks, e.g. 19 days of 100ms ticks.
+
+    /*!
+    \fn TimerWheel
+    \brief A wheel with no timers.
+    \param io_context runs the callbacks.
+    \param tick the granularity of the timers.
+    \return void
+    */
+    explicit TimerWheel(boost::asio::io_context& io_context, std::chrono::milliseconds tick = std::chrono::milliseconds(100))
+        : _timer(io_context), _tick(tick), _start(std::chrono::steady_clock::now())
+    {
+    }
+
+    /*!
+    \fn Schedule
+    \brief Call a callback once a delay has passed.
+    \param delay rounded up to whole ticks, at least one.
+    \warning Only call on the io_context's thread.
+    \return void
+    */
+    void Schedule(std::chrono::steady_clock::duration delay, Callback callback)
+    {
+        if (_size == 0)
+        {
+            _current = Elapsed(); // Nothing was scheduled, so there is nothing to fire on the way.
+        }
+
+        std::uint64_t ticks = static_cast<std::uint64_t>((delay + _tick - std::chrono::nanoseconds(1)) / _tick);
+        Insert(Entry{_current + std::max<std::uint64_t>(ticks, 1), std::move(callback)});
+        _size++;
+
+        if (!_running)
+        {
+            Arm();
+        }
+    }
+
+    /*!
+    \fn Stop
+    \brief Drop every timer without calling it, and stop the steady_timer,
+           e.g. so the io_context runs out of work.
+    \warning Only call on the io_context's thread.
+    \return void
+    */
+    void Stop()
+    {
+        for (auto& wheel : _wheels)
+        {
+            for (auto& slot : wheel)
+            {
+                slot.clear();
+            }
+        }
+        _size = 0;
+        _epoch++; // Abandons a slot being fired.
+        _running = false;
+        _timer.cancel();
+    }
+
+    /*!
+    \fn Size
+    \brief Gets the number of timers scheduled.
+    \return the count.
+    */
+    std::size_t Size() const
+    {
+        return _size;
+    }
+
+    /*!
+    \fn Tick
+    \brief Gets the granularity of the timers.
+    \return the tick.
+    */
+    std::chrono::milliseconds Tick() const
+    {
+        return _tick;
+    }
+
+private:
+
+    /*!
+        \struct Entry
+        \brief A timer, by the tick it expires on.
+    */
+    struct Entry
+    {
+        std::uint64_t expiry;
+        Callback callback;
+    };
+
+    boost::asio::steady_timer _timer; //!< Wakes at each tick while timers are scheduled.
+    std::chrono::milliseconds _tick;
+    std::chrono::steady_clock::time_point _start; //!< Tick 0.
+    std::uint64_t _current = 0; //!< The last tick fired.
+    std::size_t _size = 0; //!< Timers scheduled.
+    bool _running = false; //!< If the steady_timer is waiting, or its timers being fired.
+    std::uint64_t _epoch = 0; //!< Counts calls to Stop.
+    std::array<std::array<std::vector<Entry>, Slots>, Wheels> _wheels; //!< Timers by wheel and slot.
+    std::vector<Entry> _firing; //!< The slot being fired, swapped in to keep its capacity.
+
+    std::uint64_t Elapsed() const
+    {
+        return static_cast<std::uint64_t>((std::chrono::steady_clock::now() - _start) / _tick);
+    }
+
+    /*!
+    \fn Insert
+    \brief Put a timer in the slot of its expiry, in the lowest wheel spanning it.
+    \return void
+    */
+    void Insert(Entry entry)
+    {
+        std::uint64_t ahead = (entry.expiry > _current) ? (entry.expiry - _current) : 0;
+        std::size_t wheel = 0;
+        while ((wheel < Wheels - 1) && (ahead >= (std::uint64_t(1) << (SlotBits * (wheel + 1)))))
+        {
+            wheel++;
+        }
+        std::uint64_t expiry = std::max(entry.expiry, _current);
+        std::size_t slot = static_cast<std::size_t>((expiry >> (SlotBits * wheel)) & (Slots - 1));
+        _wheels[wheel][slot].push_back(std::move(entry));
+    }
+
+    void Arm()
+    {
+        _running = true;
+        _timer.expires_at(_start + (_current + 1) * _tick);
+        _timer.async_wait([this](const boost::system::error_code& error)
+        {
+            if (error || !_running)
+            {
+                return;
+            }
+
+            std::uint64_t target = Elapsed();
+            while ((_current < target) && (_size > 0))
+            {
+                Advance();
+            }
+
+            if (_size > 0)
+            {
+                Arm();
+            }
+            else
+            {
+                _running = false;
+            }
+        });
+    }
+
+    /*!
+    \fn Advance
+    \brief Move to the next tick, moving down the timers of each wheel whose
+           turn begins, highest first, then firing the slot of the first wheel.
+    \return void
+    */
+    void Advance()
+    {
+        _current++;
+
+        std::size_t turning = 0;
+        while ((turning < Wheels - 1) && ((_current & ((std::uint64_t(1) << (SlotBits * (turning + 1))) - 1)) == 0))
+        {
+            turning++;
+        }
+        for (std::size_t wheel = turning; wheel > 0; wheel--)
+        {
+            std::size_t slot = static_cast<std::size_t>((_current >> (SlotBits * wheel)) & (Slots - 1));
+            _firing.swap(_wheels[wheel][slot]);
+            for (Entry& entry : _firing)
+            {
+                Insert(std::move(entry));
+            }
+            _firing.clear();
+        }
+
+        std::uint64_t epoch = _epoch;
+        _firing.swap(_wheels[0][_current & (Slots - 1)]);
+        for (Entry& entry : _firing)
+        {
+            if (epoch != _epoch) // Stopped by a callback.
+            {
+                break;
+            }
+            _size--;
+            entry.callback(); // May schedule again, into another slot.
+        }
+        _firing.clear();
+    }
+};
+
+#endif
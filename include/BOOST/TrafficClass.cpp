@@ -0,0 +1,261 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TRAFFICCLASS_H
+#define TRAFFICCLASS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+
+/*!
+    \enum TrafficClass
+    \brief The priority of a message to send. Each connection queues each
+           class separately, and always writes Control before Bulk.
+*/
+enum class TrafficClass
+{
+    Control = 0,    //!< Urgent and small, e.g. signal preemption commands.
+    Bulk = 1        //!< Everything else, e.g. detection frames and telemetry.
+};
+
+static constexpr std::size_t TrafficClasses = 2; //!< The number of TrafficClass values.
+
+/*!
+    \struct OutboundMessage
+    \brief A message queued to send, with its class and when it was queued.
+
+    The message is written as a gather of up to three buffers: a prefix kept 
+    in the message, e.g. a length, the payload, and a suffix, e.g. a 
+    delimiter, in storage that outlives every message. So framing never 
+    copies the payload, and a payload shared by several connections is 
+    written by each without a copy.
+*/
+struct OutboundMessage
+{
+    static constexpr std::size_t MaxPrefix = 8; //!< The longest prefix.
+
+    std::string message; //!< The payload, if owned.
+    std::shared_ptr<const std::string> shared; //!< The payload, if shared, e.g. by every connection it is broadcast to; written instead of message.
+    std::array<char, MaxPrefix> prefix{}; //!< Written before the payload.
+    std::size_t prefixSize = 0; //!< The bytes of prefix used.
+    boost::asio::const_buffer suffix; //!< Written after the payload, never freed unless held by sharedSuffix, e.g. an interned delimiter.
+    std::shared_ptr<const std::string> sharedSuffix; //!< Holds the suffix, if it is shared by the connections writing it rather than never freed.
+    TrafficClass traffic = TrafficClass::Bulk; //!< Its priority.
+    std::chrono::steady_clock::time_point queued; //!< When it was queued, to measure its latency.
+
+    /*!
+    \fn Payload
+    \brief Gets the payload, owned or shared.
+    \return the payload.
+    */
+    const std::string& Payload() const
+    {
+        return shared ? *shared : message;
+    }
+
+    /*!
+    \fn Size
+    \brief Gets the bytes written, including the prefix and suffix.
+    \return the size.
+    */
+    std::size_t Size() const
+    {
+        return prefixSize + Payload().size() + suffix.size();
+    }
+
+    /*!
+    \fn Gather
+    \brief Append the buffers to write, referring to the message.
+    \param buffers appended to.
+    \return void
+    */
+    void Gather(std::vector<boost::asio::const_buffer>& buffers) const
+    {
+        if (prefixSize > 0)
+        {
+            buffers.push_back(boost::asio::buffer(prefix.data(), prefixSize));
+        }
+        buffers.push_back(boost::asio::buffer(Payload()));
+        if (suffix.size() > 0)
+        {
+            buffers.push_back(suffix);
+        }
+    }
+
+    /*!
+    \fn Release
+    \brief Drop the payload once written, keeping an owned payload's capacity.
+    \return void
+    */
+    void Release()
+    {
+        message.clear();
+        shared.reset();
+        prefixSize = 0;
+        suffix = boost::asio::const_buffer();
+        sharedSuffix.reset();
+    }
+};
+
+/*!
+    \fn GatherMessage
+    \brief Copy a message given in several buffers, e.g. a header and a body 
+           kept apart, into one payload, the only copy made sending it.
+    \param buffers the parts of the message, in order.
+    \return the payload.
+*/
+inline std::string GatherMessage(const std::vector<boost::asio::const_buffer>& buffers)
+{
+    std::string message;
+    message.reserve(boost::asio::buffer_size(buffers));
+    for (const boost::asio::const_buffer& buffer : buffers)
+    {
+        message.append(static_cast<const char*>(buffer.data()), buffer.size());
+    }
+    return message;
+}
+
+/*!
+    \struct LatencyStatistics
+    \brief How long the messages of one class took from being queued to being
+           written to the socket.
+*/
+struct LatencyStatistics
+{
+    std::uint64_t messages = 0; //!< Messages written.
+    double meanMicroseconds = 0; //!< The mean latency.
+    std::uint64_t maxMicroseconds = 0; //!< The longest latency.
+    std::uint64_t p99Microseconds = 0; //!< 99% of messages took no longer, rounded up to a power of two, or the max.
+    std::uint64_t p999Microseconds = 0; //!< 99.9% of messages took no longer, rounded up to a power of two, or the max.
+};
+
+/*!
+    \class LatencyCounters
+    \brief A histogram of latencies, safe to update and read from any thread.
+
+    Responsability
+    --------------
+    Latencies are counted in buckets of powers of two microseconds, so a
+    percentile is an upper bound, e.g. to show that control messages reach
+    the wire within a bound.
+*/
+class LatencyCounters
+{
+public:
+    static constexpr std::size_t Buckets = 32; //!< Bucket i counts latencies below 2^i microseconds.
+
+    /*!
+    \fn Record
+    \brief Count a message's latency.
+    \return void
+    */
+    void Record(std::chrono::steady_clock::duration latency)
+    {
+        std::uint64_t microseconds = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+
+        std::size_t bucket = 0;
+        while ((bucket < Buckets - 1) && ((std::uint64_t(1) << bucket) <= microseconds))
+        {
+            bucket++;
+        }
+        _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        _messages.fetch_add(1, std::memory_order_relaxed);
+        _totalMicroseconds.fetch_add(microseconds, std::memory_order_relaxed);
+
+        std::uint64_t longest = _maxMicroseconds.load(std::memory_order_relaxed);
+        while ((microseconds > longest) && !_maxMicroseconds.compare_exchange_weak(longest, microseconds, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /*!
+    \fn Snapshot
+    \brief Copy the counters.
+    \return the statistics.
+    */
+    LatencyStatistics Snapshot() const
+    {
+        LatencyStatistics statistics;
+        statistics.messages = _messages;
+        statistics.maxMicroseconds = _maxMicroseconds;
+        if (statistics.messages > 0)
+        {
+            statistics.meanMicroseconds = double(_totalMicroseconds) / statistics.messages;
+        }
+        statistics.p99Microseconds = std::min(Percentile(statistics.messages, 0.99), statistics.maxMicroseconds);
+        statistics.p999Microseconds = std::min(Percentile(statistics.messages, 0.999), statistics.maxMicroseconds);
+        return statistics;
+    }
+
+private:
+    std::array<std::atomic<std::uint64_t>, Buckets> _buckets{}; //!< Messages by latency.
+    std::atomic<std::uint64_t> _messages{0}; //!< Messages counted.
+    std::atomic<std::uint64_t> _totalMicroseconds{0}; //!< Their latencies summed.
+    std::atomic<std::uint64_t> _maxMicroseconds{0}; //!< The longest latency.
+
+    /*!
+    \fn Percentile
+    \brief Gets the upper bound of the bucket holding a fraction of the messages.
+    \return the bound in microseconds.
+    */
+    std::uint64_t Percentile(std::uint64_t messages, double fraction) const
+    {
+        std::uint64_t wanted = static_cast<std::uint64_t>(messages * fraction);
+        std::uint64_t counted = 0;
+        for (std::size_t bucket = 0; bucket < Buckets; bucket++)
+        {
+            counted += _buckets[bucket];
+            if ((counted > wanted) || (counted == messages))
+            {
+                return std::uint64_t(1) << bucket;
+            }
+        }
+        return std::uint64_t(1) << (Buckets - 1);
+    }
+};
+
+/*!
+    \class LaneLatency
+    \brief Latency counters for each TrafficClass, owned by whoever outlives
+           the connections updating them, as BufferCounters are.
+*/
+class LaneLatency
+{
+public:
+
+    /*!
+    \fn Record
+    \brief Count the latency of a message of a class.
+    \return void
+    */
+    void Record(TrafficClass traffic, std::chrono::steady_clock::duration latency)
+    {
+        _lanes[static_cast<std::size_t>(traffic)].Record(latency);
+    }
+
+    /*!
+    \fn Snapshot
+    \brief Copy the counters of a class.
+    \return the statistics.
+    */
+    LatencyStatistics Snapshot(TrafficClass traffic) const
+    {
+        return _lanes[static_cast<std::size_t>(traffic)].Snapshot();
+    }
+
+private:
+    std::array<LatencyCounters, TrafficClasses> _lanes; //!< By TrafficClass.
+};
+
+#endif
@@ -0,0 +1,228 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef XMLDOCUMENTPOOL_H
+#define XMLDOCUMENTPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../rapidxml-1.13/rapidxml.hpp"
+
+#include "Log.cpp"
+
+/*!
+    \struct XmlFrame
+    \brief A complete element and the document parsed in situ from it.
+*/
+struct XmlFrame
+{
+    std::string text; //!< The element. Parsing modifies it in place, so it is no longer the original text.
+    rapidxml::xml_document<> document; //!< Nodes pointing into text.
+
+    /*!
+    \fn Root
+    \brief Gets the element's node.
+    \return the node, or nullptr if nothing was parsed.
+    */
+    rapidxml::xml_node<>* Root()
+    {
+        return document.first_node();
+    }
+};
+
+/*!
+    \class XmlDocumentPool
+    \brief Recycles parsed documents, so each element is parsed without allocating.
+
+    Responsability
+    --------------
+    An xml_document carries a 64 KB memory pool, and the element it parses
+    needs a mutable, nul terminated buffer. Both are kept in an XmlFrame and
+    reused: Parse() swaps the element's text into a free frame, parses it in
+    situ and returns a handle. When the handle is dropped the frame goes back
+    to the pool, keeping the capacity of its text and the document's pool.
+
+    Handles keep the pool alive, so they may outlive whoever created them.
+
+    Collaboration
+    -------------
+    Used by ConnectionClient to parse elements on arrival (SubscribeParsed).
+*/
+class XmlDocumentPool : public std::enable_shared_from_this<XmlDocumentPool>
+{
+public:
+
+    /*!
+        \struct Release
+        \brief Returns a frame to its pool when a handle is dropped.
+    */
+    struct Release
+    {
+        std::shared_ptr<XmlDocumentPool> pool; //!< The frame's pool.
+
+        void operator()(XmlFrame* frame) const
+        {
+            pool->Return(frame);
+        }
+    };
+
+    typedef std::unique_ptr<XmlFrame, Release> Handle; //!< A parsed element, returned to the pool when dropped.
+
+    /*!
+    \fn Create
+    \brief Create a pool.
+    \param maxIdle the most free frames kept, further frames are deleted when returned.
+    \return the pool.
+    */
+    static std::shared_ptr<XmlDocumentPool> Create(std::size_t maxIdle = 64)
+    {
+        return std::shared_ptr<XmlDocumentPool>(new XmlDocumentPool(maxIdle));
+    }
+
+    /*!
+    \fn ~XmlDocumentPool
+    \brief Delete the free frames.
+    \return void
+    */
+    ~XmlDocumentPool()
+    {
+        for (XmlFrame* frame : _idle)
+        {
+            delete frame;
+        }
+    }
+
+    /*!
+    \fn Acquire
+    \brief Gets a free frame, allocating one only if none is free.
+    \return the frame, with its previous document cleared.
+    */
+    Handle Acquire()
+    {
+        XmlFrame* frame = nullptr;
+
+        std::unique_lock<std::mutex> idleGuard(_idleMutex);
+        if (!_idle.empty())
+        {
+            frame = _idle.back();
+            _idle.pop_back();
+        }
+        idleGuard.unlock();
+
+        if (frame == nullptr)
+        {
+            frame = new XmlFrame();
+            _created++;
+        }
+        else
+        {
+            _reused++;
+        }
+
+        frame->document.clear();
+        return Handle(frame, Release{shared_from_this()});
+    }
+
+    /*!
+    \fn Parse
+    \brief Parse an element in situ in a pooled frame.
+    \param text the element. Its contents are swapped with the frame's previous
+           text, so neither is copied; the caller may reuse the string.
+    \return the parsed element, or an empty handle if it is not well formed.
+    */
+    Handle Parse(std::string& text)
+    {
+        Handle frame = Acquire();
+        frame->text.swap(text);
+
+        try
+        {
+            frame->document.parse<rapidxml::parse_default>(&frame->text[0]);
+        }
+        catch (rapidxml::parse_error& e)
+        {
+            LOG_ERROR("XmlDocumentPool::Parse ERROR: " << e.what());
+            return Handle();
+        }
+
+        return frame;
+    }
+
+    /*!
+    \fn Created
+    \brief Gets the number of frames allocated.
+    \return the count.
+    */
+    std::uint64_t Created()
+    {
+        return _created;
+    }
+
+    /*!
+    \fn Reused
+    \brief Gets the number of times a free frame was reused.
+    \return the count.
+    */
+    std::uint64_t Reused()
+    {
+        return _reused;
+    }
+
+private:
+
+    std::vector<XmlFrame*> _idle; //!< Free frames.
+    std::mutex _idleMutex; //!< Mutex for _idle.
+    std::size_t _maxIdle; //!< The most free frames kept.
+
+    std::atomic<std::uint64_t> _created{0}; //!< Frames allocated.
+    std::atomic<std::uint64_t> _reused{0}; //!< Frames reused.
+
+    /*!
+    \fn XmlDocumentPool
+    \brief Use Create, as handles share ownership of the pool.
+    \return void
+    */
+    explicit XmlDocumentPool(std::size_t maxIdle)
+        : _maxIdle(maxIdle)
+    {
+        _idle.reserve(maxIdle);
+    }
+
+    /*!
+    \fn Return
+    \brief Keep a frame for reuse, or delete it if enough are free.
+    \return void
+    */
+    void Return(XmlFrame* frame)
+    {
+        std::unique_lock<std::mutex> idleGuard(_idleMutex);
+        if (_idle.size() < _maxIdle)
+        {
+            _idle.push_back(frame);
+            return;
+        }
+        idleGuard.unlock();
+
+        delete frame;
+    }
+};
+
+typedef XmlDocumentPool::Handle PooledXml; //!< A parsed element, returned to its pool when dropped.
+
+/*!
+    \fn MessageSize
+    \brief Gets the bytes a buffered parsed element counts against BufferLimits::maxBytes.
+    \return the size.
+*/
+inline std::size_t MessageSize(const PooledXml& message) { return (message) ? message->text.size() : 0; }
+
+#endif
@@ -14,79 +14,247 @@
 #ifndef ASYNC_CLIENT_H
 #define ASYNC_CLIENT_H
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <istream>
 #include <ostream>
 #include <string>
+#include <utility>
 #include <list>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <functional>
 
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 
+#include "BufferLimits.cpp"
+#include "EndpointCache.cpp"
+#include "Framing.cpp"
+#include "HandlerAllocator.cpp"
+#include "MessageQueues.cpp"
+#include "ReconnectBackoff.cpp"
+#include "TimerWheel.cpp"
+#include "Log.cpp"
+
 using boost::asio::ip::tcp;
 
-class asyncClientTCP
+/*!
+    \class basic_asyncClientTCP
+    \brief One connection to a server, framing messages with the Framing policy.
+    \sa DelimiterFraming(), LengthPrefixFraming(), XmlElementFraming()
+*/
+template <typename Framing = DelimiterFraming>
+class basic_asyncClientTCP
 {
 private:
 
-    tcp::resolver resolver_;
+    boost::asio::io_context& _io; //!< Runs the client.
+    std::string _server; //!< The host connected to.
+    std::string _port; //!< The port connected to.
     tcp::socket socket_;
     boost::asio::streambuf request_;
     boost::asio::streambuf response_;
 
-    std::string _messageEnd = "\r\n";
+    Framing _framing; //!< Finds each message in response_, read on the io thread.
 
-    std::vector<std::shared_ptr<std::string>> *_messageReadBuffer;
-    std::mutex _mx;
+    typedef std::function<void(const boost::system::error_code&, const std::string&)> Waiter; //!< Completes one asynchronous receive.
+
+public:
+    typedef std::function<void()> ReadyHandler; //!< Told on the io thread each time a message is buffered.
+    typedef std::function<void()> ConnectedHandler; //!< Told on the io thread once connected.
+
+private:
+    ReadyHandler _ready; //!< Told each time a message is buffered, if set.
+    ConnectedHandler _connected; //!< Told once connected, if set.
+
+    ReceiveQueue _inbox; //!< Messages received, handed from the io thread without a lock.
+    std::deque<Waiter> _waiters; //!< Asynchronous receives awaiting a message, only used on the io thread.
+
+    SendQueue _outbox; //!< Messages to send, handed to the io thread without a lock.
+    std::vector<OutboundMessage> _writeBatch; //!< The messages being written, only used on the io thread.
+    std::vector<boost::asio::const_buffer> _writeBuffers; //!< Gathers _writeBatch into one write.
+    std::size_t _writingBytes = 0; //!< The bytes of _writeBatch, only used on the io thread.
+    std::atomic<std::size_t> _queuedBytes{0}; //!< Bytes queued or being written.
+    std::string _messageRead; //!< The message being read, swapped with a recycled string when queued, only used on the io thread.
+
+    HandlerMemory _readMemory; //!< Recycled for each read.
+    HandlerMemory _writeMemory; //!< Recycled for each gathered write.
+    HandlerMemory _postMemory; //!< Recycled for each start of the writer.
+
+    bool _received = false; //!< If a message has been read, only used on the io_service.
+
+    HeartbeatOptions _heartbeat; //!< When heartbeats are sent, and the server given up on.
+    TimerWheel _wheel; //!< Drives the heartbeats, stopped once the connection fails so the io_service runs out of work.
+    std::chrono::steady_clock::time_point _lastRead; //!< When a message was last read, only used on the io_service.
+    std::chrono::steady_clock::time_point _lastWrite; //!< When a write last completed, only used on the io_service.
+    bool _readPaused = false; //!< If reading waits for the consumer, only used on the io_service.
+
+    void start_read()
+    {
+        _readPaused = false;
+        _framing.AsyncRead(socket_, response_, MakeAllocatingHandler(_readMemory,
+            boost::bind(&basic_asyncClientTCP::handle_read, this,
+            boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred)));
+    }
+
+    void resume_read()
+    {
+        boost::asio::post(socket_.get_executor(), boost::bind(&basic_asyncClientTCP::start_read, this));
+    }
+
+    /*!
+    \fn schedule_heartbeat
+    \brief Check the connection again when the next heartbeat or timeout is due.
+    \return void
+    */
+    void schedule_heartbeat()
+    {
+        std::chrono::steady_clock::time_point due = std::chrono::steady_clock::time_point::max();
+        if (_heartbeat.interval.count() > 0)
+        {
+            due = std::min(due, _lastWrite + _heartbeat.interval);
+        }
+        if (_heartbeat.timeout.count() > 0)
+        {
+            due = std::min(due, _lastRead + _heartbeat.timeout);
+        }
+        if (due != std::chrono::steady_clock::time_point::max())
+        {
+            _wheel.Schedule(due - std::chrono::steady_clock::now(), boost::bind(&basic_asyncClientTCP::check_heartbeat, this));
+        }
+    }
+
+    /*!
+    \fn check_heartbeat
+    \brief Close the connection if nothing has been read for the timeout, so 
+           the manager reconnects, or send a heartbeat if nothing has been 
+           written for the interval.
+    \warning Called on the io_service by the TimerWheel.
+    \return void
+    */
+    void check_heartbeat()
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (_readPaused)
+        {
+            _lastRead = now; // Not reading, so the server can not be heard.
+        }
+
+        if ((_heartbeat.timeout.count() > 0) && (now - _lastRead >= _heartbeat.timeout))
+        {
+            LOG_WARNING("asyncClientTCP::check_heartbeat Nothing read for " << _heartbeat.timeout.count() << " ms, closing.");
+            boost::system::error_code ignored;
+            socket_.close(ignored); // Completes the read with an error.
+            return;
+        }
+
+        if ((_heartbeat.interval.count() > 0) && (now - _lastWrite >= _heartbeat.interval))
+        {
+            _lastWrite = now; // Not again until the interval has passed, even if the write is slow.
+            SendMessage(_heartbeat.message, TrafficClass::Control);
+        }
+
+        schedule_heartbeat();
+    }
+
+    /*!
+    \fn Queue
+    \brief Frame a message, leaving its payload untouched, and queue it.
+    \note Safe to call from any thread.
+    \return void
+    */
+    void Queue(OutboundMessage& outbound, TrafficClass traffic)
+    {
+        outbound.traffic = traffic;
+        _framing.Frame(outbound);
 
+        _queuedBytes += outbound.Size();
+
+        bool start;
+        _outbox.Push(outbound, start);
+
+        if (start)
+        {
+            boost::asio::post(_io.get_executor(), MakeAllocatingHandler(_postMemory, boost::bind(&basic_asyncClientTCP::write_next, this)));
+        }
+    }
 
-    void handle_resolve(const boost::system::error_code& err,
-        tcp::resolver::iterator endpoint_iterator)
+    /*!
+    \fn write_next
+    \brief Write the next batch queued to send, control messages first, as one gathered write.
+    \warning Called on the io thread while the writer is started.
+    \return void
+    */
+    void write_next()
+    {
+        if (!_outbox.Take(_writeBatch))
+        {
+            return;
+        }
+
+        _writeBuffers.clear();
+        _writingBytes = 0;
+        for (OutboundMessage& queued : _writeBatch)
+        {
+            queued.Gather(_writeBuffers);
+            _writingBytes += queued.Size();
+        }
+
+        boost::asio::async_write(socket_, BufferSequenceView(_writeBuffers), MakeAllocatingHandler(_writeMemory,
+            boost::bind(&basic_asyncClientTCP::handle_write, this,
+            boost::asio::placeholders::error)));
+    }
+
+
+    void handle_resolve(const boost::system::error_code& err, const EndpointCache::Endpoints& endpoints)
     {
         if (!err)
         {
-            // Attempt a connection to the first endpoint in the list. Each endpoint
-            // will be tried until we successfully establish a connection.
-            tcp::endpoint endpoint = *endpoint_iterator;
-            socket_.async_connect(endpoint,
-                boost::bind(&asyncClientTCP::handle_connect, this,
-                boost::asio::placeholders::error, ++endpoint_iterator));
+            // Attempt a connection to every endpoint, staggered, taking the first to connect.
+            AsyncConnectStaggered(socket_, endpoints, EndpointCache::ConnectionAttemptDelay,
+                boost::bind(&basic_asyncClientTCP::handle_connect, this,
+                boost::asio::placeholders::error));
         }
         else
         {
-            std::cout << "asyncClientTCP::handle_resolve Error: " << err.message() << "\n";            
-            std::this_thread::sleep_for (std::chrono::seconds(5));
+            LOG_WARNING("asyncClientTCP::handle_resolve Error: " << err.message()); // The manager backs off before retrying.
         }
     }
 
-  void handle_connect(const boost::system::error_code& err,
-      tcp::resolver::iterator endpoint_iterator)
+    void handle_connect(const boost::system::error_code& err)
     {
-        std::cout << "asyncClientTCPManager::handle_connect" << std::endl;
+        LOG_DEBUG("asyncClientTCPManager::handle_connect");
 
         if (!err)
         {
-            std::cout << "asyncClientTCPManager::handle_connect Connected." << std::endl;
-                boost::asio::async_read_until(socket_, response_, _messageEnd,
-                    boost::bind(&asyncClientTCP::handle_read, this,
-                    boost::asio::placeholders::error));
+            LOG_INFO("asyncClientTCPManager::handle_connect Connected.");
+            boost::system::error_code ignored;
+            socket_.set_option(tcp::no_delay(true), ignored); // Writes are already batched, so small replies are not held back for an ACK.
+            start_read();
 
-        }
-        else if (endpoint_iterator != tcp::resolver::iterator())
-        {
-            // The connection failed. Try the next endpoint in the list.
-            socket_.close();
-            tcp::endpoint endpoint = *endpoint_iterator;
-            socket_.async_connect(endpoint,
-                boost::bind(&asyncClientTCP::handle_connect, this,
-                boost::asio::placeholders::error, ++endpoint_iterator));
+            if (_heartbeat.Enabled())
+            {
+                _lastRead = _lastWrite = std::chrono::steady_clock::now();
+                schedule_heartbeat();
+            }
+
+            if (_connected)
+            {
+                _connected();
+            }
         }
         else
         {
-            std::cout << "asyncClientTCP::handle_connect Error: " << err.message() << "\n";
+            LOG_WARNING("asyncClientTCP::handle_connect Error: " << err.message());
+            EndpointCache::Shared()->Expire(_server, _port); // The host may have moved.
         }
     }
 
@@ -95,34 +263,69 @@ private:
     {
         if (err)
         {
-            std::cout << "asyncClientTCP::handle_write Error: " << err.message() << "\n";
+            LOG_WARNING("asyncClientTCP::handle_write Error: " << err.message());
         }
+        else
+        {
+            _outbox.Written(_writeBatch);
+            _lastWrite = std::chrono::steady_clock::now();
+        }
+        _queuedBytes -= _writingBytes;
+
+        write_next(); // After an error the remaining writes fail quickly, emptying the queue.
     }
 
-    void handle_read(const boost::system::error_code& err)
+    /*!
+    \fn handle_read
+    \brief Take one message from response_.
+    \param length the bytes of the frame, as given by the framing's read. 
+           Anything read past it stays in response_ for the next read.
+    \return void
+    */
+    void handle_read(const boost::system::error_code& err, std::size_t length)
     {
-        std::cout << "asyncClientTCP::handle_read" << std::endl;
+        LOG_TRACE("asyncClientTCP::handle_read");
         if (!err)
         {
-            std::istream responseStream(&response_);
-            std::string messageRead(std::istreambuf_iterator<char>(responseStream), {});
+            _received = true;
+            _framing.Take(response_, length, _messageRead);
+            _lastRead = std::chrono::steady_clock::now();
 
-            //std::shared_ptr<std::string> messagePtr = 
+            bool reading = true;
+            if (_heartbeat.Enabled() && _framing.Matches(_messageRead, _heartbeat.message))
+            {
+                // Only shows the server is there.
+            }
+            else if (!_waiters.empty())
+            {
+                Waiter waiter = std::move(_waiters.front());
+                _waiters.pop_front();
+                waiter(boost::system::error_code(), _messageRead);
+            }
+            else
+            {
+                reading = _inbox.Push(_messageRead); // Resumed by the consumer taking a message if not.
+                LOG_TRACE("Message received & buffered. Size: " << _inbox.Size());
 
-            //std::unique_lock<std::mutex> pushGuard(_mx);
-            _messageReadBuffer->push_back(std::make_shared<std::string>(messageRead));
-            
-            int bufferSize = _messageReadBuffer->size();
-            //pushGuard.unlock();
-            std::cout << "Message received & buffered. Size: " << bufferSize << std::endl;
+                if (_ready)
+                {
+                    _ready();
+                }
+            }
 
-            boost::asio::async_read_until(socket_, response_, _messageEnd,
-                boost::bind(&asyncClientTCP::handle_read, this,
-                boost::asio::placeholders::error));
+            if (reading)
+            {
+                start_read();
+            }
+            else
+            {
+                _readPaused = true;
+            }
         }
         else
         {
-            std::cout << "asyncClientTCP::handle_read Error: " << err << "\n";
+            LOG_WARNING("asyncClientTCP::handle_read Error: " << err);
+            _wheel.Stop(); // So the io_service runs out of work, and the manager reconnects.
         }
     }
 
@@ -132,204 +335,840 @@ private:
 
 public:
 
-    asyncClientTCP(boost::asio::io_service& io_service,
-        const std::string& server, const std::string& port)
-        : resolver_(io_service),
-        socket_(io_service)
+    basic_asyncClientTCP(boost::asio::io_service& io_service,
+        const std::string& server, const std::string& port,
+        const BufferLimits& limits, BufferCounters& counters, LaneLatency& latency,
+        const Framing& framing = Framing(), ReadyHandler ready = ReadyHandler(), const HeartbeatOptions& heartbeat = HeartbeatOptions(),
+        ConnectedHandler connected = ConnectedHandler())
+        : _io(io_service),
+        _server(server),
+        _port(port),
+        socket_(io_service),
+        _framing(framing),
+        _ready(std::move(ready)),
+        _connected(std::move(connected)),
+        _inbox(limits, counters),
+        _outbox(latency),
+        _heartbeat(heartbeat),
+        _wheel(io_service)
     {
         //std::cout << "Connecting to " << server << ":" << port << " and waiting." << std::endl;
-        tcp::resolver resolver(io_service);
-        tcp::resolver::query query(server, port);
-        resolver_.async_resolve(query,
-            boost::bind(&asyncClientTCP::handle_resolve, this,
-                boost::asio::placeholders::error,
-                boost::asio::placeholders::iterator));
+        EndpointCache::Shared()->AsyncResolve(io_service.get_executor(), server, port,
+            boost::bind(&basic_asyncClientTCP::handle_resolve, this,
+                boost::placeholders::_1, boost::placeholders::_2));
+    }
+
+    ~basic_asyncClientTCP()
+    {
+        for (Waiter& waiter : _waiters) // The io_service has stopped.
+        {
+            waiter(boost::asio::error::operation_aborted, std::string());
+        }
     }
 
-    void SendMessage(std::string message)
+    /*!
+    \fn SendMessage
+    \brief Frame and queue a message to send. 
+    \param message moved into the queue, so never copied if given as an rvalue.
+    \param traffic the message's class; queued Control messages are written before Bulk ones.
+    \note Safe to call from any thread; messages of a class are written in order, 
+          batched into gathered writes on the io thread.
+    \return void
+    */
+    void SendMessage(std::string message, TrafficClass traffic = TrafficClass::Bulk)
     {
         //std::cout << "Message sending: " << message << std::endl;
+        OutboundMessage outbound;
+        outbound.message = std::move(message);
+        Queue(outbound, traffic);
+    }
 
-        // The connection was successful. Send the request.
-        boost::asio::async_write(socket_, boost::asio::buffer(message),
-            boost::bind(&asyncClientTCP::handle_write, this,
-            boost::asio::placeholders::error));
+    /*!
+    \fn SendMessage
+    \brief Frame and queue a message shared with other senders, e.g. by every 
+           stripe it may be sent on, written without copying it. 
+    \param message left unchanged until written, then released.
+    \param traffic the message's class.
+    \return void
+    */
+    void SendMessage(std::shared_ptr<const std::string> message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        OutboundMessage outbound;
+        outbound.shared = std::move(message);
+        Queue(outbound, traffic);
     }
 
-    std::string ReceiveMessage()
+    /*!
+    \fn SendMessage
+    \brief Frame and queue a message given in several buffers, copied once. 
+    \param buffers the parts of the message, in order, only read during the call.
+    \param traffic the message's class.
+    \return void
+    */
+    void SendMessage(const std::vector<boost::asio::const_buffer>& buffers, TrafficClass traffic = TrafficClass::Bulk)
     {
-        std::cout << "asyncClientTCP::ReceiveMessage" << std::endl;
+        SendMessage(GatherMessage(buffers), traffic);
+    }
 
-        std::string receivedMessage = "";
+    std::string ReceiveMessage()
+    {
+        LOG_TRACE("asyncClientTCP::ReceiveMessage");
 
-        while (receivedMessage.length() == 0)
-        {   
-            //std::unique_lock<std::mutex> sizeGuard(_mx);
-            int bufferSize = _messageReadBuffer->size();
-            //sizeGuard.unlock();
+        std::string receivedMessage;
+        bool resume;
+        _inbox.Pop(receivedMessage, resume);
 
-            if (bufferSize == 0)
-            {
-                std::this_thread::sleep_for (std::chrono::milliseconds(50));
-            }
-            else
-            {
-                //std::unique_lock<std::mutex> popGuard(_mx);
-                std::shared_ptr<std::string> receivedMessagePtr = std::move(_messageReadBuffer->front());
-                receivedMessage = *receivedMessagePtr;
-                _messageReadBuffer->pop_back();
-                //popGuard.unlock();
-
-                bufferSize--;
-                std::cout << "Message popped from buffer. Size: " << bufferSize << std::endl;
-            }
+        if (resume)
+        {
+            resume_read();
         }
 
+        LOG_TRACE("Message popped from buffer. Size: " << _inbox.Size());
+
         return receivedMessage;
     };
 
+    /*!
+    \fn TryReceiveMessage
+    \brief Take the oldest buffered message, if any, without waiting. 
+    \param message set to the message. Reusing the same string recycles its 
+           capacity for later messages.
+    \return false if nothing is buffered.
+    */
+    bool TryReceiveMessage(std::string& message)
+    {
+        bool resume;
+        bool taken = _inbox.TryPop(message, resume);
+
+        if (resume)
+        {
+            resume_read();
+        }
+        return taken;
+    }
+
+    /*!
+    \fn async_receive
+    \brief Asynchronously receive the next message. 
+    \param token the completion token, e.g. a callback, boost::asio::use_future 
+           or boost::asio::use_awaitable, with signature 
+           void(boost::system::error_code, std::string).
+    \note Completes on the handler's associated executor, so no thread is held 
+          while waiting. Completes with operation_aborted if the client is destroyed.
+    \return As determined by the completion token.
+    */
+    template <typename CompletionToken>
+    auto async_receive(CompletionToken&& token)
+    {
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, std::string)>(
+            [this](auto handler)
+            {
+                typedef typename std::decay<decltype(handler)>::type Handler;
+
+                auto work = boost::asio::make_work_guard(boost::asio::get_associated_executor(handler));
+                auto shared = std::make_shared<Handler>(std::move(handler));
+
+                Waiter waiter = [shared, work](const boost::system::error_code& error, const std::string& message)
+                {
+                    boost::asio::post(work.get_executor(), [shared, error, message]() { (*shared)(error, message); });
+                };
+
+                boost::asio::post(socket_.get_executor(), [this, waiter]() // Registered on the io thread, so no message can be missed.
+                {
+                    std::string receivedMessage;
+                    bool resume;
+                    if (_inbox.TryPop(receivedMessage, resume))
+                    {
+                        if (resume)
+                        {
+                            start_read();
+                        }
+                        waiter(boost::system::error_code(), receivedMessage);
+                    }
+                    else
+                    {
+                        _waiters.push_back(waiter);
+                    }
+                });
+            },
+            token);
+    }
+
     int BufferSize()
     {   
-        //std::lock_guard<std::mutex> lk(_mx);
-        int bufferSize = _messageReadBuffer->size();
-        return bufferSize;
+        return _inbox.Size();
     };
 
+    /*!
+    \fn QueuedBytes
+    \brief Gets the bytes queued to send, including those being written. 
+    \return the bytes.
+    */
+    std::size_t QueuedBytes() const
+    {
+        return _queuedBytes;
+    }
+
     void ClearBuffer()
     {
-        //std::lock_guard<std::mutex> lk(_mx);
-        _messageReadBuffer->clear();
+        if (_inbox.Clear())
+        {
+            resume_read();
+        }
+    }
+
+    /*!
+    \fn Statistics
+    \brief Gets the buffer limit counters and the data currently buffered. 
+    \return The statistics.
+    */
+    BufferStatistics Statistics()
+    {
+        return _inbox.Statistics();
+    }
+
+    /*!
+    \fn Received
+    \brief Returns if a message was read, i.e. the connection worked. 
+    \warning Only call once the io_service has stopped. 
+    \return bool
+    */
+    bool Received()
+    {
+        return _received;
     }
 };
 
-class asyncClientTCPManager
+typedef basic_asyncClientTCP<> asyncClientTCP; //!< Messages ended by "\r\n".
+
+/*!
+    \class basic_asyncClientTCPManager
+    \brief Keeps one or more basic_asyncClientTCP connected to a server, reconnecting with backoff.
+
+    Responsability
+    --------------
+    With more than one stripe, a connection is kept per stripe, each with its
+    own congestion window, so a bulk upload is not limited to what one
+    stream carries, and a large message only holds back its own stripe.
+    send(message) picks the stripe with the fewest bytes queued; send(key,
+    message) always picks the same stripe for a key, so messages with one
+    key stay in order. Received messages from every stripe are merged:
+    each stripe keeps its own buffer, and is listed once it has a message,
+    so stripes are served in turn as in asyncServerInbox.
+
+    Collaboration
+    -------------
+    Used by asyncRpcClientTCP.
+    \sa asyncClientTCPManager
+*/
+template <typename Framing = DelimiterFraming>
+class basic_asyncClientTCPManager
 {
 private: 
-    asyncClientTCP *_client;  //!< TODO: The current server class.  
-    std::thread _threadStart; //!< Thread container for the Start method
-    
-    bool _healthy = false;  //!< Store if the server is healthy.  
+    typedef std::function<void(const boost::system::error_code&, const std::string&)> Waiter; //!< Completes one asynchronous receive.
+
+    /*!
+        \struct Stripe
+        \brief One connection, reconnected by its own thread.
+    */
+    struct Stripe
+    {
+        basic_asyncClientTCP<Framing> *client = nullptr;  //!< The current client, guarded by mx.
+        boost::asio::io_service* io = nullptr; //!< Runs the current client, stopped to destroy the manager, guarded by mx.
+        std::mutex mx; //!< Held while using client, so it is not destroyed meanwhile.
+        std::thread thread; //!< Runs start for the stripe.
+        std::atomic<bool> healthy{false}; //!< Store if the client is running.
+        bool listed = false; //!< If listed as having messages, guarded by the manager's _mx.
+        ReconnectBackoff backoff; //!< Delays between connection attempts.
+    };
+
+    std::vector<std::unique_ptr<Stripe>> _stripes; //!< The connections, at least one.
     int _port;
     std::string _address;
 
+    BufferLimits _limits; //!< Caps on each client's receive buffer.
+    BufferCounters _counters; //!< What the caps have done, kept across reconnects.
+    LaneLatency _latency; //!< How long messages waited to be written, by class, kept across reconnects.
+    HeartbeatOptions _heartbeat; //!< When each client sends heartbeats, and gives up on the server.
+    std::atomic<std::uint64_t> _connects{0}; //!< Clients created, across stripes.
+    Framing _framing; //!< Copied by each client.
+
+    std::mutex _mx;
+    std::deque<std::size_t> _ready; //!< Stripes with messages, each listed once, guarded by _mx.
+    std::deque<Waiter> _waiters; //!< Asynchronous receives awaiting a message, guarded by _mx.
+    std::condition_variable _messageReady; //!< Signalled when a stripe is listed.
+
+    std::atomic<bool> _stopping{false}; //!< Set when the manager is being destroyed.
+    std::mutex _stopMutex; //!< Pairs with _stopCondition.
+    std::condition_variable _stopCondition; //!< Wakes the stripes waiting to reconnect.
+
+    std::mutex _connectedMutex; //!< Guards _onConnected.
+    std::function<void()> _onConnected; //!< Told each time a stripe connects.
+
+    /*!
+    \fn stripe_connected
+    \brief Tell the connected handler, if any, a stripe has connected.
+    \warning Called on the stripe's io thread.
+    \return void
+    */
+    void stripe_connected()
+    {
+        std::unique_lock<std::mutex> connectedGuard(_connectedMutex);
+        std::function<void()> handler = _onConnected;
+        connectedGuard.unlock();
+
+        if (handler)
+        {
+            handler();
+        }
+    }
+
+    /*!
+    \fn stripe_ready
+    \brief Hand a message a stripe has buffered to an asynchronous receive, or list the stripe.
+    \warning Called on the stripe's io thread, so its client is alive.
+    \return void
+    */
+    void stripe_ready(std::size_t index)
+    {
+        Stripe& stripe = *_stripes[index];
+        std::unique_lock<std::mutex> readyGuard(_mx);
+        if (!_waiters.empty())
+        {
+            std::string message;
+            if (stripe.client->TryReceiveMessage(message))
+            {
+                Waiter waiter = std::move(_waiters.front());
+                _waiters.pop_front();
+                readyGuard.unlock();
+
+                waiter(boost::system::error_code(), message);
+                return;
+            }
+        }
+
+        if (stripe.listed)
+        {
+            return;
+        }
+        stripe.listed = true;
+        _ready.push_back(index);
+        readyGuard.unlock();
+
+        _messageReady.notify_one();
+    }
+
+    /*!
+    \fn try_take
+    \brief Take a message from the first stripe listed, listing it again if it has more.
+    \warning _mx must be held by the guard given.
+    \return false if no stripe listed had a message.
+    */
+    bool try_take(std::unique_lock<std::mutex>& guard, std::string& message)
+    {
+        while (!_ready.empty())
+        {
+            std::size_t index = _ready.front();
+            _ready.pop_front();
+            Stripe& stripe = *_stripes[index];
+
+            std::lock_guard<std::mutex> stripeGuard(stripe.mx);
+            bool taken = (stripe.client != nullptr) && stripe.client->TryReceiveMessage(message);
+            if ((stripe.client != nullptr) && (stripe.client->BufferSize() > 0)) // Checked under _mx, so a message buffered meanwhile is never left unlisted.
+            {
+                _ready.push_back(index);
+            }
+            else
+            {
+                stripe.listed = false;
+            }
+
+            if (taken)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*!
+    \fn stripe_lost
+    \brief Forget a stripe's client before it is destroyed, and abort the 
+           asynchronous receives, as replies sent on it are lost.
+    \return void
+    */
+    void stripe_lost(std::size_t index)
+    {
+        Stripe& stripe = *_stripes[index];
+        {
+            std::lock_guard<std::mutex> stripeGuard(stripe.mx);
+            stripe.client = nullptr;
+            stripe.io = nullptr;
+            stripe.healthy = false;
+        }
+
+        std::unique_lock<std::mutex> lostGuard(_mx);
+        std::deque<Waiter> aborted;
+        aborted.swap(_waiters);
+        lostGuard.unlock();
+
+        for (Waiter& waiter : aborted)
+        {
+            waiter(boost::asio::error::operation_aborted, std::string());
+        }
+    }
+
+    /*!
+    \fn send_to
+    \brief Send a message on a stripe, if it is healthy.
+    \param message an owned or shared payload, moved from only if sent.
+    \return false if the stripe has no client.
+    */
+    template <typename Payload>
+    bool send_to(Stripe& stripe, Payload& message, TrafficClass traffic)
+    {
+        std::lock_guard<std::mutex> stripeGuard(stripe.mx);
+        if (stripe.client == nullptr)
+        {
+            return false;
+        }
+        stripe.client->SendMessage(std::move(message), traffic);
+        return true;
+    }
+
 public: 
     /*!
     \fn asyncServerTCPManager
     \brief A constructor for the connection manager class. 
+    \param limits caps on each receive buffer, unlimited by default.
+    \param backoff the delays between connection attempts.
+    \param framing how messages are framed.
+    \param stripes the connections to keep to the server.
+    \param heartbeat when each connection sends heartbeats, and gives up on 
+           the server to reconnect, off by default.
     \return void
     */
-    asyncClientTCPManager(std::string address, int port)
+    basic_asyncClientTCPManager(std::string address, int port, BufferLimits limits = BufferLimits(), ReconnectBackoff backoff = ReconnectBackoff(),
+        Framing framing = Framing(), std::size_t stripes = 1, HeartbeatOptions heartbeat = HeartbeatOptions())
+        : _heartbeat(heartbeat), _framing(framing)
     {        
-        std::cout << "asyncClientTCPManager::asyncClientTCPManager " << address << ":" << std::to_string(port) << std::endl;
+        LOG_INFO("asyncClientTCPManager::asyncClientTCPManager " << address << ":" << std::to_string(port));
+        _address = address;
         _port = port;
-        _threadStart = std::thread(&asyncClientTCPManager::start, this);
+        _limits = limits;
+
+        for (std::size_t i = 0; i < std::max<std::size_t>(stripes, 1); i++)
+        {
+            _stripes.emplace_back(new Stripe());
+            _stripes.back()->backoff = backoff;
+        }
+        for (std::size_t i = 0; i < _stripes.size(); i++)
+        {
+            _stripes[i]->thread = std::thread(&basic_asyncClientTCPManager::start, this, i);
+        }
         return;
     }
 
     /*!
     \fn ~asyncServerTCPManager
-    \brief Clear up all pointers, lists and objects. 
+    \brief Stop every stripe, closing its connection, and join its thread. 
     \return void
     */
-    ~asyncClientTCPManager()
+    ~basic_asyncClientTCPManager()
     {
-        std::cout << "asyncClientTCPManager::~asyncClientTCPManager" << std::endl;
-        _healthy = false;
+        LOG_INFO("asyncClientTCPManager::~asyncClientTCPManager");
+        {
+            std::lock_guard<std::mutex> stopGuard(_stopMutex);
+            _stopping = true;
+        }
+        _stopCondition.notify_all();
+
+        for (auto& stripe : _stripes)
+        {
+            std::lock_guard<std::mutex> stripeGuard(stripe->mx);
+            stripe->healthy = false;
+            if (stripe->io != nullptr)
+            {
+                stripe->io->stop();
+            }
+        }
+        for (auto& stripe : _stripes)
+        {
+            if (stripe->thread.joinable())
+            {
+                stripe->thread.join();
+            }
+        }
     }
 
     /*!
     \fn Start
-    \brief Starts the server listening.
+    \brief Keeps a stripe connected.
+    \param index the stripe.
     \return void
     */
-    void start()
+    void start(std::size_t index)
     {
-        while(true)
+        Stripe& stripe = *_stripes[index];
+        while(!_stopping)
         {
             try
             {
-                std::cout << "asyncClientTCPManager::start" << std::endl;
+                LOG_DEBUG("asyncClientTCPManager::start");
                 boost::asio::io_service io_service;
-                asyncClientTCP asyncClient(io_service, _address, std::to_string(_port));
-                _healthy = true;
+                basic_asyncClientTCP<Framing> asyncClient(io_service, _address, std::to_string(_port), _limits, _counters, _latency, _framing,
+                    [this, index]() { stripe_ready(index); }, _heartbeat, [this]() { stripe_connected(); });
+                {
+                    std::lock_guard<std::mutex> stripeGuard(stripe.mx);
+                    stripe.client = &asyncClient;
+                    stripe.io = &io_service;
+                    stripe.healthy = true;
+                    _connects++;
+                    if (_stopping)
+                    {
+                        io_service.stop(); // Set under mx, so either seen here or stopped by the destructor.
+                    }
+                }
                 io_service.run(); //blocking
+                stripe_lost(index);
+
+                if (asyncClient.Received())
+                {
+                    stripe.backoff.Reset(); // The connection worked, so retry quickly.
+                }
             }
             catch (std::exception& e)
             {
-                std::cout << "asyncClientTCPManager::start::Exception: " << e.what() << "\n";
+                LOG_WARNING("asyncClientTCPManager::start::Exception: " << e.what());
+                stripe_lost(index);
+            }
+
+            if (_stopping)
+            {
+                break;
             }
 
-            _healthy = false;
-            std::cout << "asyncClientTCPManager::start CLIENT CONNECTION FAILED." << std::endl;
-            std::this_thread::sleep_for (std::chrono::seconds(5)); // nothing to process
+            std::chrono::milliseconds delay = stripe.backoff.Next();
+            LOG_ERROR("asyncClientTCPManager::start CLIENT CONNECTION FAILED. Retrying in " << delay.count() << " ms.");
+            std::unique_lock<std::mutex> stopGuard(_stopMutex);
+            _stopCondition.wait_for(stopGuard, delay, [this] { return _stopping.load(); });
         }
     }
 
+private: 
     /*!
-    \fn SendMessage
-    \brief Send a message to all connected clients. 
-    \param message the text desired to be sent to all connected parties.
+    \fn send_least
+    \brief Send a message on the stripe with the fewest bytes queued.
     \return void
     */
-    void send(std::string message)
+    template <typename Payload>
+    void send_least(Payload& message, TrafficClass traffic)
     {
-        std::cout << "asyncClientTCPManager::send" << std::endl;
-        message = message + "\r\n";
-        if (healthy())
+        LOG_TRACE("asyncClientTCPManager::send");
+
+        Stripe* least = nullptr;
+        std::size_t leastQueued = 0;
+        for (auto& stripe : _stripes)
         {
-            _client->SendMessage(message);
+            std::lock_guard<std::mutex> stripeGuard(stripe->mx);
+            if (stripe->client != nullptr)
+            {
+                std::size_t queued = stripe->client->QueuedBytes();
+                if ((least == nullptr) || (queued < leastQueued))
+                {
+                    least = stripe.get();
+                    leastQueued = queued;
+                }
+            }
         }
-        else
+
+        if ((least == nullptr) || !send_to(*least, message, traffic))
         {
-            std::cout << "asyncClientTCPManager::send:ERROR: Client unhealthy, message not sent." << std::endl;
+            LOG_ERROR("asyncClientTCPManager::send:ERROR: Client unhealthy, message not sent.");
         }
     }
 
+    /*!
+    \fn send_keyed
+    \brief Send a message on the stripe for its key, or the next healthy one.
+    \return void
+    */
+    template <typename Payload>
+    void send_keyed(const std::string& key, Payload& message, TrafficClass traffic)
+    {
+        LOG_TRACE("asyncClientTCPManager::send");
+
+        std::size_t first = std::hash<std::string>()(key) % _stripes.size();
+        for (std::size_t i = 0; i < _stripes.size(); i++)
+        {
+            if (send_to(*_stripes[(first + i) % _stripes.size()], message, traffic))
+            {
+                return;
+            }
+        }
+        LOG_ERROR("asyncClientTCPManager::send:ERROR: Client unhealthy, message not sent.");
+    }
+
+public: 
+    /*!
+    \fn SendMessage
+    \brief Send a message to the server, framed by the client, on the stripe 
+           with the fewest bytes queued. 
+    \param message the text desired to be sent, moved to the client, so never 
+           copied if given as an rvalue; the delimiter is written after it 
+           rather than appended.
+    \param traffic the message's class; Control messages are written ahead of queued Bulk ones.
+    \return void
+    */
+    void send(std::string message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        send_least(message, traffic);
+    }
+
+    /*!
+    \fn send
+    \brief Send a message shared with other senders, never copied. 
+    \param message left unchanged until written.
+    \param traffic the message's class.
+    \return void
+    */
+    void send(std::shared_ptr<const std::string> message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        send_least(message, traffic);
+    }
+
+    /*!
+    \fn send
+    \brief Send a message given in several buffers, copied once. 
+    \param buffers the parts of the message, in order, only read during the call.
+    \param traffic the message's class.
+    \return void
+    */
+    void send(const std::vector<boost::asio::const_buffer>& buffers, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        std::string message = GatherMessage(buffers);
+        send_least(message, traffic);
+    }
+
+    /*!
+    \fn send
+    \brief Send a message on the stripe for its key, so messages with the same 
+           key arrive in order. If that stripe is down the next healthy one is 
+           used, the same for every message with the key while it is down.
+    \param key e.g. the detector the message is from.
+    \param message the text desired to be sent, moved to the client.
+    \param traffic the message's class.
+    \return void
+    */
+    void send(const std::string& key, std::string message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        send_keyed(key, message, traffic);
+    }
+
+    /*!
+    \fn send
+    \brief Send a message shared with other senders on the stripe for its key, never copied. 
+    \return void
+    */
+    void send(const std::string& key, std::shared_ptr<const std::string> message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        send_keyed(key, message, traffic);
+    }
+
+    /*!
+    \fn send
+    \brief Send a message given in several buffers on the stripe for its key, copied once. 
+    \return void
+    */
+    void send(const std::string& key, const std::vector<boost::asio::const_buffer>& buffers, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        std::string message = GatherMessage(buffers);
+        send_keyed(key, message, traffic);
+    }
+
+
     /*!
     \fn receive
-    \brief Receive a message from the client connection. 
+    \brief Receive a message from any stripe, in turn. 
     \warning This is a blocking call. 
     \return the text received.
     */
     std::string receive()
     {
-        std::cout << "asyncClientTCPManager::receive" << std::endl;
-        
-        while (true)
+        LOG_TRACE("asyncClientTCPManager::receive");
+
+        std::string message;
+        std::unique_lock<std::mutex> receiveGuard(_mx);
+        while (!try_take(receiveGuard, message))
         {
-            if (healthy())
-            {
-                return _client->ReceiveMessage();
-            }
-            else
+            _messageReady.wait(receiveGuard, [this] { return !_ready.empty(); });
+        }
+        if (!_ready.empty())
+        {
+            _messageReady.notify_one(); // Another receiver may serve the rest.
+        }
+        return message;
+    }
+
+
+    /*!
+    \fn async_receive
+    \brief Asynchronously receive a message from any stripe. 
+    \param token the completion token, e.g. a callback, boost::asio::use_future 
+           or boost::asio::use_awaitable, with signature 
+           void(boost::system::error_code, std::string).
+    \note Completes with not_connected if no stripe is healthy, and with 
+          operation_aborted if a stripe is lost while waiting. The blocking 
+          receive remains for callers that dedicate a thread.
+    \return As determined by the completion token.
+    */
+    template <typename CompletionToken>
+    auto async_receive(CompletionToken&& token)
+    {
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, std::string)>(
+            [this](auto handler)
             {
-                std::cout << "asyncClientTCPManager::receive Client unhealthy. Waiting." << std::endl;
-                std::this_thread::sleep_for (std::chrono::seconds(5)); // nothing to process
-            }
+                typedef typename std::decay<decltype(handler)>::type Handler;
 
-        }
+                auto work = boost::asio::make_work_guard(boost::asio::get_associated_executor(handler));
+                auto shared = std::make_shared<Handler>(std::move(handler));
 
+                Waiter waiter = [shared, work](const boost::system::error_code& error, const std::string& message)
+                {
+                    boost::asio::post(work.get_executor(), [shared, error, message]() { (*shared)(error, message); });
+                };
 
+                std::unique_lock<std::mutex> receiveGuard(_mx);
+                std::string message;
+                if (try_take(receiveGuard, message))
+                {
+                    receiveGuard.unlock();
+                    waiter(boost::system::error_code(), message);
+                }
+                else if (!healthy())
+                {
+                    receiveGuard.unlock();
+                    waiter(boost::asio::error::not_connected, std::string());
+                }
+                else
+                {
+                    _waiters.push_back(waiter); // Under _mx, so a message buffered meanwhile is handed to it.
+                }
+            },
+            token);
     }
 
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+    /*!
+    \fn receive_awaitable
+    \brief Awaitable form of async_receive, e.g. co_await manager.receive_awaitable(). 
+    \warning Throws boost::system::system_error if the client is unhealthy.
+    \return the text received.
+    */
+    boost::asio::awaitable<std::string> receive_awaitable()
+    {
+        return async_receive(boost::asio::use_awaitable);
+    }
+#endif
 
     /*!
     \fn Healthy
-    \brief Returns if the connection manager is healthy. 
+    \brief Returns if any stripe of the connection manager is healthy. 
     \return bool
     */
     bool healthy()
     {
-        return _healthy;
+        for (auto& stripe : _stripes)
+        {
+            if (stripe->healthy)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*!
+    \fn connects
+    \brief Gets the number of clients created across stripes, so a change 
+           shows a connection has been replaced, and any state kept with the 
+           server must be started again. 
+    \return the count.
+    */
+    std::uint64_t connects() const
+    {
+        return _connects;
+    }
+
+    /*!
+    \fn on_connected
+    \brief Tell a handler each time a stripe connects, e.g. to start again 
+           any state kept with the server. 
+    \param handler called on the stripe's io thread, once connected.
+    \return void
+    */
+    void on_connected(std::function<void()> handler)
+    {
+        std::lock_guard<std::mutex> connectedGuard(_connectedMutex);
+        _onConnected = std::move(handler);
+    }
+
+    /*!
+    \fn stripes
+    \brief Gets the number of connections kept. 
+    \return the count.
+    */
+    std::size_t stripes() const
+    {
+        return _stripes.size();
     }
 
     void clear_buffer()
     {
-        if (healthy())
+        for (auto& stripe : _stripes)
+        {
+            std::lock_guard<std::mutex> stripeGuard(stripe->mx);
+            if (stripe->client != nullptr)
+            {
+                stripe->client->ClearBuffer();
+            }
+        }
+    }
+
+    /*!
+    \fn statistics
+    \brief Gets the receive buffer counters, kept across reconnects, and the 
+           data buffered across stripes. 
+    \return The statistics.
+    */
+    BufferStatistics statistics()
+    {
+        std::size_t bytesHeld = 0;
+        std::size_t messagesHeld = 0;
+        for (auto& stripe : _stripes)
         {
-            _client->ClearBuffer();
+            std::lock_guard<std::mutex> stripeGuard(stripe->mx);
+            if (stripe->client != nullptr)
+            {
+                BufferStatistics held = stripe->client->Statistics();
+                bytesHeld += held.bytesHeld;
+                messagesHeld += held.messagesHeld;
+            }
         }
+        return _counters.Snapshot(bytesHeld, messagesHeld);
+    }
+
+    /*!
+    \fn latency
+    \brief Gets how long the messages of a class waited to be written, kept across reconnects. 
+    \return The statistics.
+    */
+    LatencyStatistics latency(TrafficClass traffic)
+    {
+        return _latency.Snapshot(traffic);
     }
 
 };
+
+typedef basic_asyncClientTCPManager<> asyncClientTCPManager; //!< Messages ended by "\r\n".
 #endif
\ No newline at end of file
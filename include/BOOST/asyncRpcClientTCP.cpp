@@ -0,0 +1,497 @@
+//          Copyright TrafficSignals.ai 2021.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file BOOST_LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef ASYNC_RPC_CLIENT_H
+#define ASYNC_RPC_CLIENT_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include <boost/asio.hpp>
+
+#include "asyncClientTCP.cpp"
+
+/*!
+    \class RpcEnvelope
+    \brief Carries the correlation id of a request, and of its reply, ahead of the message.
+
+    Responsability
+    --------------
+    A request is sent as "@<id> <message>", and the reply to it must start
+    with the same "@<id> ", e.g. built with Reply(). A message without the
+    envelope is unsolicited. The envelope is inside the frame, so it needs a
+    framing that keeps the whole message, i.e. DelimiterFraming or
+    LengthPrefixFraming; XmlElementFraming would discard it.
+
+    Collaboration
+    -------------
+    Used by asyncRpcClientTCP, and by servers answering it.
+*/
+class RpcEnvelope
+{
+public:
+
+    /*!
+    \fn Wrap
+    \brief Put a message in an envelope.
+    \param id the correlation id.
+    \return the message to send.
+    */
+    static std::string Wrap(std::uint64_t id, const std::string& message)
+    {
+        std::string wrapped = "@" + std::to_string(id) + " ";
+        wrapped += message;
+        return wrapped;
+    }
+
+    /*!
+    \fn Unwrap
+    \brief Take a message out of its envelope.
+    \param message the message received, left with what was in the envelope.
+    \param id set to the correlation id.
+    \return false if the message has no envelope, leaving it unchanged.
+    */
+    static bool Unwrap(std::string& message, std::uint64_t& id)
+    {
+        if ((message.size() < 3) || (message[0] != '@'))
+        {
+            return false;
+        }
+
+        std::uint64_t parsed = 0;
+        std::size_t i = 1;
+        for (; (i < message.size()) && (message[i] >= '0') && (message[i] <= '9'); i++)
+        {
+            parsed = (parsed * 10) + (message[i] - '0');
+        }
+        if ((i == 1) || (i == message.size()) || (message[i] != ' '))
+        {
+            return false;
+        }
+
+        id = parsed;
+        message.erase(0, i + 1);
+        return true;
+    }
+
+    /*!
+    \fn Reply
+    \brief Put a reply in the envelope of the request it answers.
+    \param request the request received.
+    \param reply the reply.
+    \return the reply to send, unchanged if the request had no envelope.
+    */
+    static std::string Reply(std::string request, const std::string& reply)
+    {
+        std::uint64_t id;
+        if (!Unwrap(request, id))
+        {
+            return reply;
+        }
+        return Wrap(id, reply);
+    }
+};
+
+/*!
+    \struct RpcStatistics
+    \brief What an asyncRpcClientTCP has done.
+*/
+struct RpcStatistics
+{
+    std::uint64_t calls = 0; //!< Requests sent.
+    std::uint64_t replies = 0; //!< Requests answered in time.
+    std::uint64_t timeouts = 0; //!< Requests not answered in time.
+    std::uint64_t failed = 0; //!< Requests failed as the connection was down, or lost while waiting.
+    std::uint64_t late = 0; //!< Replies arriving after their request timed out, discarded.
+    std::uint64_t unsolicited = 0; //!< Messages received without an envelope.
+    std::size_t inFlight = 0; //!< Requests waiting for their reply.
+};
+
+/*!
+    \class basic_asyncRpcClientTCP
+    \brief Requests and their replies over a basic_asyncClientTCPManager,
+           with many requests in flight on the one connection.
+
+    Responsability
+    --------------
+    Each request is given a correlation id, sent in an RpcEnvelope, and
+    completed by the reply carrying the same id, whatever order replies
+    arrive in, so requests are pipelined rather than each waiting a round
+    trip. A request not answered within its timeout completes with
+    timed_out, and its reply is discarded if it arrives later. If the
+    connection is down, or lost while waiting, requests complete with
+    not_connected or connection_aborted; the manager reconnects.
+
+    Messages without an envelope are unsolicited, passed to the handler
+    given, if any, rather than taken as a reply.
+
+    The client takes every message the manager receives, so the manager
+    must not be received from directly. Requests, replies and timeouts are
+    handled on the client's own thread.
+
+    Collaboration
+    -------------
+    Uses basic_asyncClientTCPManager. The server answers with RpcEnvelope::Reply.
+    \sa RpcEnvelope()
+*/
+template <typename Framing = DelimiterFraming>
+class basic_asyncRpcClientTCP
+{
+public:
+    typedef basic_asyncClientTCPManager<Framing> manager;
+    typedef std::function<void(const std::string&)> Unsolicited; //!< Receives messages without an envelope, on the client's thread.
+
+private:
+    typedef std::function<void(const boost::system::error_code&, const std::string&)> Completion; //!< Completes one request.
+
+    /*!
+        \struct Pending
+        \brief A request waiting for its reply.
+    */
+    struct Pending
+    {
+        Completion complete; //!< Completes the request.
+        std::unique_ptr<boost::asio::steady_timer> timer; //!< Expires at the timeout.
+    };
+
+    /*!
+        \struct State
+        \brief Shared with the handlers receiving from the manager, which may complete after the client is destroyed.
+    */
+    struct State
+    {
+        boost::asio::io_context io; //!< Runs requests, replies and timeouts.
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work{io.get_executor()};
+        boost::asio::steady_timer retry{io}; //!< Waits before receiving again while the manager is unhealthy.
+
+        manager* connection; //!< Sends requests and receives replies.
+        Unsolicited unsolicited; //!< Receives messages without an envelope, if set.
+        std::weak_ptr<State> self; //!< Lets handlers tell if the state still exists.
+        std::unordered_map<std::uint64_t, Pending> pending; //!< Requests by correlation id, only used on the io thread.
+        std::uint64_t next = 0; //!< The last correlation id given.
+        bool stopping = false; //!< Set when the client is destroyed, only used on the io thread.
+
+        std::atomic<std::uint64_t> calls{0};
+        std::atomic<std::uint64_t> replies{0};
+        std::atomic<std::uint64_t> timeouts{0};
+        std::atomic<std::uint64_t> failed{0};
+        std::atomic<std::uint64_t> late{0};
+        std::atomic<std::uint64_t> unsolicitedCount{0};
+        std::atomic<std::size_t> inFlight{0};
+
+        /*!
+        \fn Call
+        \brief Send a request and wait for its reply, on the io thread.
+        \return void
+        */
+        void Call(std::string request, std::chrono::milliseconds timeout, Completion complete)
+        {
+            if (stopping)
+            {
+                complete(boost::asio::error::operation_aborted, std::string());
+                return;
+            }
+            if (!connection->healthy())
+            {
+                failed++;
+                complete(boost::asio::error::not_connected, std::string());
+                return;
+            }
+
+            std::uint64_t id = ++next;
+            Pending& waiting = pending[id];
+            waiting.complete = std::move(complete);
+            waiting.timer.reset(new boost::asio::steady_timer(io, timeout));
+            waiting.timer->async_wait([this, id](const boost::system::error_code& error)
+            {
+                if (!error)
+                {
+                    Expire(id);
+                }
+            });
+            calls++;
+            inFlight++;
+
+            connection->send(RpcEnvelope::Wrap(id, request));
+        }
+
+        /*!
+        \fn Expire
+        \brief Complete a request not answered in time.
+        \return void
+        */
+        void Expire(std::uint64_t id)
+        {
+            auto found = pending.find(id);
+            if (found == pending.end())
+            {
+                return;
+            }
+            Completion complete = std::move(found->second.complete);
+            pending.erase(found);
+            timeouts++;
+            inFlight--;
+            complete(boost::asio::error::timed_out, std::string());
+        }
+
+        /*!
+        \fn FailAll
+        \brief Complete every request waiting, as no reply will come.
+        \return void
+        */
+        void FailAll(const boost::system::error_code& error)
+        {
+            std::unordered_map<std::uint64_t, Pending> lost;
+            lost.swap(pending);
+            for (auto& waiting : lost)
+            {
+                waiting.second.timer->cancel();
+                inFlight--;
+                if (error != boost::asio::error::operation_aborted)
+                {
+                    failed++;
+                }
+                waiting.second.complete(error, std::string());
+            }
+        }
+
+        /*!
+        \fn Received
+        \brief Complete the request a reply is for, or pass on an unsolicited message, on the io thread.
+        \return void
+        */
+        void Received(const boost::system::error_code& error, std::string message)
+        {
+            if (stopping)
+            {
+                return;
+            }
+
+            if (error)
+            {
+                // The client was lost, or there is none, so the requests sent will not be answered.
+                FailAll(boost::asio::error::connection_aborted);
+                retry.expires_after(std::chrono::milliseconds(100)); // Reconnecting may take only milliseconds.
+                retry.async_wait([this](const boost::system::error_code& error)
+                {
+                    if (!error && !stopping)
+                    {
+                        Receive();
+                    }
+                });
+                return;
+            }
+
+            std::uint64_t id;
+            if (!RpcEnvelope::Unwrap(message, id))
+            {
+                unsolicitedCount++;
+                if (unsolicited)
+                {
+                    unsolicited(message);
+                }
+            }
+            else
+            {
+                auto found = pending.find(id);
+                if (found == pending.end())
+                {
+                    late++;
+                }
+                else
+                {
+                    Completion complete = std::move(found->second.complete);
+                    found->second.timer->cancel();
+                    pending.erase(found);
+                    replies++;
+                    inFlight--;
+                    complete(boost::system::error_code(), message);
+                }
+            }
+            Receive();
+        }
+
+        /*!
+        \fn Receive
+        \brief Receive the next message from the manager.
+        \return void
+        */
+        void Receive()
+        {
+            std::weak_ptr<State> weak = self;
+            connection->async_receive([weak](const boost::system::error_code& error, std::string message)
+            {
+                if (std::shared_ptr<State> state = weak.lock())
+                {
+                    boost::asio::post(state->io, [weak, error, message = std::move(message)]() mutable
+                    {
+                        if (std::shared_ptr<State> state = weak.lock())
+                        {
+                            state->Received(error, std::move(message));
+                        }
+                    });
+                }
+            });
+        }
+
+        /*!
+        \fn Stop
+        \brief Abort every request and stop the io thread.
+        \return void
+        */
+        void Stop()
+        {
+            stopping = true;
+            retry.cancel();
+            FailAll(boost::asio::error::operation_aborted);
+            io.stop();
+        }
+    };
+
+    std::shared_ptr<State> _state;
+    std::chrono::milliseconds _timeout; //!< The default timeout of each request.
+    std::thread _thread; //!< Runs _state->io.
+
+public:
+
+    /*!
+    \fn asyncRpcClientTCP
+    \brief Start taking replies from the manager.
+    \param connection the manager, outliving the client.
+    \param timeout the time each request waits for its reply, unless given.
+    \param unsolicited receives messages without an envelope, if set.
+    \return void
+    */
+    basic_asyncRpcClientTCP(manager& connection, std::chrono::milliseconds timeout = std::chrono::seconds(5), Unsolicited unsolicited = Unsolicited())
+        : _state(std::make_shared<State>()), _timeout(timeout)
+    {
+        LOG_INFO("asyncRpcClientTCP::asyncRpcClientTCP");
+        _state->connection = &connection;
+        _state->unsolicited = std::move(unsolicited);
+        _state->self = _state;
+
+        std::shared_ptr<State> state = _state;
+        boost::asio::post(_state->io, [state]() { state->Receive(); });
+        _thread = std::thread([state]() { state->io.run(); });
+    }
+
+    /*!
+    \fn ~asyncRpcClientTCP
+    \brief Complete every request waiting with operation_aborted, and stop the thread.
+    \return void
+    */
+    ~basic_asyncRpcClientTCP()
+    {
+        LOG_INFO("asyncRpcClientTCP::~asyncRpcClientTCP");
+        std::shared_ptr<State> state = _state;
+        boost::asio::post(_state->io, [state]() { state->Stop(); });
+        _thread.join();
+    }
+
+    /*!
+    \fn async_call
+    \brief Send a request and asynchronously receive its reply, with the default timeout.
+    \param token the completion token, e.g. a callback, boost::asio::use_future
+           or boost::asio::use_awaitable, with signature
+           void(boost::system::error_code, std::string).
+    \return As determined by the completion token.
+    */
+    template <typename CompletionToken>
+    auto async_call(std::string request, CompletionToken&& token)
+    {
+        return async_call(std::move(request), _timeout, std::forward<CompletionToken>(token));
+    }
+
+    /*!
+    \fn async_call
+    \brief Send a request and asynchronously receive its reply.
+    \param request the message, without the envelope.
+    \param timeout the time to wait for the reply.
+    \param token the completion token, with signature void(boost::system::error_code, std::string).
+    \note Completes on the handler's associated executor with the reply, without
+          the envelope, or with timed_out, not_connected, connection_aborted or
+          operation_aborted.
+    \return As determined by the completion token.
+    */
+    template <typename CompletionToken>
+    auto async_call(std::string request, std::chrono::milliseconds timeout, CompletionToken&& token)
+    {
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, std::string)>(
+            [this](auto handler, std::string request, std::chrono::milliseconds timeout)
+            {
+                typedef typename std::decay<decltype(handler)>::type Handler;
+
+                auto work = boost::asio::make_work_guard(boost::asio::get_associated_executor(handler));
+                auto shared = std::make_shared<Handler>(std::move(handler));
+
+                Completion complete = [shared, work](const boost::system::error_code& error, const std::string& reply)
+                {
+                    boost::asio::post(work.get_executor(), [shared, error, reply]() { (*shared)(error, reply); });
+                };
+
+                std::shared_ptr<State> state = _state;
+                boost::asio::post(state->io, [state, request = std::move(request), timeout, complete]() mutable
+                {
+                    state->Call(std::move(request), timeout, std::move(complete));
+                });
+            },
+            token, std::move(request), timeout);
+    }
+
+    /*!
+    \fn call
+    \brief Send a request and receive its reply.
+    \warning This is a blocking call. Throws boost::system::system_error if the request fails.
+    \return the reply.
+    */
+    std::string call(std::string request)
+    {
+        return async_call(std::move(request), boost::asio::use_future).get();
+    }
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+    /*!
+    \fn call_awaitable
+    \brief Awaitable form of async_call, e.g. co_await rpc.call_awaitable(request).
+    \warning Throws boost::system::system_error if the request fails.
+    \return the reply.
+    */
+    boost::asio::awaitable<std::string> call_awaitable(std::string request)
+    {
+        return async_call(std::move(request), boost::asio::use_awaitable);
+    }
+#endif
+
+    /*!
+    \fn statistics
+    \brief Gets the counts of requests and replies.
+    \return The statistics.
+    */
+    RpcStatistics statistics()
+    {
+        RpcStatistics statistics;
+        statistics.calls = _state->calls;
+        statistics.replies = _state->replies;
+        statistics.timeouts = _state->timeouts;
+        statistics.failed = _state->failed;
+        statistics.late = _state->late;
+        statistics.unsolicited = _state->unsolicitedCount;
+        statistics.inFlight = _state->inFlight;
+        return statistics;
+    }
+};
+
+typedef basic_asyncRpcClientTCP<> asyncRpcClientTCP; //!< Messages ended by "\r\n".
+
+#endif
@@ -17,186 +17,736 @@
 #include <string>
 #include <boost/bind/bind.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/enable_shared_from_this.hpp>
+#include <boost/intrusive_ptr.hpp>
 #include <boost/asio.hpp>
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BufferLimits.cpp"
+#include "Framing.cpp"
+#include "HandlerAllocator.cpp"
+#include "SlabPool.cpp"
+#include "MessageQueues.cpp"
+#include "SlotMap.cpp"
+#include "TimerWheel.cpp"
+#include "Log.cpp"
 
 using boost::asio::ip::tcp;
 
-class asyncConnectionTCP : public boost::enable_shared_from_this<asyncConnectionTCP>
+/*!
+    \class basic_asyncConnectionTCP
+    \brief A server's connection to one client, framing messages with the Framing policy.
+
+    Reference counted intrusively, so a server can recycle connections 
+    through a SlabPool (create_pool).
+
+    With heartbeats, a heartbeat is sent once nothing has been written for 
+    the interval, heartbeats received are discarded, and the connection is 
+    closed once nothing has been read for the timeout, unless reading is 
+    paused by its buffer.
+    \sa DelimiterFraming(), LengthPrefixFraming(), XmlElementFraming()
+*/
+template <typename Framing = DelimiterFraming>
+class basic_asyncConnectionTCP : public Pooled<basic_asyncConnectionTCP<Framing>>
 {
 public:
-    typedef boost::shared_ptr<asyncConnectionTCP> pointer;
+    typedef boost::intrusive_ptr<basic_asyncConnectionTCP> pointer;
+    typedef SlabPool<basic_asyncConnectionTCP> pool; //!< Recycles connections.
+    typedef std::function<void(const pointer&)> ready_handler; //!< Told each time a message is buffered.
+    typedef std::function<void(const pointer&)> closed_handler; //!< Told once reading fails, i.e. the client has gone.
+
+    /*!
+    \fn create
+    \brief Create a connection.
+    \param latency updated with the latency of each message written, by class.
+    \param ready called on the io thread each time a message is buffered.
+    \param closed called on the io thread once reading fails.
+    \param framing how messages are framed.
+    \return pointer
+    */
+    static pointer create(boost::asio::io_context& io_context, const BufferLimits& limits, BufferCounters& counters, LaneLatency& latency,
+        ready_handler ready = ready_handler(), closed_handler closed = closed_handler(), const Framing& framing = Framing())
+    {
+        LOG_DEBUG("asyncConnectionTCP::create");
+        return pointer(new basic_asyncConnectionTCP(io_context, limits, counters, latency, ready, closed, framing));
+
+    }
+
+    /*!
+    \fn create_pool
+    \brief Create a pool of connections, each made as by create.
+    \param slabSize the connections allocated together.
+    \return the pool.
+    */
+    static std::shared_ptr<pool> create_pool(boost::asio::io_context& io_context, const BufferLimits& limits, BufferCounters& counters, LaneLatency& latency,
+        ready_handler ready = ready_handler(), closed_handler closed = closed_handler(), const Framing& framing = Framing(), std::size_t slabSize = 32)
+    {
+        LOG_DEBUG("asyncConnectionTCP::create_pool");
+        BufferCounters* countersPointer = &counters;
+        LaneLatency* latencyPointer = &latency;
+        return pool::Create([&io_context, limits, countersPointer, latencyPointer, ready, closed, framing](void* where)
+        {
+            return new (where) basic_asyncConnectionTCP(io_context, limits, *countersPointer, *latencyPointer, ready, closed, framing);
+        }, slabSize);
+    }
 
-    static pointer create(boost::asio::io_context& io_context)
+    /*!
+    \fn recycle
+    \brief Return to the state after construction, once no longer referenced, 
+           so a pool can reuse the connection.
+    \return void
+    */
+    void recycle()
     {
-        std::cout << "asyncConnectionTCP::create" << std::endl;
-        return pointer(new asyncConnectionTCP(io_context));
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        request_.consume(request_.size());
+        response_.consume(response_.size());
+        _framing.Reset();
+        _inbox.Reset();
+        _outbox.Reset();
+        _writeBatch.clear();
+        _writeBuffers.clear();
+        _id = 0;
+        _listed = false;
+        _wheel = nullptr;
+        _heartbeat = nullptr;
+    }
 
+    /*!
+    \fn id
+    \brief Gets the identity given by the server.
+    \return the id, 0 until registered.
+    */
+    std::uint64_t id() const
+    {
+        return _id;
+    }
+
+    /*!
+    \fn registered
+    \brief Set the identity given by the server, before start.
+    \param id the id.
+    \return void
+    */
+    void registered(std::uint64_t id)
+    {
+        _id = id;
+    }
+
+    /*!
+    \fn has_messages
+    \brief Returns if a message is buffered.
+    \return bool
+    */
+    bool has_messages() const
+    {
+        return _inbox.Size() > 0;
     }
 
     tcp::socket& socket()
     {
-        std::cout << "asyncConnectionTCP::socket" << std::endl;
+        LOG_TRACE("asyncConnectionTCP::socket");
         return socket_;
     }
 
-    void start()
+    /*!
+    \fn start_heartbeat
+    \brief Send heartbeats, and close the connection once nothing is read for the timeout.
+    \param wheel drives the checks, on the io thread, outliving the connection.
+    \param heartbeat the options, outliving the connection.
+    \warning Call on the io thread, once started.
+    \return void
+    */
+    void start_heartbeat(TimerWheel& wheel, const HeartbeatOptions& heartbeat)
     {
-        std::cout << "asyncConnectionTCP::start" << std::endl;
-        boost::asio::async_read_until(socket_, response_, _messageEnd,
-            boost::bind(&asyncConnectionTCP::handle_read, this,
-            boost::asio::placeholders::error));
+        _wheel = &wheel;
+        _heartbeat = &heartbeat;
+        _lastRead = _lastWrite = std::chrono::steady_clock::now();
+        schedule_heartbeat();
     }
 
-    void send_message_async(std::string message)
+    void start()
     {
-        std::cout << "asyncConnectionTCP::send_message_async: " << message << std::endl;
-        boost::asio::async_write(socket_, boost::asio::buffer(message),
-            boost::bind(&asyncConnectionTCP::handle_write, shared_from_this(),
+        LOG_DEBUG("asyncConnectionTCP::start");
+        boost::system::error_code ignored;
+        socket_.set_option(tcp::no_delay(true), ignored); // Writes are already batched, so small replies are not held back for an ACK.
+        _framing.AsyncRead(socket_, response_, MakeAllocatingHandler(_readMemory,
+            boost::bind(&basic_asyncConnectionTCP::handle_read, pointer(this),
             boost::asio::placeholders::error,
-            boost::asio::placeholders::bytes_transferred));
+            boost::asio::placeholders::bytes_transferred)));
+    }
+
+    /*!
+    \fn send_message_async
+    \brief Frame and queue a message to send. 
+    \param message moved into the queue, so never copied if given as an rvalue.
+    \param traffic the message's class; queued Control messages are written before Bulk ones.
+    \note Safe to call from any thread; messages of a class are written in order, 
+          batched into gathered writes on the io thread.
+    \return void
+    */
+    void send_message_async(std::string message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        LOG_TRACE("asyncConnectionTCP::send_message_async: " << message);
+        OutboundMessage outbound;
+        outbound.message = std::move(message);
+        queue(outbound, traffic);
+    }
+
+    /*!
+    \fn send_message_async
+    \brief Frame and queue a message shared with other connections, e.g. one 
+           broadcast to all, written without copying it. 
+    \param message left unchanged until written by every connection, then released.
+    \param traffic the message's class.
+    \return void
+    */
+    void send_message_async(std::shared_ptr<const std::string> message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        LOG_TRACE("asyncConnectionTCP::send_message_async: " << *message);
+        OutboundMessage outbound;
+        outbound.shared = std::move(message);
+        queue(outbound, traffic);
     }
 
     int buffer_size()
     {   
-        std::cout << "asyncConnectionTCP::buffer_size" << std::endl;
-        std::unique_lock<std::mutex> sizeGuard(_messageReadBufferMutex);
-        int bufferSize = _messageReadBuffer.size();
-        sizeGuard.unlock();
-        return bufferSize;
+        LOG_TRACE("asyncConnectionTCP::buffer_size");
+        return _inbox.Size();
     };
 
     void clear_buffer()
     {
-        std::cout << "asyncConnectionTCP::clear_buffer" << std::endl;
-        std::unique_lock<std::mutex> clearGuard(_messageReadBufferMutex);
-        _messageReadBuffer.clear();
-        clearGuard.unlock();
+        LOG_TRACE("asyncConnectionTCP::clear_buffer");
+        if (_inbox.Clear())
+        {
+            resume_read();
+        }
+    }
 
+    /*!
+    \fn buffered
+    \brief Gets the data currently buffered by this connection. 
+    \param bytes set to the bytes held.
+    \param messages set to the messages held.
+    \return void
+    */
+    void buffered(std::size_t& bytes, std::size_t& messages)
+    {
+        _inbox.Buffered(bytes, messages);
     }
 
-    std::string receive_message()
+    /*!
+    \fn try_receive_message
+    \brief Take the oldest buffered message, if any, without waiting. 
+    \param message set to the message.
+    \return false if nothing is buffered.
+    */
+    bool try_receive_message(std::string& message)
     {
-        std::cout << "asyncConnectionTCP::receive_message" << std::endl;
-        std::string receivedMessage = "";
+        bool resume;
+        bool taken = _inbox.TryPop(message, resume);
 
-        while (receivedMessage.length() == 0)
+        if (resume)
         {
-            std::unique_lock<std::mutex> sizeGuard(_messageReadBufferMutex);
-            int bufferSize = _messageReadBuffer.size();
-            sizeGuard.unlock();
+            resume_read();
+        }
+        return taken;
+    }
 
-            if (bufferSize == 0)
-            {
-                std::this_thread::sleep_for (std::chrono::milliseconds(50));
-            }
-            else
-            {
-                std::unique_lock<std::mutex> popGuard(_messageReadBufferMutex);
-                receivedMessage = _messageReadBuffer.front();
-                _messageReadBuffer.pop_front();
-                popGuard.unlock();
+    std::string receive_message()
+    {
+        LOG_TRACE("asyncConnectionTCP::receive_message");
+        std::string receivedMessage = "";
 
-                bufferSize--;
-                std::cout << "Message popped from buffer. Size: " << bufferSize << std::endl;
-            }
+        bool resume;
+        _inbox.Pop(receivedMessage, resume);
+
+        if (resume)
+        {
+            resume_read();
         }
 
+        LOG_TRACE("Message popped from buffer. Size: " << _inbox.Size());
+
         return receivedMessage;
     };
 
 
 private:
-    asyncConnectionTCP(boost::asio::io_context& io_context) : socket_(io_context)
+    basic_asyncConnectionTCP(boost::asio::io_context& io_context, const BufferLimits& limits, BufferCounters& counters, LaneLatency& latency,
+        ready_handler ready, closed_handler closed, const Framing& framing) 
+        : _io(io_context), socket_(io_context), _framing(framing), _inbox(limits, counters), _ready(ready), _closed(closed), _outbox(latency)
     {
-        std::cout << "asyncConnectionTCP::asyncConnectionTCP" << std::endl;
+        LOG_DEBUG("asyncConnectionTCP::asyncConnectionTCP");
+
+    }
 
+    /*!
+    \fn resume_read
+    \brief Restart reading after a pause. 
+    \warning Only call when ReceiveQueue says reading must be resumed.
+    \return void
+    */
+    void resume_read()
+    {
+        boost::asio::post(socket_.get_executor(), [this]()
+        {
+            pointer self = std::move(_pausedSelf);
+            self->start();
+        });
     }
 
-    void handle_write(const boost::system::error_code& /*error*/, size_t /*bytes_transferred*/)
+    /*!
+    \fn schedule_heartbeat
+    \brief Check the connection again when the next heartbeat or timeout is due.
+    \return void
+    */
+    void schedule_heartbeat()
     {
-        std::cout << "asyncConnectionTCP::handle_write" << std::endl;
+        std::chrono::steady_clock::time_point due = std::chrono::steady_clock::time_point::max();
+        if (_heartbeat->interval.count() > 0)
+        {
+            due = std::min(due, _lastWrite + _heartbeat->interval);
+        }
+        if (_heartbeat->timeout.count() > 0)
+        {
+            due = std::min(due, _lastRead + _heartbeat->timeout);
+        }
+        if (due == std::chrono::steady_clock::time_point::max())
+        {
+            return;
+        }
+
+        pointer self(this);
+        _wheel->Schedule(due - std::chrono::steady_clock::now(), [self]() { self->check_heartbeat(); });
     }
 
-    void handle_read(const boost::system::error_code& err)
+    /*!
+    \fn check_heartbeat
+    \brief Close the connection if nothing has been read for the timeout, 
+           or send a heartbeat if nothing has been written for the interval.
+    \warning Called on the io thread by the TimerWheel.
+    \return void
+    */
+    void check_heartbeat()
     {
-        std::cout << "asyncConnectionTCP::handle_read" << std::endl;
+        if ((_heartbeat == nullptr) || !socket_.is_open())
+        {
+            return; // Closed, so the check ends.
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (_pausedSelf)
+        {
+            _lastRead = now; // Not reading, so the client can not be heard.
+        }
+
+        if ((_heartbeat->timeout.count() > 0) && (now - _lastRead >= _heartbeat->timeout))
+        {
+            LOG_WARNING("asyncConnectionTCP::check_heartbeat Nothing read for " << _heartbeat->timeout.count() << " ms, closing.");
+            boost::system::error_code ignored;
+            socket_.shutdown(tcp::socket::shutdown_both, ignored);
+            socket_.close(ignored); // Completes the read with an error, telling the server.
+            return;
+        }
+
+        if ((_heartbeat->interval.count() > 0) && (now - _lastWrite >= _heartbeat->interval))
+        {
+            _lastWrite = now; // Not again until the interval has passed, even if the write is slow.
+            send_message_async(_heartbeat->message, TrafficClass::Control);
+        }
+
+        schedule_heartbeat();
+    }
+
+    /*!
+    \fn queue
+    \brief Frame a message, leaving its payload untouched, and queue it.
+    \note Safe to call from any thread.
+    \return void
+    */
+    void queue(OutboundMessage& outbound, TrafficClass traffic)
+    {
+        outbound.traffic = traffic;
+        _framing.Frame(outbound);
+
+        bool start;
+        _outbox.Push(outbound, start);
+
+        if (start)
+        {
+            boost::asio::post(_io.get_executor(), MakeAllocatingHandler(_postMemory, boost::bind(&basic_asyncConnectionTCP::write_next, pointer(this))));
+        }
+    }
+
+    /*!
+    \fn write_next
+    \brief Write the next batch queued to send, control messages first, as one gathered write.
+    \warning Called on the io thread while the writer is started.
+    \return void
+    */
+    void write_next()
+    {
+        if (!_outbox.Take(_writeBatch))
+        {
+            return;
+        }
+
+        _writeBuffers.clear();
+        for (OutboundMessage& queued : _writeBatch)
+        {
+            queued.Gather(_writeBuffers);
+        }
+
+        boost::asio::async_write(socket_, BufferSequenceView(_writeBuffers), MakeAllocatingHandler(_writeMemory,
+            boost::bind(&basic_asyncConnectionTCP::handle_write, pointer(this),
+            boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred)));
+    }
+
+    void handle_write(const boost::system::error_code& error, size_t /*bytes_transferred*/)
+    {
+        LOG_TRACE("asyncConnectionTCP::handle_write");
+        if (!error)
+        {
+            _outbox.Written(_writeBatch);
+            _lastWrite = std::chrono::steady_clock::now();
+        }
+        write_next(); // After an error the remaining writes fail quickly, emptying the queue.
+    }
+
+    /*!
+    \fn handle_read
+    \brief Take one message from response_.
+    \param length the bytes of the frame, as given by the framing's read. 
+           Anything read past it stays in response_ for the next read.
+    \return void
+    */
+    void handle_read(const boost::system::error_code& err, std::size_t length)
+    {
+        LOG_TRACE("asyncConnectionTCP::handle_read");
         if (!err)
         {
-            std::istream responseStream(&response_);
-            std::string messageRead(std::istreambuf_iterator<char>(responseStream), {});
-
-            std::unique_lock<std::mutex> pushGuard(_messageReadBufferMutex);
-            _messageReadBuffer.push_back(messageRead);
-            int bufferSize = _messageReadBuffer.size();
-            pushGuard.unlock();
-            std::cout << "Message received & buffered. Size: " << bufferSize << std::endl;
-
-            boost::asio::async_read_until(socket_, response_, _messageEnd,
-                boost::bind(&asyncConnectionTCP::handle_read, this,
-                boost::asio::placeholders::error));
+            _framing.Take(response_, length, _messageRead);
+            _lastRead = std::chrono::steady_clock::now();
+
+            if ((_heartbeat == nullptr) || !_framing.Matches(_messageRead, _heartbeat->message))
+            {
+                if (!_inbox.Push(_messageRead))
+                {
+                    _pausedSelf = pointer(this); // No read is pending to keep the connection alive.
+                }
+                LOG_TRACE("Message received & buffered. Size: " << _inbox.Size());
+
+                if (_ready)
+                {
+                    _ready(pointer(this));
+                }
+            }
+
+            if (!_pausedSelf)
+            {
+                _framing.AsyncRead(socket_, response_, MakeAllocatingHandler(_readMemory,
+                    boost::bind(&basic_asyncConnectionTCP::handle_read, pointer(this),
+                    boost::asio::placeholders::error,
+                    boost::asio::placeholders::bytes_transferred)));
+            }
         }
         else
         {
-            std::cout << "asyncConnectionTCP::handle_read Error: " << err << "\n";
+            LOG_WARNING("asyncConnectionTCP::handle_read Error: " << err);
+
+            if (_closed)
+            {
+                _closed(pointer(this));
+            }
         }
     }
+    boost::asio::io_context& _io; //!< Runs the connection.
     boost::asio::streambuf request_;
     boost::asio::streambuf response_;
     tcp::socket socket_;
-    std::string _messageEnd = "\r\n";
+    Framing _framing; //!< Finds each message in response_, read on the io thread.
+
+    ReceiveQueue _inbox; //!< Messages received, handed from the io thread without a lock.
+    pointer _pausedSelf; //!< Keeps the connection alive while reading is paused, only used on the io thread.
+    std::uint64_t _id = 0; //!< Identifies the connection to receivers.
+    ready_handler _ready; //!< Told each time a message is buffered.
+    closed_handler _closed; //!< Told once reading fails.
+    bool _listed = false; //!< If listed as ready by an asyncServerInbox, guarded by it.
+    template <typename> friend class basic_asyncServerInbox;
+
+    SendQueue _outbox; //!< Messages to send, handed to the io thread without a lock.
+    std::vector<OutboundMessage> _writeBatch; //!< The messages being written, only used on the io thread.
+    std::vector<boost::asio::const_buffer> _writeBuffers; //!< Gathers _writeBatch into one write.
+    std::string _messageRead; //!< The message being read, swapped with a recycled string when queued, only used on the io thread.
+
+    HandlerMemory _readMemory; //!< Recycled for each read.
+    HandlerMemory _writeMemory; //!< Recycled for each gathered write.
+    HandlerMemory _postMemory; //!< Recycled for each start of the writer.
+
+    TimerWheel* _wheel = nullptr; //!< Drives heartbeats, if started.
+    const HeartbeatOptions* _heartbeat = nullptr; //!< The server's options, if heartbeats are started.
+    std::chrono::steady_clock::time_point _lastRead; //!< When a message was last read, only used on the io thread.
+    std::chrono::steady_clock::time_point _lastWrite; //!< When a write last completed, only used on the io thread.
+};
+
+typedef basic_asyncConnectionTCP<> asyncConnectionTCP; //!< Messages ended by "\r\n".
+
+
+
 
-    std::list<std::string> _messageReadBuffer;
-    std::mutex _messageReadBufferMutex;         //!< Mutex for the buffer
+/*!
+    \class basic_asyncServerInbox
+    \brief The connections of a server with messages waiting, in turn.
+
+    Responsability
+    --------------
+    Each connection keeps its own buffer, and its own limits. When it buffers
+    a message it is listed here, once, and a waiting receiver is woken at
+    once. A receiver takes one message from the first connection listed and,
+    if it has more, lists it again at the back, so connections are served
+    round-robin and a busy connection can not starve a quiet one. Listed
+    connections are held until drained, so a message received just before a
+    disconnect is still delivered.
+
+    Collaboration
+    -------------
+    Shared by asyncServerTCP and the ready handlers of its connections.
+*/
+template <typename Framing>
+class basic_asyncServerInbox
+{
+public:
+    typedef typename basic_asyncConnectionTCP<Framing>::pointer connection_pointer;
+
+    /*!
+    \fn ready
+    \brief List a connection that has buffered a message, if it is not listed.
+    \param connection the connection.
+    \return void
+    */
+    void ready(const connection_pointer& connection)
+    {
+        std::unique_lock<std::mutex> readyGuard(_mx);
+        if (connection->_listed)
+        {
+            return;
+        }
+        connection->_listed = true;
+        _ready.push_back(connection);
+        readyGuard.unlock();
+
+        _messageReady.notify_one();
+    }
+
+    /*!
+    \fn receive
+    \brief Take the next message, round-robin across connections.
+    \param message set to the message.
+    \param from set to the id of the connection it was received from.
+    \param cancelled if given and set, return without taking a message, once 
+           woken by wake.
+    \warning Blocks until a message is available.
+    \return false if the inbox was stopped or the receive cancelled.
+    */
+    bool receive(std::string& message, std::uint64_t& from, const std::atomic<bool>* cancelled = nullptr)
+    {
+        std::unique_lock<std::mutex> receiveGuard(_mx);
+        while (true)
+        {
+            _messageReady.wait(receiveGuard, [this, cancelled] { return !_ready.empty() || _stopping || ((cancelled != nullptr) && cancelled->load()); });
+            if (_ready.empty() || ((cancelled != nullptr) && cancelled->load()))
+            {
+                return false;
+            }
+
+            connection_pointer connection = std::move(_ready.front());
+            _ready.pop_front();
+            receiveGuard.unlock();
+
+            bool taken = connection->try_receive_message(message);
+
+            receiveGuard.lock();
+            if (connection->has_messages()) // Checked under the lock, so a message buffered meanwhile is never left unlisted.
+            {
+                _ready.push_back(connection);
+                if (taken)
+                {
+                    _messageReady.notify_one(); // Another receiver may serve it.
+                }
+            }
+            else
+            {
+                connection->_listed = false;
+            }
+
+            if (taken)
+            {
+                from = connection->id();
+                return true;
+            }
+        }
+    }
+
+    /*!
+    \fn stop
+    \brief Wake every waiting receiver, which return once nothing is listed.
+    \return void
+    */
+    void stop()
+    {
+        std::lock_guard<std::mutex> stopGuard(_mx);
+        _stopping = true;
+        _messageReady.notify_all();
+    }
+
+    /*!
+    \fn wake
+    \brief Wake every waiting receiver, so those whose receive is cancelled return.
+    \warning Set the cancelled flag first.
+    \return void
+    */
+    void wake()
+    {
+        std::lock_guard<std::mutex> wakeGuard(_mx); // A receiver checks its flag under the lock, so can not miss this.
+        _messageReady.notify_all();
+    }
+
+private:
+    std::deque<connection_pointer> _ready; //!< Connections with messages, each listed once, guarded by _mx.
+    std::mutex _mx;
+    std::condition_variable _messageReady; //!< Signalled when a connection is listed or the inbox stops.
+    bool _stopping = false; //!< Set by stop, guarded by _mx.
 };
 
 
 
 
-class asyncServerTCP
+/*!
+    \class basic_asyncServerTCP
+    \brief Accepts clients, each a basic_asyncConnectionTCP framing messages with the Framing policy.
+    \sa asyncServerTCP
+*/
+template <typename Framing = DelimiterFraming>
+class basic_asyncServerTCP
 {
 
 private:
 
-    using connptr = boost::shared_ptr<asyncConnectionTCP>;
-    using weakptr = boost::weak_ptr<asyncConnectionTCP>;
+    typedef basic_asyncConnectionTCP<Framing> connection;
+    typedef basic_asyncServerInbox<Framing> inbox;
+    using connptr = typename connection::pointer;
 
     std::mutex _mx;
-    std::vector<weakptr> _registered;
+    SlotMap<connptr> _registered; //!< Live connections, removed as soon as they close, guarded by _mx.
 
     boost::asio::io_context& io_context_;
     tcp::acceptor acceptor_;
 
+    BufferLimits _limits; //!< Caps on each connection's receive buffer.
+    BufferCounters _counters; //!< What the caps have done, across all connections.
+    LaneLatency _latency; //!< How long messages waited to be written, by class, across all connections.
+
+    Framing _framing; //!< Copied by each connection.
+
+    std::shared_ptr<inbox> _inbox = std::make_shared<inbox>(); //!< Connections with messages, shared with their ready handlers.
+    std::shared_ptr<typename connection::pool> _pool; //!< Recycles connections once closed and released.
 
-    void reg_connection(weakptr wp) 
+    HeartbeatOptions _heartbeat; //!< Given to each connection.
+    TimerWheel _wheel; //!< Drives every connection's heartbeats, after _pool so destroyed first, releasing the connections it holds.
+
+    std::function<void(std::uint64_t)> _onClosed; //!< Told the id of each connection once it closes, guarded by _mx.
+
+
+    /*!
+    \fn reg_connection
+    \brief Register a connection, giving it its id. 
+    \return void
+    */
+    void reg_connection(connptr connection) 
     {
-        std::cout << "asyncServerTCP::reg_connection" << std::endl;
+        LOG_DEBUG("asyncServerTCP::reg_connection");
         std::lock_guard<std::mutex> lk(_mx);
-        _registered.push_back(wp);
+        connection->registered(_registered.Insert(connection).Pack());
         return;
     }
 
+    /*!
+    \fn unreg_connection
+    \brief Remove a connection that has closed, and tell the closed handler. 
+    \return void
+    */
+    void unreg_connection(const connptr& connection) 
+    {
+        LOG_DEBUG("asyncServerTCP::unreg_connection");
+        std::unique_lock<std::mutex> lk(_mx);
+        bool removed = _registered.Remove(SlotKey::Unpack(connection->id()));
+        std::function<void(std::uint64_t)> closed = _onClosed;
+        lk.unlock();
+
+        if (removed && closed)
+        {
+            closed(connection->id());
+        }
+        return;
+    }
+
+    /*!
+    \fn active_connections
+    \brief Gets the live connections. 
+    \return the connections.
+    */
+    std::vector<connptr> active_connections()
+    {
+        std::lock_guard<std::mutex> lk(_mx);
+        return std::vector<connptr>(_registered.begin(), _registered.end());
+    }
+
+    /*!
+    \fn registered
+    \brief Gets a live connection by id. 
+    \return the connection, or null if it has closed.
+    */
+    connptr registered(std::uint64_t id)
+    {
+        std::lock_guard<std::mutex> lk(_mx);
+        connptr* found = _registered.Get(SlotKey::Unpack(id));
+        return (found == nullptr) ? connptr() : *found;
+    }
+
     void start_accept()
     {
-        std::cout << "asyncServerTCP::start_accept" << std::endl;
-        asyncConnectionTCP::pointer new_connection = asyncConnectionTCP::create(io_context_);
+        LOG_DEBUG("asyncServerTCP::start_accept");
+        connptr new_connection = _pool->Acquire();
 
         acceptor_.async_accept(new_connection->socket(),
-            boost::bind(&asyncServerTCP::handle_accept, this, new_connection,
+            boost::bind(&basic_asyncServerTCP::handle_accept, this, new_connection,
             boost::asio::placeholders::error));
     }
 
-    void handle_accept(asyncConnectionTCP::pointer new_connection, const boost::system::error_code& error)
+    void handle_accept(connptr new_connection, const boost::system::error_code& error)
     {
-        std::cout << "asyncServerTCP::handle_accept" << std::endl;
+        LOG_DEBUG("asyncServerTCP::handle_accept");
         if (!error)
         {
-            auto weak = boost::weak_ptr<asyncConnectionTCP>(new_connection);
-
-            reg_connection(weak);
+            reg_connection(new_connection);
             new_connection->start();
+            if (_heartbeat.Enabled())
+            {
+                new_connection->start_heartbeat(_wheel, _heartbeat);
+            }
         }
 
         start_accept();
@@ -206,87 +756,238 @@ private:
 public:
 
 
-    asyncServerTCP(boost::asio::io_context& io_context, int port) : io_context_(io_context), acceptor_(io_context, tcp::endpoint(tcp::v4(), port))
+    /*!
+    \fn asyncServerTCP
+    \brief Start accepting clients.
+    \param limits caps on each connection's receive buffer.
+    \param framing how messages are framed.
+    \param heartbeat when each connection sends heartbeats and times out, off by default.
+    \return void
+    */
+    basic_asyncServerTCP(boost::asio::io_context& io_context, int port, BufferLimits limits = BufferLimits(), Framing framing = Framing(),
+        HeartbeatOptions heartbeat = HeartbeatOptions()) 
+        : io_context_(io_context), acceptor_(io_context, tcp::endpoint(tcp::v4(), port)), _limits(limits), _framing(framing),
+        _heartbeat(heartbeat), _wheel(io_context)
     {
-        std::cout << "asyncServerTCP::asyncServerTCP" << std::endl;
+        LOG_INFO("asyncServerTCP::asyncServerTCP");
+        std::shared_ptr<inbox> ready = _inbox;
+        _pool = connection::create_pool(io_context_, _limits, _counters, _latency,
+            [ready](const connptr& c) { ready->ready(c); },
+            [this](const connptr& c) { unreg_connection(c); },
+            _framing);
         start_accept();
     }
 
-    void send_all_async(std::string message)
+    ~basic_asyncServerTCP()
     {
-        std::cout << "asyncServerTCP::get_next_buffered_message" << std::endl;
-        std::string receivedMessage = "";
-        
-        std::vector<connptr> active;
+        _inbox->stop();
+    }
+
+    /*!
+    \fn send_all_async
+    \brief Send a message to every connection, sharing one copy of it. 
+    \param message moved into the shared copy, so never copied if given as an rvalue.
+    \param traffic the message's class.
+    \return void
+    */
+    void send_all_async(std::string message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        send_all_async(std::make_shared<const std::string>(std::move(message)), traffic);
+    }
+
+    /*!
+    \fn send_all_async
+    \brief Send a message shared with other senders to every connection, never copied. 
+    \param message left unchanged until written by every connection.
+    \param traffic the message's class.
+    \return void
+    */
+    void send_all_async(std::shared_ptr<const std::string> message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        LOG_TRACE("asyncServerTCP::send_all_async");
+        std::vector<connptr> active = active_connections();
+
+        for (auto& c : active) 
         {
-            std::lock_guard<std::mutex> lk(_mx);
-            for (auto& w : _registered)
-            {
-                if (auto c = w.lock())
-                {
-                    active.push_back(c);
-                }
-            }
+            c->send_message_async(message, traffic);
         }
+        return;
+    }
 
-        for (auto& connection : active) 
+    /*!
+    \fn send_async
+    \brief Send a message to one connection, e.g. a reply to what it sent. 
+    \param to the id of the connection, as given when receiving from it.
+    \param message moved to the connection, so never copied if given as an rvalue.
+    \param traffic the message's class.
+    \return false if the connection has closed.
+    */
+    bool send_async(std::uint64_t to, std::string message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        connptr c = registered(to);
+        if (!c)
         {
-            connection->send_message_async(message);
+            return false;
         }
-        return;
+
+        c->send_message_async(std::move(message), traffic);
+        return true;
     }
 
+    /*!
+    \fn send_async
+    \brief Send a message shared with other senders to one connection, never copied. 
+    \return false if the connection has closed.
+    */
+    bool send_async(std::uint64_t to, std::shared_ptr<const std::string> message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        connptr c = registered(to);
+        if (!c)
+        {
+            return false;
+        }
 
+        c->send_message_async(std::move(message), traffic);
+        return true;
+    }
 
-    std::string get_next_buffered_message()
+
+
+    /*!
+    \fn on_closed
+    \brief Tell a handler the id of each connection once it closes, e.g. to 
+           drop state kept for it. 
+    \param handler called on the io thread, once the id is no longer live.
+    \return void
+    */
+    void on_closed(std::function<void(std::uint64_t)> handler)
     {
-        std::cout << "asyncServerTCP::get_next_buffered_message" << std::endl;
-        std::string receivedMessage = "";
+        std::lock_guard<std::mutex> lk(_mx);
+        _onClosed = std::move(handler);
+    }
 
-        while (receivedMessage.length() == 0)
-        {
-            std::vector<connptr> active;
-            {
-                std::lock_guard<std::mutex> lk(_mx);
-                for (auto& w : _registered)
-                {
-                    if (auto c = w.lock())
-                    {
-                        active.push_back(c);
-                    }
-                }
-            }
+    /*!
+    \fn connected
+    \brief Returns if a connection is live. 
+    \param id the id of the connection, as given when receiving from it.
+    \return bool
+    */
+    bool connected(std::uint64_t id)
+    {
+        std::lock_guard<std::mutex> lk(_mx);
+        return _registered.Contains(SlotKey::Unpack(id));
+    }
 
-            for (auto& connection : active) 
-            {
-                int connectionBufferSize = connection->buffer_size();
+    /*!
+    \fn connection_count
+    \brief Gets the number of live connections. 
+    \return the count.
+    */
+    std::size_t connection_count()
+    {
+        std::lock_guard<std::mutex> lk(_mx);
+        return _registered.Size();
+    }
 
-                std::cout << "asyncServerTCP::get_next_buffered_message: Buffer Size: " << connectionBufferSize << std::endl;
+    /*!
+    \fn statistics
+    \brief Gets the receive buffer counters, and the data buffered, across all connections. 
+    \return The statistics.
+    */
+    BufferStatistics statistics()
+    {
+        std::vector<connptr> active = active_connections();
 
-                if (connectionBufferSize > 0)
-                {
-                    receivedMessage = connection->receive_message();
-                    std::cout << "asyncServerTCP::get_next_buffered_message: Received message: " << receivedMessage << std::endl;
-                }
+        std::size_t bytesHeld = 0;
+        std::size_t messagesHeld = 0;
+        for (auto& c : active) 
+        {
+            std::size_t bytes;
+            std::size_t messages;
+            c->buffered(bytes, messages);
+            bytesHeld += bytes;
+            messagesHeld += messages;
+        }
+        return _counters.Snapshot(bytesHeld, messagesHeld);
+    }
 
-            }
+    /*!
+    \fn latency
+    \brief Gets how long the messages of a class waited to be written, across all connections. 
+    \return The statistics.
+    */
+    LatencyStatistics latency(TrafficClass traffic)
+    {
+        return _latency.Snapshot(traffic);
+    }
 
-            if (receivedMessage.length() == 0)
-            {
-                std::this_thread::sleep_for (std::chrono::milliseconds(50));
-            }
+    /*!
+    \fn get_next_buffered_message
+    \brief Receive the next message from any connection, round-robin. 
+    \warning Blocks until a message is available.
+    \return the text received, or empty if the server is destroyed while waiting.
+    */
+    std::string get_next_buffered_message()
+    {
+        std::uint64_t from;
+        return get_next_buffered_message(from);
+    }
+
+    /*!
+    \fn get_next_buffered_message
+    \brief Receive the next message from any connection, round-robin. 
+    \param from set to the id of the connection it was received from.
+    \warning Blocks until a message is available.
+    \return the text received, or empty if the server is destroyed while waiting.
+    */
+    std::string get_next_buffered_message(std::uint64_t& from)
+    {
+        LOG_TRACE("asyncServerTCP::get_next_buffered_message");
+        std::string receivedMessage;
+
+        if (_inbox->receive(receivedMessage, from))
+        {
+            LOG_TRACE("asyncServerTCP::get_next_buffered_message: Received message: " << receivedMessage);
         }
 
         return receivedMessage;
     }
 
+    /*!
+    \fn get_next_buffered_message
+    \brief Receive the next message from any connection, round-robin, unless cancelled. 
+    \param from set to the id of the connection it was received from.
+    \param cancelled once set, and the receivers woken with wake_receivers, 
+           returns without taking a message.
+    \warning Blocks until a message is available or the receive is cancelled.
+    \return the text received, or empty if cancelled or the server is destroyed while waiting.
+    */
+    std::string get_next_buffered_message(std::uint64_t& from, const std::atomic<bool>& cancelled)
+    {
+        std::string receivedMessage;
+        _inbox->receive(receivedMessage, from, &cancelled);
+        return receivedMessage;
+    }
+
+    /*!
+    \fn wake_receivers
+    \brief Wake every waiting receiver, so those cancelled return. 
+    \return void
+    */
+    void wake_receivers()
+    {
+        _inbox->wake();
+    }
+
 
 };
 
+typedef basic_asyncServerTCP<> asyncServerTCP; //!< Messages ended by "\r\n".
+
 
 
 /*!
-    \class asyncServerTCPManager
+    \class basic_asyncServerTCPManager
     \brief Represents a management service for the server
 
     Responsability
@@ -298,29 +999,58 @@ public:
     Used by objects detecting where an object has been detected within a 2d plane. 
     \sa ServerTCP()
 */
-class asyncServerTCPManager
+template <typename Framing = DelimiterFraming>
+class basic_asyncServerTCPManager
 {
 private: 
-    asyncServerTCP *_server;  //!< TODO: The current server class.  
+    basic_asyncServerTCP<Framing> *_server;  //!< TODO: The current server class.  
     std::thread _threadStart; //!< Thread container for the Start method
     
     bool _healthy;  //!< Store if the server is healthy.  
     int _port;
+    BufferLimits _limits; //!< Caps on each connection's receive buffer.
+    Framing _framing; //!< Copied by each connection.
+    HeartbeatOptions _heartbeat; //!< When each connection sends heartbeats and times out.
+
+    std::mutex _closedMutex; //!< Guards _onClosed.
+    std::function<void(std::uint64_t)> _onClosed; //!< Told the id of each connection once it closes.
+
+    /*!
+    \fn closed
+    \brief Tell the closed handler, if any, a connection has closed. 
+    \return void
+    */
+    void closed(std::uint64_t id)
+    {
+        std::unique_lock<std::mutex> closedGuard(_closedMutex);
+        std::function<void(std::uint64_t)> handler = _onClosed;
+        closedGuard.unlock();
+
+        if (handler)
+        {
+            handler(id);
+        }
+    }
 
 public: 
     /*!
     \fn asyncServerTCPManager
     \brief A constructor for the connection manager class. 
+    \param limits caps on each connection's receive buffer, unlimited by default.
+    \param framing how messages are framed.
+    \param heartbeat when each connection sends heartbeats and times out, off by default.
     \return void
     */
-    asyncServerTCPManager(int port)
+    basic_asyncServerTCPManager(int port, BufferLimits limits = BufferLimits(), Framing framing = Framing(), HeartbeatOptions heartbeat = HeartbeatOptions())
+        : _framing(framing), _heartbeat(heartbeat)
     {        
-        std::cout << "asyncServerTCPManager::asyncServerTCPManager" << std::endl;
+        LOG_INFO("asyncServerTCPManager::asyncServerTCPManager");
 
         _healthy = true;
         _port = port;
-        std::cout << "main::createServer initialised." << std::endl;
-        _threadStart = std::thread(&asyncServerTCPManager::start, this);
+        _limits = limits;
+        LOG_INFO("main::createServer initialised.");
+        _threadStart = std::thread(&basic_asyncServerTCPManager::start, this);
         return;
     }
 
@@ -329,9 +1059,9 @@ public:
     \brief Clear up all pointers, lists and objects. 
     \return void
     */
-    ~asyncServerTCPManager()
+    ~basic_asyncServerTCPManager()
     {
-        std::cout << "asyncServerTCPManager::~asyncServerTCPManager" << std::endl;
+        LOG_INFO("asyncServerTCPManager::~asyncServerTCPManager");
         //_threadStart.~thread();
         //_server->~asyncServerTCP();
         _healthy = false;
@@ -344,28 +1074,88 @@ public:
     */
     void start()
     {
-        std::cout << "asyncServerTCPManager::start" << std::endl;
+        LOG_DEBUG("asyncServerTCPManager::start");
         boost::asio::io_context context;
-        asyncServerTCP server(context, _port);
+        basic_asyncServerTCP<Framing> server(context, _port, _limits, _framing, _heartbeat);
+        server.on_closed([this](std::uint64_t id) { closed(id); });
         _server = &(server);
         _healthy = true;
         context.run();
 
         //This will only run if the server fails....
         _healthy = false;
-        std::cout << "main::createServer SERVER FAILED." << std::endl;
+        LOG_ERROR("main::createServer SERVER FAILED.");
     }
 
     /*!
     \fn SendMessage
-    \brief Send a message to all connected clients. 
-    \param message the text desired to be sent to all connected parties.
+    \brief Send a message to all connected clients, sharing one copy of it. 
+    \param message the text desired to be sent to all connected parties, 
+           never copied if given as an rvalue.
+    \param traffic the message's class.
     \return void
     */
-    void send_all(std::string message)
+    void send_all(std::string message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        LOG_TRACE("asyncServerTCPManager::send_all");
+        _server->send_all_async(std::move(message), traffic);
+    }
+
+    /*!
+    \fn send_all
+    \brief Send a message shared with other senders to all connected clients, never copied. 
+    \return void
+    */
+    void send_all(std::shared_ptr<const std::string> message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        LOG_TRACE("asyncServerTCPManager::send_all");
+        _server->send_all_async(std::move(message), traffic);
+    }
+
+    /*!
+    \fn send_all
+    \brief Send a message given in several buffers to all connected clients, copied once. 
+    \param buffers the parts of the message, in order, only read during the call.
+    \return void
+    */
+    void send_all(const std::vector<boost::asio::const_buffer>& buffers, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        send_all(GatherMessage(buffers), traffic);
+    }
+
+    /*!
+    \fn send
+    \brief Send a message to one connected client. 
+    \param to the id of the connection, as given by receive.
+    \param message never copied if given as an rvalue.
+    \param traffic the message's class.
+    \return false if the connection has closed.
+    */
+    bool send(std::uint64_t to, std::string message, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        LOG_TRACE("asyncServerTCPManager::send");
+        return _server->send_async(to, std::move(message), traffic);
+    }
+
+    /*!
+    \fn send
+    \brief Send a message shared with other senders to one connected client, never copied. 
+    \return false if the connection has closed.
+    */
+    bool send(std::uint64_t to, std::shared_ptr<const std::string> message, TrafficClass traffic = TrafficClass::Bulk)
     {
-        std::cout << "asyncServerTCPManager::send_all" << std::endl;
-        _server->send_all_async(message);
+        LOG_TRACE("asyncServerTCPManager::send");
+        return _server->send_async(to, std::move(message), traffic);
+    }
+
+    /*!
+    \fn send
+    \brief Send a message given in several buffers to one connected client, copied once. 
+    \return false if the connection has closed.
+    */
+    bool send(std::uint64_t to, const std::vector<boost::asio::const_buffer>& buffers, TrafficClass traffic = TrafficClass::Bulk)
+    {
+        return send(to, GatherMessage(buffers), traffic);
     }
 
     /*!
@@ -375,10 +1165,86 @@ public:
     */
     std::string receive()
     {
-        std::cout << "asyncServerTCPManager::receive" << std::endl;
+        LOG_TRACE("asyncServerTCPManager::receive");
         return _server->get_next_buffered_message();
     }
 
+    /*!
+    \fn receive
+    \brief Receive a message from any connected client, round-robin. 
+    \param from set to the id of the connection it was received from.
+    \return the text received.
+    */
+    std::string receive(std::uint64_t& from)
+    {
+        LOG_TRACE("asyncServerTCPManager::receive");
+        return _server->get_next_buffered_message(from);
+    }
+
+    /*!
+    \fn receive
+    \brief Receive a message from any connected client, round-robin, unless cancelled. 
+    \param from set to the id of the connection it was received from.
+    \param cancelled once set, and the receivers woken with wake_receivers, 
+           returns without taking a message.
+    \return the text received, or empty if cancelled.
+    */
+    std::string receive(std::uint64_t& from, const std::atomic<bool>& cancelled)
+    {
+        return _server->get_next_buffered_message(from, cancelled);
+    }
+
+    /*!
+    \fn wake_receivers
+    \brief Wake every waiting receiver, so those cancelled return. 
+    \return void
+    */
+    void wake_receivers()
+    {
+        _server->wake_receivers();
+    }
+
+    /*!
+    \fn on_closed
+    \brief Tell a handler the id of each connection once it closes, see asyncServerTCP. 
+    \return void
+    */
+    void on_closed(std::function<void(std::uint64_t)> handler)
+    {
+        std::lock_guard<std::mutex> closedGuard(_closedMutex);
+        _onClosed = std::move(handler);
+    }
+
+    /*!
+    \fn connected
+    \brief Returns if a connection is live. 
+    \return bool
+    */
+    bool connected(std::uint64_t id)
+    {
+        return _server->connected(id);
+    }
+
+
+    /*!
+    \fn statistics
+    \brief Gets the receive buffer counters across all connections. 
+    \return The statistics.
+    */
+    BufferStatistics statistics()
+    {
+        return _server->statistics();
+    }
+
+    /*!
+    \fn latency
+    \brief Gets how long the messages of a class waited to be written, across all connections. 
+    \return The statistics.
+    */
+    LatencyStatistics latency(TrafficClass traffic)
+    {
+        return _server->latency(traffic);
+    }
 
     /*!
     \fn Healthy
@@ -393,4 +1259,6 @@ public:
 
 };
 
+typedef basic_asyncServerTCPManager<> asyncServerTCPManager; //!< Messages ended by "\r\n".
+
 #endif
\ No newline at end of file
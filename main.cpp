@@ -44,11 +44,30 @@
 
 #include <string>
 
+#include <boost/weak_ptr.hpp>
+
 #include "include/BOOST/ConnectionTCP.cpp"
 #include "include/BOOST/asyncClientTCP.cpp"
 #include "include/BOOST/asyncServerTCP.cpp"
+#include "include/BOOST/asyncRpcClientTCP.cpp"
+#include "include/BOOST/FanInClient.cpp"
+#include "include/BOOST/ChannelMux.cpp"
+
+#include <malloc.h>
+#include <filesystem>
 
 
+#if defined(TSAI_COUNT_ALLOCATIONS)
+// Counted by the replacement operator new of CountingAllocator.cpp, linked only into console-allocations.
+std::size_t AllocationCount();
+std::size_t ThreadAllocatedBytes();
+const bool allocationsCounted = true;
+#else
+std::size_t AllocationCount() { return 0; }
+std::size_t ThreadAllocatedBytes() { return 0; }
+const bool allocationsCounted = false; //!< The console keeps the default operator new.
+#endif
+
 void BoostServerExample()
 {
     const int port = 8000;
@@ -104,6 +123,39 @@ void BoostClientExample()
     }
 };
 
+int fanInClientExample(int argc, char* argv[])
+{
+    std::cout << "Running fanInClientExample." << std::endl;    
+
+    if (argc < 4)
+    {
+        std::cout << "Usage: console fanInClient <tag> <server>:<port> [<server>:<port>...]" << std::endl;
+        std::cout << "Example:" << std::endl;
+        std::cout << "  console fanInClient Vision 192.168.1.181:8000 192.168.1.182:8000" << std::endl;
+        return 1;
+    }
+
+    std::vector<SourceEndpoint> endpoints;
+    for (int i = 3; i < argc; i++)
+    {
+        std::string endpoint = argv[i];
+        std::size_t colon = endpoint.rfind(':');
+        endpoints.push_back({ endpoint.substr(0, colon), std::stoi(endpoint.substr(colon + 1)) });
+    }
+
+    FanInClient client(endpoints);
+    client.Subscribe(argv[2]);
+
+    SourcedFrame frame;
+    while (client.AwaitFrame(frame))
+    {
+        SourceStatistics statistics = client.Statistics(frame.source);
+        std::cout << "Tag received from " << statistics.endpoint.address << ":" << statistics.endpoint.port 
+                  << " of " << frame.frame.size() << " characters. Frames: " << statistics.framesReceived << std::endl;
+    }
+    return 0;
+}
+
 int asyncClientTCPManagerExample(int argc, char* argv[])
 {
     std::cout << "Running asycClientTCPExample." << std::endl;    
@@ -143,6 +195,41 @@ int asyncClientTCPManagerExample(int argc, char* argv[])
     return 0;
 }
 
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+boost::asio::awaitable<void> AwaitTagLoop(ConnectionClient& client, std::string tag)
+{
+    while (true)
+    {
+        std::string content = co_await client.next_tag(tag);
+        std::cout << "Tag " << tag << " received of " << content.size() << " characters." << std::endl;
+    }
+}
+
+int awaitableClientExample(int argc, char* argv[])
+{
+    std::cout << "Running awaitableClientExample." << std::endl;    
+
+    if (argc < 5)
+    {
+        std::cout << "Usage: console awaitableClient <server> <port> <tag> [<tag>...]" << std::endl;
+        std::cout << "Example:" << std::endl;
+        std::cout << "  console awaitableClient localhost 8000 Vision Phase" << std::endl;
+        return 1;
+    }
+
+    // One thread services every tag of the client.
+    boost::asio::io_context context;
+    ConnectionClient client(argv[2], std::stoi(argv[3]));
+
+    for (int i = 4; i < argc; i++)
+    {
+        boost::asio::co_spawn(context, AwaitTagLoop(client, argv[i]), boost::asio::detached);
+    }
+
+    context.run();
+    return 0;
+}
+#endif
 
 int asycServerTCPManagerExample(int argc, char* argv[])
 {
@@ -181,24 +268,1911 @@ int asycServerTCPManagerExample(int argc, char* argv[])
 }
 
 
-int asycServerTCP_read()
+/*!
+    \fn FeedVisionFrames
+    \brief Accept one connection on the port and write count Vision elements to it. 
+    \return void
+*/
+void FeedVisionFrames(int port, int count)
 {
-    while(true)
+    boost::asio::io_context context;
+    tcp::acceptor acceptor(context, tcp::endpoint(tcp::v4(), port));
+    tcp::socket socket(context);
+    acceptor.accept(socket);
+
+    std::string frames;
+    for (int i = 0; i < count; i++)
     {
-        
+        frames += "<Vision id=\"" + std::to_string(i) + "\"><Object x=\"1\" y=\"2\"/></Vision>";
     }
+    boost::asio::write(socket, boost::asio::buffer(frames));
+
+    char end;
+    boost::system::error_code ignored;
+    socket.read_some(boost::asio::buffer(&end, 1), ignored); // Hold open until the client goes.
 }
 
-int main(int argc, char* argv[])
+/*!
+    \fn TimeDrain
+    \brief Buffer count elements in a client, then time taking them in batches. 
+    \param batch the AwaitTags batch size, or 0 to loop over AwaitTag.
+    \return the time taken in microseconds.
+*/
+long TimeDrain(int port, int count, std::size_t batch)
 {
-    if (argc > 1)
+    std::thread feeder(FeedVisionFrames, port, count);
+    std::this_thread::sleep_for (std::chrono::milliseconds(100));
+
+    long elapsed;
     {
-        if (!strcmp(argv[1], "asyncClientTCPManager"))        {
-            return asyncClientTCPManagerExample(argc, argv);
+        ConnectionClient client("127.0.0.1", port);
+        client.Subscribe("Vision");
+        while (client.BufferSize() < count)
+        {
+            std::this_thread::sleep_for (std::chrono::milliseconds(10));
         }
-        else if (!strcmp(argv[1], "asycServerTCP"))        {
-            return asycServerTCPManagerExample(argc, argv);
+
+        auto start = std::chrono::steady_clock::now();
+        int taken = 0;
+        while (taken < count)
+        {
+            if (batch == 0)
+            {
+                client.AwaitTag("Vision");
+                taken++;
+            }
+            else
+            {
+                taken += client.AwaitTags("Vision", batch, std::chrono::milliseconds(100)).size();
+            }
+        }
+        elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    feeder.join();
+    return elapsed;
+}
+
+int benchmarkAwaitTags(int argc, char* argv[])
+{
+    const int port = 8001;
+    int count = (argc > 2) ? std::stoi(argv[2]) : 100000;
+    std::size_t batch = (argc > 3) ? std::stoi(argv[3]) : 64;
+
+    long single = TimeDrain(port, count, 0);
+    long batched = TimeDrain(port, count, batch);
+
+    std::cout << "benchmarkAwaitTags " << count << " elements." << std::endl;
+    std::cout << "  AwaitTag loop:        " << single << " us, " << (1000.0 * single / count) << " ns/element." << std::endl;
+    std::cout << "  AwaitTags batch " << batch << ": " << batched << " us, " << (1000.0 * batched / count) << " ns/element." << std::endl;
+    return 0;
+}
+
+/*!
+    \fn TimeParse
+    \brief Buffer count elements in a client, then time taking and parsing them. 
+    \param pooled if AwaitParsed is used, otherwise AwaitTag, a copy and a new document.
+    \return the time taken in microseconds.
+*/
+long TimeParse(int port, int count, bool pooled)
+{
+    std::thread feeder(FeedVisionFrames, port, count);
+    std::this_thread::sleep_for (std::chrono::milliseconds(100));
+
+    long elapsed;
+    long objects = 0;
+    {
+        ConnectionClient client("127.0.0.1", port);
+        if (pooled)
+        {
+            client.SubscribeParsed("Vision");
+        }
+        else
+        {
+            client.Subscribe("Vision");
+        }
+        while (client.BufferSize() < count)
+        {
+            std::this_thread::sleep_for (std::chrono::milliseconds(10));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; i++)
+        {
+            if (pooled)
+            {
+                PooledXml vision = client.AwaitParsed("Vision");
+                objects += (vision->Root()->first_node("Object") != nullptr);
+            }
+            else
+            {
+                std::string content = client.AwaitTag("Vision");
+                std::vector<char> text(content.begin(), content.end());
+                text.push_back('\0');
+                std::unique_ptr<rapidxml::xml_document<>> document(new rapidxml::xml_document<>());
+                document->parse<rapidxml::parse_default>(text.data());
+                objects += (document->first_node()->first_node("Object") != nullptr);
+            }
+        }
+        elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    feeder.join();
+    return (objects == count) ? elapsed : -1;
+}
+
+int benchmarkAwaitParsed(int argc, char* argv[])
+{
+    const int port = 8001;
+    int count = (argc > 2) ? std::stoi(argv[2]) : 100000;
+
+    long copied = TimeParse(port, count, false);
+    long pooled = TimeParse(port, count, true);
+
+    std::cout << "benchmarkAwaitParsed " << count << " elements." << std::endl;
+    std::cout << "  AwaitTag, copy and parse: " << copied << " us, " << (1000.0 * copied / count) << " ns/element." << std::endl;
+    std::cout << "  AwaitParsed:              " << pooled << " us, " << (1000.0 * pooled / count) << " ns/element." << std::endl;
+    return 0;
+}
+
+/*!
+    \fn TimeMutexQueue
+    \brief Time producers handing messages to consumers through a locked deque. 
+    \return the time taken in microseconds.
+*/
+long TimeMutexQueue(int producers, int consumers, int perProducer)
+{
+    const std::string message = "<Vision id=\"1\"><Object x=\"1\" y=\"2\"/></Vision>";
+    const int total = producers * perProducer;
+
+    std::deque<std::string> queue;
+    std::mutex queueMutex;
+    std::condition_variable queued;
+    std::atomic<int> taken{0};
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int p = 0; p < producers; p++)
+    {
+        threads.emplace_back([&]()
+        {
+            for (int i = 0; i < perProducer; i++)
+            {
+                std::unique_lock<std::mutex> pushGuard(queueMutex);
+                queue.push_back(message);
+                pushGuard.unlock();
+                queued.notify_one();
+            }
+        });
+    }
+    for (int c = 0; c < consumers; c++)
+    {
+        threads.emplace_back([&]()
+        {
+            std::string received;
+            while (taken < total)
+            {
+                std::unique_lock<std::mutex> popGuard(queueMutex);
+                if (queued.wait_for(popGuard, std::chrono::milliseconds(1), [&]() { return !queue.empty(); }))
+                {
+                    received = std::move(queue.front());
+                    queue.pop_front();
+                    taken++;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*!
+    \fn TimeRing
+    \brief Time producers handing messages to consumers through a ring, the 
+           consumers taking turns as its single consumer, as ReceiveQueue does. 
+    \return the time taken in microseconds.
+*/
+template <typename Ring>
+long TimeRing(int producers, int consumers, int perProducer)
+{
+    const std::string message = "<Vision id=\"1\"><Object x=\"1\" y=\"2\"/></Vision>";
+    const int total = producers * perProducer;
+
+    Ring ring(4096);
+    std::mutex consumerMutex;
+    std::atomic<int> taken{0};
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int p = 0; p < producers; p++)
+    {
+        threads.emplace_back([&]()
+        {
+            for (int i = 0; i < perProducer; i++)
+            {
+                while (!ring.TryPush([&message](std::string& slot) { slot.assign(message); }))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (int c = 0; c < consumers; c++)
+    {
+        threads.emplace_back([&]()
+        {
+            std::string received;
+            while (taken < total)
+            {
+                std::unique_lock<std::mutex> popGuard(consumerMutex);
+                if (ring.TryPop([&received](std::string& slot) { received.swap(slot); }))
+                {
+                    taken++;
+                }
+                else
+                {
+                    popGuard.unlock();
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+int benchmarkQueues(int argc, char* argv[])
+{
+    int producers = (argc > 2) ? std::stoi(argv[2]) : 4;
+    int consumers = (argc > 3) ? std::stoi(argv[3]) : 2;
+    int count = (argc > 4) ? std::stoi(argv[4]) : 1000000;
+
+    long lockedSingle = TimeMutexQueue(1, 1, count);
+    long spsc = TimeRing<SpscRing<std::string>>(1, 1, count);
+    long lockedMany = TimeMutexQueue(producers, consumers, count / producers);
+    long mpsc = TimeRing<MpscRing<std::string>>(producers, consumers, count / producers);
+
+    std::cout << "benchmarkQueues " << count << " messages." << std::endl;
+    std::cout << "  1 producer, 1 consumer, locked deque: " << lockedSingle << " us, " << (1000.0 * lockedSingle / count) << " ns/message." << std::endl;
+    std::cout << "  1 producer, 1 consumer, SpscRing:     " << spsc << " us, " << (1000.0 * spsc / count) << " ns/message." << std::endl;
+    std::cout << "  " << producers << " producers, " << consumers << " consumers, locked deque: " << lockedMany << " us, " << (1000.0 * lockedMany / count) << " ns/message." << std::endl;
+    std::cout << "  " << producers << " producers, " << consumers << " consumers, MpscRing:     " << mpsc << " us, " << (1000.0 * mpsc / count) << " ns/message." << std::endl;
+    return 0;
+}
+
+/*!
+    \fn TimeRegistry
+    \brief Time connect/disconnect cycles against a registry, broadcasting to 
+           the live connections every 100 cycles. 
+    \param slotMap if SlotMap is used, otherwise a never pruned vector of weak_ptr.
+    \param size set to the registry's final size.
+    \return the time taken in microseconds.
+*/
+long TimeRegistry(int cycles, bool slotMap, std::size_t& size)
+{
+    const std::size_t live = 64;
+    std::deque<std::pair<boost::shared_ptr<int>, SlotKey>> connections;
+    std::vector<boost::weak_ptr<int>> registered;
+    SlotMap<boost::shared_ptr<int>> slots;
+    long sent = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < cycles; i++)
+    {
+        boost::shared_ptr<int> connection(new int(i));
+        SlotKey key;
+        if (slotMap)
+        {
+            key = slots.Insert(connection);
+        }
+        else
+        {
+            registered.push_back(connection);
+        }
+        connections.emplace_back(connection, key);
+
+        if (connections.size() > live) // The oldest disconnects.
+        {
+            if (slotMap)
+            {
+                slots.Remove(connections.front().second);
+            }
+            connections.pop_front();
+        }
+
+        if (i % 100 == 0)
+        {
+            if (slotMap)
+            {
+                for (auto& c : slots)
+                {
+                    sent += *c;
+                }
+            }
+            else
+            {
+                for (auto& w : registered)
+                {
+                    if (auto c = w.lock())
+                    {
+                        sent += *c;
+                    }
+                }
+            }
+        }
+    }
+    long elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    size = slotMap ? slots.Slots() : registered.size();
+    return (sent > 0) ? elapsed : -1;
+}
+
+int benchmarkRegistry(int argc, char* argv[])
+{
+    int cycles = (argc > 2) ? std::stoi(argv[2]) : 100000;
+
+    std::size_t vectorSize;
+    std::size_t slotSize;
+    long vector = TimeRegistry(cycles, false, vectorSize);
+    long slots = TimeRegistry(cycles, true, slotSize);
+
+    std::cout << "benchmarkRegistry " << cycles << " connect/disconnect cycles, 64 live." << std::endl;
+    std::cout << "  vector<weak_ptr>: " << vector << " us, " << vectorSize << " entries." << std::endl;
+    std::cout << "  SlotMap:          " << slots << " us, " << slotSize << " slots." << std::endl;
+    return 0;
+}
+
+/*!
+    \fn TimeFrameReads
+    \brief Time the io thread's share of reading messages: each read leaves 
+           one message and the start of the next in a streambuf, and the 
+           message is taken and queued through an SpscRing, as the async 
+           read handlers do. 
+    \param view if the message is taken by its length from the streambuf's 
+           data into a reused string, otherwise through an istream into a new 
+           string, consuming everything buffered.
+    \param bytes set to the bytes taken.
+    \return the processor time taken in microseconds.
+*/
+long TimeFrameReads(int count, bool view, std::size_t& bytes)
+{
+    const std::string message = "<Vision id=\"1\"><Object x=\"1\" y=\"2\"/></Vision>\r\n";
+    const std::string next = "<Vision id=\"2\">";
+
+    boost::asio::streambuf response;
+    SpscRing<std::string> ring(1024);
+    std::string messageRead;
+    std::string received;
+    bytes = 0;
+
+    std::clock_t start = std::clock();
+    for (int i = 0; i < count; i++)
+    {
+        response.consume(response.size()); // Keep each read alike.
+        std::ostream(&response) << message << next;
+
+        if (view)
+        {
+            messageRead.assign(static_cast<const char*>(response.data().data()), message.size());
+            response.consume(message.size());
+        }
+        else
+        {
+            std::istream responseStream(&response);
+            std::string copy(std::istreambuf_iterator<char>(responseStream), {});
+            messageRead.swap(copy);
+        }
+
+        ring.TryPush([&messageRead](std::string& slot) { slot.swap(messageRead); });
+        ring.TryPop([&received](std::string& slot) { received.swap(slot); });
+        bytes += received.size();
+    }
+    return static_cast<long>((std::clock() - start) * 1000000.0 / CLOCKS_PER_SEC);
+}
+
+int benchmarkFrameReads(int argc, char* argv[])
+{
+    int count = (argc > 2) ? std::stoi(argv[2]) : 1000000;
+
+    std::size_t streamBytes;
+    std::size_t viewBytes;
+    long stream = TimeFrameReads(count, false, streamBytes);
+    long view = TimeFrameReads(count, true, viewBytes);
+
+    std::cout << "benchmarkFrameReads " << count << " messages, processor time." << std::endl;
+    std::cout << "  istream, whole buffer: " << stream << " us, " << (1000.0 * stream / count) << " ns/message, " << streamBytes << " bytes taken." << std::endl;
+    std::cout << "  length, one frame:     " << view << " us, " << (1000.0 * view / count) << " ns/message, " << viewBytes << " bytes taken." << std::endl;
+    return 0;
+}
+
+/*!
+    \fn CountAllocations
+    \brief Count the heap allocations made sending messages one way between an 
+           asyncClientTCP and an asyncConnectionTCP on one io_context, after a 
+           warm up long enough for every ring slot to hold a recycled string. 
+           Messages are built beforehand and received into a reused string, 
+           so only the library's allocations are counted. 
+    \param toServer if the client sends, otherwise the connection sends.
+    \return the allocations.
+*/
+std::size_t CountAllocations(boost::asio::io_context& io, asyncClientTCP& client, asyncConnectionTCP::pointer& connection, int count, bool toServer)
+{
+    const int warmUp = 5000;
+    std::vector<std::string> messages(warmUp + count, "<Vision id=\"1\"><Object x=\"1\" y=\"2\"/></Vision>\r\n");
+    std::string received;
+    std::size_t before = 0;
+
+    for (int i = 0; i < warmUp + count; i++)
+    {
+        if (i == warmUp)
+        {
+            before = AllocationCount();
+        }
+
+        if (toServer)
+        {
+            client.SendMessage(std::move(messages[i]));
+            while (!connection->try_receive_message(received))
+            {
+                io.run_one();
+            }
+        }
+        else
+        {
+            connection->send_message_async(std::move(messages[i]));
+            while (!client.TryReceiveMessage(received))
+            {
+                io.run_one();
+            }
+        }
+    }
+    return AllocationCount() - before;
+}
+
+int countAllocations(int argc, char* argv[])
+{
+    int count = (argc > 2) ? std::stoi(argv[2]) : 100000;
+    if (!allocationsCounted)
+    {
+        std::cout << "countAllocations counts through a replacement operator new, run: console-allocations countAllocations" << std::endl;
+        return 1;
+    }
+
+    boost::asio::io_context io;
+    tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    BufferCounters serverCounters;
+    BufferCounters clientCounters;
+    LaneLatency latency;
+
+    asyncConnectionTCP::pointer connection = asyncConnectionTCP::create(io, BufferLimits(), serverCounters, latency);
+    bool accepted = false;
+    acceptor.async_accept(connection->socket(), [&](const boost::system::error_code& error)
+    {
+        accepted = !error;
+        connection->start();
+    });
+    asyncClientTCP client(io, "127.0.0.1", std::to_string(acceptor.local_endpoint().port()), BufferLimits(), clientCounters, latency);
+    while (!accepted)
+    {
+        io.run_one();
+    }
+
+    std::size_t toServer = CountAllocations(io, client, connection, count, true);
+    std::size_t toClient = CountAllocations(io, client, connection, count, false);
+
+    std::cout << "countAllocations " << count << " messages each way, after warming up." << std::endl;
+    std::cout << "  client to server: " << toServer << " allocations, " << (double(toServer) / count) << " per message." << std::endl;
+    std::cout << "  server to client: " << toClient << " allocations, " << (double(toClient) / count) << " per message." << std::endl;
+    return 0;
+}
+
+/*!
+    \fn TimeReconnectStorm
+    \brief Accept waves of clients on one io_context, as after a network blip, 
+           then disconnect them all, the server's connections either drawn 
+           from a pool or created alone. The first wave warms up. 
+    \param pooled if the connections are drawn from a SlabPool.
+    \param latency set to the mean time from connecting to being accepted, in microseconds.
+    \param allocations set to the heap allocations per connection.
+    \return the time taken in microseconds.
+*/
+long TimeReconnectStorm(int waves, int clients, bool pooled, double& latency, double& allocations)
+{
+    boost::asio::io_context io;
+    auto work = boost::asio::make_work_guard(io); // So run_one never finds the io_context out of work, stopping it.
+    tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    tcp::endpoint endpoint = acceptor.local_endpoint();
+    BufferCounters counters;
+    LaneLatency lanes;
+    std::shared_ptr<asyncConnectionTCP::pool> pool = asyncConnectionTCP::create_pool(io, BufferLimits(), counters, lanes);
+
+    std::vector<asyncConnectionTCP::pointer> accepted;
+    std::vector<tcp::socket> sockets;
+    accepted.reserve(clients);
+    sockets.reserve(clients);
+
+    long accepting = 0;
+    std::size_t before = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int wave = 0; wave < waves; wave++)
+    {
+        if (wave == 1)
+        {
+            before = AllocationCount();
+            accepting = 0;
+            start = std::chrono::steady_clock::now();
+        }
+
+        for (int c = 0; c < clients; c++)
+        {
+            asyncConnectionTCP::pointer connection = pooled ? pool->Acquire() : asyncConnectionTCP::create(io, BufferLimits(), counters, lanes);
+            bool done = false;
+            auto connecting = std::chrono::steady_clock::now();
+            acceptor.async_accept(connection->socket(), [&done](const boost::system::error_code&) { done = true; });
+            sockets.emplace_back(io);
+            sockets.back().async_connect(endpoint, [](const boost::system::error_code&) {});
+            while (!done)
+            {
+                io.run_one();
+            }
+            accepting += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - connecting).count();
+
+            connection->start();
+            accepted.push_back(connection);
+        }
+
+        sockets.clear(); // Every client disconnects.
+        for (asyncConnectionTCP::pointer& connection : accepted)
+        {
+            while (connection->References() > 1) // Until its read fails.
+            {
+                io.run_one();
+            }
+        }
+        accepted.clear();
+    }
+    long elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    int measured = (waves - 1) * clients;
+    latency = double(accepting) / measured;
+    allocations = double(AllocationCount() - before) / measured;
+    return elapsed;
+}
+
+int benchmarkReconnectStorm(int argc, char* argv[])
+{
+    int waves = (argc > 2) ? std::stoi(argv[2]) : 20;
+    int clients = (argc > 3) ? std::stoi(argv[3]) : 200;
+
+    double createdLatency;
+    double createdAllocations;
+    double pooledLatency;
+    double pooledAllocations;
+    long created = TimeReconnectStorm(waves, clients, false, createdLatency, createdAllocations);
+    long pooled = TimeReconnectStorm(waves, clients, true, pooledLatency, pooledAllocations);
+
+    std::cout << "benchmarkReconnectStorm " << waves << " waves of " << clients << " clients." << std::endl;
+    std::cout << "  created alone: " << created << " us, " << createdLatency << " us to accept";
+    if (allocationsCounted)
+    {
+        std::cout << ", " << createdAllocations << " allocations per connection";
+    }
+    std::cout << "." << std::endl;
+    std::cout << "  SlabPool:      " << pooled << " us, " << pooledLatency << " us to accept";
+    if (allocationsCounted)
+    {
+        std::cout << ", " << pooledAllocations << " allocations per connection";
+    }
+    std::cout << "." << std::endl;
+    if (!allocationsCounted)
+    {
+        std::cout << "  Allocations are counted by console-allocations." << std::endl;
+    }
+    return 0;
+}
+
+/*!
+    \fn TimeRpc
+    \brief Make count calls, a window of them at a time, each window waiting 
+           for all its replies before the next is sent. 
+    \param window the calls in flight at once.
+    \return the time taken in microseconds.
+*/
+long TimeRpc(asyncRpcClientTCP& rpc, int count, int window)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int sent = 0; sent < count; sent += window)
+    {
+        std::vector<std::future<std::string>> replies;
+        for (int i = sent; (i < sent + window) && (i < count); i++)
+        {
+            replies.push_back(rpc.async_call("ping " + std::to_string(i), boost::asio::use_future));
+        }
+        for (std::future<std::string>& reply : replies)
+        {
+            reply.get();
+        }
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+int benchmarkRpc(int argc, char* argv[])
+{
+    int count = (argc > 2) ? std::stoi(argv[2]) : 2000;
+    int window = (argc > 3) ? std::stoi(argv[3]) : 64;
+    const int port = 8002;
+
+    try
+    {
+        // The managers run until the process exits.
+        asyncServerTCPManager* server = new asyncServerTCPManager(port);
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        std::thread responder([server]()
+        {
+            while (true)
+            {
+                std::uint64_t from;
+                std::string request = server->receive(from);
+                server->send(from, RpcEnvelope::Reply(request, "pong"));
+            }
+        });
+        responder.detach();
+
+        asyncClientTCPManager* client = new asyncClientTCPManager("127.0.0.1", port);
+        asyncRpcClientTCP rpc(*client, std::chrono::seconds(1));
+        while (true) // Until connected.
+        {
+            try
+            {
+                rpc.call("ping");
+                break;
+            }
+            catch (boost::system::system_error&)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+
+        long sequential = TimeRpc(rpc, count, 1);
+        long pipelined = TimeRpc(rpc, count, window);
+        RpcStatistics statistics = rpc.statistics();
+
+        std::cout << "benchmarkRpc " << count << " calls." << std::endl;
+        std::cout << "  one in flight:  " << sequential << " us, " << (count * 1000000.0 / sequential) << " calls/s." << std::endl;
+        std::cout << "  " << window << " in flight: " << pipelined << " us, " << (count * 1000000.0 / pipelined) << " calls/s." << std::endl;
+        std::cout << "  " << statistics.replies << " replies, " << statistics.timeouts << " timeouts, " << statistics.late << " late." << std::endl;
+    }
+    catch (std::exception& e)
+    {
+        std::cout << "Exception: " << e.what() << "\n";
+    }
+    return 0;
+}
+
+/*!
+    \class EmulatedLink
+    \brief Forwards connections from one port to another through an emulated 
+           long path: each way, at most window bytes are carried per delay, as 
+           a TCP connection limited by its congestion window. 
+*/
+class EmulatedLink
+{
+public:
+    EmulatedLink(boost::asio::io_context& io, int port, int target, std::chrono::milliseconds delay, std::size_t window)
+        : _io(io), _acceptor(io, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), port)),
+        _target(boost::asio::ip::make_address("127.0.0.1"), target), _delay(delay), _window(window)
+    {
+        Accept();
+    }
+
+private:
+
+    /*!
+        \struct Session
+        \brief A connection and its forwarded connection, pumped each way.
+    */
+    struct Session : std::enable_shared_from_this<Session>
+    {
+        tcp::socket client;
+        tcp::socket server;
+        boost::asio::steady_timer upTimer;
+        boost::asio::steady_timer downTimer;
+        std::vector<char> up;
+        std::vector<char> down;
+        std::chrono::milliseconds delay;
+
+        Session(boost::asio::io_context& io, std::chrono::milliseconds delay, std::size_t window)
+            : client(io), server(io), upTimer(io), downTimer(io), up(window), down(window), delay(delay)
+        {
+        }
+
+        void Pump(tcp::socket& from, tcp::socket& to, std::vector<char>& buffer, boost::asio::steady_timer& timer)
+        {
+            auto self = shared_from_this();
+            from.async_read_some(boost::asio::buffer(buffer), [this, self, &from, &to, &buffer, &timer](const boost::system::error_code& error, std::size_t length)
+            {
+                if (error)
+                {
+                    Close();
+                    return;
+                }
+                timer.expires_after(delay);
+                timer.async_wait([this, self, &from, &to, &buffer, &timer, length](const boost::system::error_code&)
+                {
+                    boost::asio::async_write(to, boost::asio::buffer(buffer.data(), length), [this, self, &from, &to, &buffer, &timer](const boost::system::error_code& error, std::size_t)
+                    {
+                        if (error)
+                        {
+                            Close();
+                            return;
+                        }
+                        Pump(from, to, buffer, timer);
+                    });
+                });
+            });
+        }
+
+        void Close()
+        {
+            boost::system::error_code ignored;
+            client.close(ignored);
+            server.close(ignored);
+        }
+    };
+
+    void Accept()
+    {
+        auto session = std::make_shared<Session>(_io, _delay, _window);
+        _acceptor.async_accept(session->client, [this, session](const boost::system::error_code& error)
+        {
+            if (!error)
+            {
+                session->server.async_connect(_target, [session](const boost::system::error_code& error)
+                {
+                    if (error)
+                    {
+                        session->Close();
+                        return;
+                    }
+                    session->Pump(session->client, session->server, session->up, session->upTimer);
+                    session->Pump(session->server, session->client, session->down, session->downTimer);
+                });
+            }
+            Accept();
+        });
+    }
+
+    boost::asio::io_context& _io;
+    tcp::acceptor _acceptor;
+    tcp::endpoint _target;
+    std::chrono::milliseconds _delay; //!< Added to every window carried.
+    std::size_t _window; //!< The most bytes carried per delay, each way.
+};
+
+/*!
+    \fn TimeStripedUpload
+    \brief Upload count lines through the link with a new manager, timing until 
+           the server has received them all. 
+    \param stripes the connections the manager keeps.
+    \param keyed if each line is sent by its detector's key, otherwise to the 
+           stripe with the fewest bytes queued.
+    \return the time taken in microseconds.
+*/
+long TimeStripedUpload(int linkPort, std::atomic<int>& received, std::size_t stripes, bool keyed, int count, const std::string& line)
+{
+    // The manager runs until the process exits.
+    asyncClientTCPManager* client = new asyncClientTCPManager("127.0.0.1", linkPort, BufferLimits(), ReconnectBackoff(), DelimiterFraming(), stripes);
+    std::this_thread::sleep_for(std::chrono::seconds(1)); // Connected through the link.
+
+    int before = received;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+    {
+        if (keyed)
+        {
+            client->send("detector" + std::to_string(i % 16), line);
+        }
+        else
+        {
+            client->send(line);
+        }
+    }
+    while (received - before < count)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+int benchmarkStripes(int argc, char* argv[])
+{
+    int count = (argc > 2) ? std::stoi(argv[2]) : 2000;
+    std::size_t stripes = (argc > 3) ? std::stoul(argv[3]) : 4;
+    const int serverPort = 8003;
+    const int linkPort = 8004;
+    const std::chrono::milliseconds delay(20);
+    const std::size_t window = 16 * 1024;
+    const std::string line(1024, 'd'); // A detection log line.
+
+    // The server runs until the process exits.
+    asyncServerTCPManager* server = new asyncServerTCPManager(serverPort);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    std::atomic<int> received{0};
+    std::thread receiver([server, &received]()
+    {
+        while (true)
+        {
+            server->receive();
+            received++;
+        }
+    });
+    receiver.detach();
+
+    boost::asio::io_context io;
+    EmulatedLink link(io, linkPort, serverPort, delay, window);
+    std::thread linkThread([&io]() { io.run(); });
+
+    long single = TimeStripedUpload(linkPort, received, 1, false, count, line);
+    long leastQueued = TimeStripedUpload(linkPort, received, stripes, false, count, line);
+    long keyed = TimeStripedUpload(linkPort, received, stripes, true, count, line);
+
+    std::cout << "benchmarkStripes " << count << " lines of " << line.size() << " bytes, over a link carrying " 
+        << window << " bytes per " << delay.count() << " ms each connection." << std::endl;
+    std::cout << "  1 stripe:                 " << single << " us, " << (count * line.size() / (single / 1000.0)) << " KB/s." << std::endl;
+    std::cout << "  " << stripes << " stripes, least queued: " << leastQueued << " us, " << (count * line.size() / (leastQueued / 1000.0)) << " KB/s." << std::endl;
+    std::cout << "  " << stripes << " stripes, by key:        " << keyed << " us, " << (count * line.size() / (keyed / 1000.0)) << " KB/s." << std::endl;
+
+    io.stop();
+    linkThread.join();
+    return 0;
+}
+
+/*!
+    \fn TimeConnect
+    \brief Connect to the first of the endpoints to answer, either one at a 
+           time, as before, or staggered, giving up after a time limit. 
+    \param staggered if attempts are staggered, otherwise each waits for the last to fail.
+    \return the time taken in milliseconds, or the limit if not connected.
+*/
+long TimeConnect(const EndpointCache::Endpoints& endpoints, bool staggered, std::chrono::milliseconds limit)
+{
+    boost::asio::io_context io;
+    tcp::socket socket(io);
+    bool connected = false;
+    auto start = std::chrono::steady_clock::now();
+
+    if (staggered)
+    {
+        AsyncConnectStaggered(socket, endpoints, EndpointCache::ConnectionAttemptDelay,
+            [&connected](const boost::system::error_code& error, const tcp::endpoint&) { connected = !error; });
+    }
+    else
+    {
+        boost::asio::async_connect(socket, endpoints,
+            [&connected](const boost::system::error_code& error, const tcp::endpoint&) { connected = !error; });
+    }
+    io.run_for(limit);
+
+    if (!connected)
+    {
+        return limit.count();
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+int benchmarkConnect(int argc, char* argv[])
+{
+    int lookups = (argc > 2) ? std::stoi(argv[2]) : 1000;
+    const std::chrono::milliseconds limit(5000);
+
+    // An endpoint that never answers: a listener whose backlog is full drops further SYNs.
+    boost::asio::io_context io;
+    tcp::acceptor unanswered(io, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    unanswered.listen(0);
+    std::vector<std::unique_ptr<tcp::socket>> filling;
+    for (int i = 0; i < 4; i++)
+    {
+        filling.emplace_back(new tcp::socket(io));
+        filling.back()->async_connect(unanswered.local_endpoint(), [](const boost::system::error_code&) {});
+    }
+    io.run_for(std::chrono::milliseconds(200));
+
+    tcp::acceptor listening(io, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    EndpointCache::Endpoints endpoints = { unanswered.local_endpoint(), listening.local_endpoint() };
+
+    long sequential = TimeConnect(endpoints, false, limit);
+    long staggered = TimeConnect(endpoints, true, limit);
+
+    std::shared_ptr<EndpointCache> cache = EndpointCache::Create();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < lookups; i++)
+    {
+        boost::asio::io_context resolving;
+        tcp::resolver resolver(resolving);
+        resolver.resolve("localhost", "8000");
+    }
+    long resolved = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < lookups; i++)
+    {
+        cache->Resolve("localhost", "8000");
+    }
+    long cached = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "benchmarkConnect to an endpoint that never answers, then one that does." << std::endl;
+    std::cout << "  one at a time: " << sequential << " ms" << ((sequential >= limit.count()) ? ", gave up." : ".") << std::endl;
+    std::cout << "  staggered:     " << staggered << " ms." << std::endl;
+    std::cout << "benchmarkConnect " << lookups << " lookups of localhost." << std::endl;
+    std::cout << "  resolved:      " << (double(resolved) / lookups) << " us each." << std::endl;
+    std::cout << "  EndpointCache: " << (double(cached) / lookups) << " us each, " << cache->Misses() << " resolved." << std::endl;
+    return 0;
+}
+
+/*!
+    \fn TimeLanes
+    \brief Flood bulk lines through the link with a new manager, sending a 
+           control message every few milliseconds meanwhile, until the server 
+           has received them all. 
+    \param traffic the class the control messages are sent as.
+    \param control set to how long the control messages waited to be written.
+    \param bulk set to how long the bulk lines waited to be written.
+    \return the time taken in microseconds.
+*/
+long TimeLanes(int linkPort, std::atomic<int>& received, TrafficClass traffic, int count, const std::string& line, LatencyStatistics& control, LatencyStatistics& bulk)
+{
+    // The manager runs until the process exits.
+    asyncClientTCPManager* client = new asyncClientTCPManager("127.0.0.1", linkPort);
+    std::this_thread::sleep_for(std::chrono::seconds(1)); // Connected through the link.
+
+    int before = received;
+    int controls = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+    {
+        client->send(line);
+    }
+    while (received - before < count + controls)
+    {
+        if (controls < 100)
+        {
+            client->send("<Preempt phase=\"" + std::to_string(controls % 8) + "\"/>", traffic);
+            controls++;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    long taken = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    control = client->latency(traffic);
+    bulk = client->latency(TrafficClass::Bulk);
+    if (traffic == TrafficClass::Bulk)
+    {
+        control = LatencyStatistics(); // Not told apart from the bulk lines.
+    }
+    return taken;
+}
+
+int benchmarkLanes(int argc, char* argv[])
+{
+    int count = (argc > 2) ? std::stoi(argv[2]) : 2000;
+    const int serverPort = 8005;
+    const int linkPort = 8006;
+    const std::chrono::milliseconds delay(10);
+    const std::size_t window = 256 * 1024;
+    const std::string line(16 * 1024, 'd'); // A detection frame.
+
+    // The server runs until the process exits.
+    asyncServerTCPManager* server = new asyncServerTCPManager(serverPort);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    std::atomic<int> received{0};
+    std::thread receiver([server, &received]()
+    {
+        while (true)
+        {
+            server->receive();
+            received++;
+        }
+    });
+    receiver.detach();
+
+    boost::asio::io_context io;
+    EmulatedLink link(io, linkPort, serverPort, delay, window);
+    std::thread linkThread([&io]() { io.run(); });
+
+    LatencyStatistics sharedControl;
+    LatencyStatistics sharedBulk;
+    LatencyStatistics control;
+    LatencyStatistics bulk;
+    long shared = TimeLanes(linkPort, received, TrafficClass::Bulk, count, line, sharedControl, sharedBulk);
+    long laned = TimeLanes(linkPort, received, TrafficClass::Control, count, line, control, bulk);
+
+    std::cout << "benchmarkLanes " << count << " lines of " << line.size() << " bytes, and 100 control messages, over a link carrying " 
+        << window << " bytes per " << delay.count() << " ms." << std::endl;
+    std::cout << "  one queue:  " << shared << " us, every message waited p99 " << sharedBulk.p99Microseconds << " us, max " 
+        << sharedBulk.maxMicroseconds << " us, mean " << sharedBulk.meanMicroseconds << " us." << std::endl;
+    std::cout << "  two lanes:  " << laned << " us, control waited p99 " << control.p99Microseconds << " us, max " 
+        << control.maxMicroseconds << " us, mean " << control.meanMicroseconds << " us." << std::endl;
+    std::cout << "              bulk waited p99 " << bulk.p99Microseconds << " us, max " << bulk.maxMicroseconds 
+        << " us, mean " << bulk.meanMicroseconds << " us." << std::endl;
+
+    io.stop();
+    linkThread.join();
+    return 0;
+}
+
+/*!
+    \fn ProcessFootprint
+    \brief Gets the heap in use, and the threads running, in this process.
+    \return void
+*/
+void ProcessFootprint(std::size_t& heapBytes, std::size_t& threads)
+{
+    heapBytes = mallinfo2().uordblks;
+    threads = 0;
+    for (const auto& task : std::filesystem::directory_iterator("/proc/self/task"))
+    {
+        (void)task;
+        threads++;
+    }
+}
+
+int benchmarkChannels(int argc, char* argv[])
+{
+    int flood = (argc > 2) ? std::stoi(argv[2]) : 1000;
+    const int pings = 100;
+    const int separatePort = 8007;
+    const int channelPort = 8008;
+    const std::uint16_t detections = 1;
+    const std::uint16_t health = 2;
+
+    // The servers and clients run until the process exits.
+    asyncServerTCPManager* separateServer = new asyncServerTCPManager(separatePort);
+    basic_asyncServerTCPManager<LengthPrefixFraming>* channelServer = new basic_asyncServerTCPManager<LengthPrefixFraming>(channelPort);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    basic_asyncChannelServerTCP<LengthPrefixFraming>* channels = new basic_asyncChannelServerTCP<LengthPrefixFraming>(*channelServer);
+    channels->handle(health, [channels](std::uint64_t from, std::string& message)
+    {
+        channels->send(from, health, std::move(message), TrafficClass::Control);
+    });
+    // Detections are never taken, as by a stalled consumer.
+    (void)separateServer;
+
+    std::size_t heapBefore, threadsBefore, heapSeparate, threadsSeparate, heapChannels, threadsChannels;
+    ProcessFootprint(heapBefore, threadsBefore);
+    for (int i = 0; i < 3; i++)
+    {
+        new asyncClientTCPManager("127.0.0.1", separatePort);
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    ProcessFootprint(heapSeparate, threadsSeparate);
+
+    basic_asyncClientTCPManager<LengthPrefixFraming>* connection = new basic_asyncClientTCPManager<LengthPrefixFraming>("127.0.0.1", channelPort);
+    basic_asyncChannelClientTCP<LengthPrefixFraming>* client = new basic_asyncChannelClientTCP<LengthPrefixFraming>(*connection);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    ProcessFootprint(heapChannels, threadsChannels);
+
+    const std::string frame(16 * 1024, 'd');
+    for (int i = 0; i < flood; i++)
+    {
+        client->send(detections, frame);
+    }
+
+    long longest = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < pings; i++)
+    {
+        auto sent = std::chrono::steady_clock::now();
+        client->send(health, "<Health seq=\"" + std::to_string(i) + "\"/>", TrafficClass::Control);
+        client->receive(health);
+        longest = std::max<long>(longest, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sent).count());
+    }
+    long taken = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    ChannelStatistics flooded = client->statistics(detections);
+
+    std::cout << "benchmarkChannels detections, health and configuration to one server." << std::endl;
+    std::cout << "  3 connections: " << (threadsSeparate - threadsBefore) << " threads, " << ((heapSeparate - heapBefore) / 1024) << " KB of heap, both ends." << std::endl;
+    std::cout << "  3 channels:    " << (threadsChannels - threadsSeparate) << " threads, " << ((heapChannels - heapSeparate) / 1024) << " KB of heap, both ends." << std::endl;
+    std::cout << "benchmarkChannels " << flood << " detections of " << frame.size() << " bytes never taken by the server, then " << pings << " health pings." << std::endl;
+    std::cout << "  health round trip: mean " << (taken / pings) << " us, max " << longest << " us." << std::endl;
+    std::cout << "  detections sent " << flooded.sent << ", held by the client for credit " << flooded.waiting << "." << std::endl;
+    return 0;
+}
+
+/*!
+    \fn TimeSilentPeer
+    \brief Accept one connection on a port, never answer it, and wait for the 
+           client to give up on it.
+    \return the microseconds from accepting to the client closing, or -1.
+*/
+long TimeSilentPeer(boost::asio::ip::tcp::acceptor& acceptor)
+{
+    boost::asio::ip::tcp::socket socket(acceptor.get_executor());
+    acceptor.accept(socket);
+    auto accepted = std::chrono::steady_clock::now();
+
+    char discard[512];
+    boost::system::error_code error;
+    while (!error)
+    {
+        socket.read_some(boost::asio::buffer(discard), error); // Heartbeats, until the client closes.
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - accepted).count();
+}
+
+int benchmarkHeartbeats(int argc, char* argv[])
+{
+    int connections = (argc > 2) ? std::stoi(argv[2]) : 10000;
+    const int reads = 1000000;
+    const int serverPort = 8009;
+    const int asyncPort = 8010;
+    const int blockingPort = 8011;
+    HeartbeatOptions heartbeat;
+    heartbeat.interval = std::chrono::milliseconds(200);
+    heartbeat.timeout = std::chrono::seconds(1);
+
+    // Idle deadlines, each read moving its connection's deadline.
+    boost::asio::io_context io;
+    std::vector<std::unique_ptr<boost::asio::steady_timer>> timers;
+    for (int i = 0; i < connections; i++)
+    {
+        timers.emplace_back(new boost::asio::steady_timer(io));
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < reads; i++)
+    {
+        boost::asio::steady_timer& timer = *timers[i % connections];
+        timer.expires_after(heartbeat.timeout); // Cancels the last wait.
+        timer.async_wait([](const boost::system::error_code&) {});
+        if ((i % connections) == connections - 1)
+        {
+            io.poll(); // Completes the cancelled waits.
+        }
+    }
+    io.poll();
+    long rearmed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    for (auto& timer : timers)
+    {
+        timer->cancel();
+    }
+    io.poll();
+
+    TimerWheel wheel(io);
+    std::vector<std::chrono::steady_clock::time_point> lastRead(connections, std::chrono::steady_clock::now());
+    for (int i = 0; i < connections; i++)
+    {
+        wheel.Schedule(heartbeat.timeout, []() {});
+    }
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < reads; i++)
+    {
+        lastRead[i % connections] = std::chrono::steady_clock::now();
+        if ((i % connections) == connections - 1)
+        {
+            io.poll();
+        }
+    }
+    io.poll();
+    long lazy = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    wheel.Stop();
+    io.poll();
+
+    // The server runs until the process exits.
+    basic_asyncServerTCPManager<>* server = new basic_asyncServerTCPManager<>(serverPort, BufferLimits(), DelimiterFraming(), heartbeat);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    (void)server;
+    long serverDetected = -1;
+    {
+        boost::asio::io_context rawIo;
+        boost::asio::ip::tcp::socket raw(rawIo);
+        raw.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), serverPort));
+        auto connected = std::chrono::steady_clock::now();
+        char discard[512];
+        boost::system::error_code error;
+        while (!error)
+        {
+            raw.read_some(boost::asio::buffer(discard), error); // Heartbeats, until the server closes.
+        }
+        serverDetected = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - connected).count();
+    }
+
+    // The clients run until the process exits, each reconnecting to its own silent port.
+    boost::asio::io_context silentIo;
+    boost::asio::ip::tcp::acceptor asyncAcceptor(silentIo, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), asyncPort));
+    boost::asio::ip::tcp::acceptor blockingAcceptor(silentIo, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), blockingPort));
+    new asyncClientTCPManager("127.0.0.1", asyncPort, BufferLimits(), ReconnectBackoff(), DelimiterFraming(), 1, heartbeat);
+    long asyncDetected = TimeSilentPeer(asyncAcceptor);
+    new ConnectionClient("127.0.0.1", blockingPort, BufferLimits(), ReconnectBackoff(), false, heartbeat);
+    long blockingDetected = TimeSilentPeer(blockingAcceptor);
+
+    std::cout << "benchmarkHeartbeats " << reads << " reads across " << connections << " connections, each moving an idle deadline." << std::endl;
+    std::cout << "  steady_timer per connection: " << rearmed << " us, " << (rearmed * 1000.0 / reads) << " ns per read." << std::endl;
+    std::cout << "  timer wheel, lazy deadline:  " << lazy << " us, " << (lazy * 1000.0 / reads) << " ns per read." << std::endl;
+    std::cout << "benchmarkHeartbeats a silent peer, with heartbeats every " << heartbeat.interval.count() << " ms and a timeout of " 
+        << heartbeat.timeout.count() << " ms, ticks of " << wheel.Tick().count() << " ms." << std::endl;
+    std::cout << "  basic_asyncServerTCP closed it after " << (serverDetected / 1000) << " ms." << std::endl;
+    std::cout << "  asyncClientTCP closed it after       " << (asyncDetected / 1000) << " ms." << std::endl;
+    std::cout << "  ConnectionClient closed it after     " << (blockingDetected / 1000) << " ms." << std::endl;
+    return 0;
+}
+
+/*!
+    \fn checkReceiveQueueLimits
+    \brief Check a ReceiveQueue applies its drop policy, rather than pausing 
+           reading, at message caps on either side of a power of two, the 
+           ring's own size.
+    \return 0 if every cap dropped the messages over it without pausing.
+*/
+int checkReceiveQueueLimits(int argc, char* argv[])
+{
+    const std::size_t pushes = 10;
+    bool passed = true;
+    std::cout << "checkReceiveQueueLimits pushing " << pushes << " messages." << std::endl;
+    for (OverflowPolicy policy : { OverflowPolicy::DropOldest, OverflowPolicy::DropNewest })
+    {
+        for (std::size_t cap : { 3, 4, 5, 8 })
+        {
+            BufferLimits limits;
+            limits.maxMessages = cap;
+            limits.policy = policy;
+            BufferCounters counters;
+            ReceiveQueue queue(limits, counters);
+
+            bool paused = false;
+            for (std::size_t i = 0; i < pushes; i++)
+            {
+                std::string message = "<Vision id=\"" + std::to_string(i) + "\"/>";
+                paused |= !queue.Push(message);
+            }
+
+            BufferStatistics statistics = queue.Statistics();
+            std::uint64_t dropped = statistics.messagesDroppedOldest + statistics.messagesDroppedNewest;
+            bool correct = !paused && (statistics.messagesHeld == cap) && (dropped == pushes - cap);
+            passed &= correct;
+            std::cout << "  " << ((policy == OverflowPolicy::DropOldest) ? "DropOldest" : "DropNewest") << " cap " << cap 
+                << ": held " << statistics.messagesHeld << ", dropped " << dropped << (paused ? ", paused" : "") 
+                << (correct ? "" : " FAILED") << std::endl;
+        }
+    }
+    std::cout << "checkReceiveQueueLimits " << (passed ? "passed" : "FAILED") << "." << std::endl;
+    return passed ? 0 : 1;
+}
+
+/*!
+    \fn checkSendQueueOverflow
+    \brief Check messages sent beyond a SendQueue's capacity wait rather than 
+           being dropped, both pushed from several threads into a small queue 
+           and sent in a burst by an asyncClientTCPManager.
+    \return 0 if every message was taken, or received, once and in order.
+*/
+int checkSendQueueOverflow(int argc, char* argv[])
+{
+    const std::size_t capacity = 16;
+    const std::size_t producers = 4;
+    const std::size_t pushes = 1000;
+    const int port = 8021;
+    const std::size_t burst = 50000;
+
+    LaneLatency latency;
+    SendQueue queue(latency, capacity);
+    std::vector<std::thread> threads;
+    for (std::size_t producer = 0; producer < producers; producer++)
+    {
+        threads.emplace_back([&queue, producer, pushes]()
+        {
+            for (std::size_t i = 0; i < pushes; i++)
+            {
+                OutboundMessage message;
+                message.message = std::to_string(producer) + ":" + std::to_string(i);
+                message.traffic = (i % 10 == 0) ? TrafficClass::Control : TrafficClass::Bulk;
+                bool start;
+                queue.Push(message, start);
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    std::size_t overflowed = queue.Overflowed();
+
+    std::vector<std::size_t> next(producers * 2, 0); // The next number expected, per producer and class.
+    std::size_t taken = 0;
+    bool queueInOrder = true;
+    std::vector<OutboundMessage> batch;
+    while (queue.Take(batch))
+    {
+        for (OutboundMessage& message : batch)
+        {
+            std::size_t colon = message.message.find(':');
+            std::size_t producer = std::stoul(message.message.substr(0, colon));
+            std::size_t i = std::stoul(message.message.substr(colon + 1));
+            std::size_t& expected = next[producer * 2 + ((message.traffic == TrafficClass::Control) ? 0 : 1)];
+            while ((expected % 10 == 0) != (message.traffic == TrafficClass::Control))
+            {
+                expected++; // Skip the other class's numbers.
+            }
+            queueInOrder &= (i == expected);
+            expected = i + 1;
+            taken++;
+        }
+        queue.Written(batch);
+    }
+    bool queuePassed = queueInOrder && (taken == producers * pushes) && (overflowed > 0);
+
+    boost::asio::io_context rawIo;
+    boost::asio::ip::tcp::acceptor acceptor(rawIo, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port));
+    asyncClientTCPManager* client = new asyncClientTCPManager("127.0.0.1", port); // Runs until the process exits.
+    boost::asio::ip::tcp::socket accepted(rawIo);
+    acceptor.accept(accepted);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    for (std::size_t i = 0; i < burst; i++)
+    {
+        client->send(std::to_string(i));
+    }
+
+    std::string received;
+    std::size_t lines = 0;
+    std::size_t expected = 0;
+    bool burstInOrder = true;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    char buffer[65536];
+    while ((lines < burst) && (std::chrono::steady_clock::now() < deadline))
+    {
+        boost::system::error_code error;
+        if (accepted.available(error) == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10)); // Lost messages never arrive, so do not block.
+            continue;
+        }
+        received.append(buffer, accepted.read_some(boost::asio::buffer(buffer), error));
+        if (error)
+        {
+            break;
+        }
+
+        std::size_t head = 0;
+        std::size_t end;
+        while ((end = received.find("\r\n", head)) != std::string::npos)
+        {
+            burstInOrder &= (received.compare(head, end - head, std::to_string(expected)) == 0);
+            expected++;
+            lines++;
+            head = end + 2;
+        }
+        received.erase(0, head);
+    }
+    bool burstPassed = burstInOrder && (lines == burst);
+
+    bool passed = queuePassed && burstPassed;
+    std::cout << "checkSendQueueOverflow " << (passed ? "passed" : "FAILED") << "." << std::endl;
+    std::cout << "  " << producers << " threads pushed " << (producers * pushes) << " into a queue of " << capacity << ", " << overflowed 
+        << " overflowed, taken " << taken << (queueInOrder ? ", in order." : ", OUT OF ORDER.") << std::endl;
+    std::cout << "  asyncClientTCPManager sent a burst of " << burst << ", received " << lines << (burstInOrder ? ", in order." : ", OUT OF ORDER.") << std::endl;
+    (void)client;
+    return passed ? 0 : 1;
+}
+
+/*!
+    \fn ReadFor
+    \brief Read whatever arrives on a socket for a while.
+    \return the bytes read.
+*/
+std::string ReadFor(boost::asio::ip::tcp::socket& socket, std::chrono::milliseconds wait)
+{
+    std::this_thread::sleep_for(wait);
+    std::string received;
+    char buffer[4096];
+    boost::system::error_code error;
+    while (socket.available(error) > 0)
+    {
+        received.append(buffer, socket.read_some(boost::asio::buffer(buffer), error));
+    }
+    return received;
+}
+
+/*!
+    \fn checkResume
+    \brief Check a ServerTCP with a resume history sends messages unchanged 
+           to a client that does not resume, once its grace period has ended, 
+           and replays missed messages with their markers to one that does.
+    \return 0 if both clients received what they should.
+*/
+int checkResume(int argc, char* argv[])
+{
+    const int port = 8017;
+    const std::chrono::milliseconds wait(200);
+
+    // The server runs until the process exits.
+    boost::asio::io_context* io = new boost::asio::io_context();
+    ServerTCP* server = new ServerTCP(*io, port, 100);
+    std::thread([io]() { io->run(); }).detach();
+    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::make_address("127.0.0.1"), port);
+
+    boost::asio::io_context rawIo;
+    boost::asio::ip::tcp::socket plain(rawIo);
+    plain.connect(endpoint);
+    std::this_thread::sleep_for(wait);
+    for (int i = 1; i <= 3; i++)
+    {
+        server->SendMessage("<Vision id=\"" + std::to_string(i) + "\"/>");
+    }
+    std::string plainReceived = ReadFor(plain, wait);
+
+    boost::asio::ip::tcp::socket resuming(rawIo);
+    resuming.connect(endpoint);
+    boost::asio::write(resuming, boost::asio::buffer(std::string("<Resume seq=\"1\"/>")));
+    std::this_thread::sleep_for(wait);
+    server->SendMessage("<Vision id=\"4\"/>");
+    std::string resumingReceived = ReadFor(resuming, wait);
+
+    bool passed = (plainReceived == "<Vision id=\"1\"/><Vision id=\"2\"/><Vision id=\"3\"/>")
+        && (resumingReceived == "<Vision id=\"2\"/><Seq n=\"2\"/><Vision id=\"3\"/><Seq n=\"3\"/><Vision id=\"4\"/><Seq n=\"4\"/>");
+    std::cout << "checkResume " << (passed ? "passed" : "FAILED") << "." << std::endl;
+    std::cout << "  not resuming received: " << plainReceived << std::endl;
+    std::cout << "  resuming from 1 received: " << resumingReceived << std::endl;
+    return passed ? 0 : 1;
+}
+
+/*!
+    \fn TakeSequenced
+    \brief Check the messages received by a resuming client, up to the last 
+           marker, are each followed by their marker and follow on from the 
+           last received, as a client discards anything after the last marker.
+    \param data the bytes received.
+    \param last the last sequence number received, 0 if none, updated.
+    \param count incremented for each message.
+    \return false if a message is out of order, repeated or unmarked.
+*/
+bool TakeSequenced(const std::string& data, std::uint64_t& last, std::size_t& count)
+{
+    const std::string open = "<Vision id=\"";
+    std::size_t at = 0;
+    while ((at = data.find(open, at)) != std::string::npos)
+    {
+        std::size_t end = data.find("\"/>", at);
+        if (end == std::string::npos)
+        {
+            break;
+        }
+        std::string id = data.substr(at + open.size(), end - at - open.size());
+        std::string marker = "<Seq n=\"" + id + "\"/>";
+        if (data.compare(end + 3, marker.size(), marker) != 0)
+        {
+            return (data.find("<Seq", end) == std::string::npos); // Only the unmarked tail may lack a marker.
+        }
+
+        std::uint64_t sequence = std::stoull(id);
+        if ((last != 0) && (sequence != last + 1))
+        {
+            return false;
+        }
+        last = sequence;
+        count++;
+        at = end + 3 + marker.size();
+    }
+    return true;
+}
+
+/*!
+    \fn checkResumeOrder
+    \brief Check a client reconnecting while messages are sent continuously 
+           receives every message once and in order, its resume request 
+           arriving after messages sent since it connected, and that a client 
+           that does not resume receives every message unchanged.
+    \return 0 if both clients received every message in order.
+*/
+int checkResumeOrder(int argc, char* argv[])
+{
+    const int port = 8020;
+    const int reconnections = 5;
+    const std::chrono::milliseconds requestDelay(20); // Within ServerTCP::ResumeGracePeriod.
+
+    // The server runs until the process exits.
+    boost::asio::io_context* io = new boost::asio::io_context();
+    ServerTCP* server = new ServerTCP(*io, port, 10000);
+    std::thread([io]() { io->run(); }).detach();
+    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::make_address("127.0.0.1"), port);
+
+    boost::asio::io_context rawIo;
+    boost::asio::ip::tcp::socket plain(rawIo);
+    plain.connect(endpoint);
+
+    std::atomic<bool> sending{true};
+    std::thread sender([server, &sending]()
+    {
+        for (std::uint64_t id = 1; sending; id++)
+        {
+            server->SendMessage("<Vision id=\"" + std::to_string(id) + "\"/>");
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    bool resumedInOrder = true;
+    std::uint64_t last = 0;
+    std::size_t resumedCount = 0;
+    for (int i = 0; i < reconnections; i++)
+    {
+        boost::asio::ip::tcp::socket resuming(rawIo);
+        resuming.connect(endpoint);
+        std::this_thread::sleep_for(requestDelay);
+        boost::asio::write(resuming, boost::asio::buffer("<Resume seq=\"" + std::to_string(last) + "\"/>"));
+        resumedInOrder &= TakeSequenced(ReadFor(resuming, std::chrono::milliseconds(100)), last, resumedCount);
+    }
+
+    sending = false;
+    sender.join();
+
+    std::string plainReceived = ReadFor(plain, ServerTCP::ResumeGracePeriod * 2);
+    bool plainInOrder = (plainReceived.find("<Seq") == std::string::npos);
+    std::uint64_t plainLast = 0;
+    std::size_t plainCount = 0;
+    for (std::size_t at = 0; plainInOrder && ((at = plainReceived.find("<Vision id=\"", at)) != std::string::npos); at++)
+    {
+        std::uint64_t sequence = std::stoull(plainReceived.substr(at + 12));
+        plainInOrder = (plainLast == 0) || (sequence == plainLast + 1);
+        plainLast = sequence;
+        plainCount++;
+    }
+
+    bool passed = resumedInOrder && (resumedCount > 0) && plainInOrder && (plainCount > 0);
+    std::cout << "checkResumeOrder " << (passed ? "passed" : "FAILED") << "." << std::endl;
+    std::cout << "  resuming over " << reconnections << " connections received " << resumedCount << " messages, to " << last
+        << (resumedInOrder ? ", in order." : ", OUT OF ORDER or repeated.") << std::endl;
+    std::cout << "  not resuming received " << plainCount << " messages, to " << plainLast
+        << (plainInOrder ? ", in order." : ", OUT OF ORDER or marked.") << std::endl;
+    return passed ? 0 : 1;
+}
+
+/*!
+    \fn checkManagerShutdown
+    \brief Check short-lived asyncClientTCPManagers are destroyed cleanly, 
+           striped and connected, with an RPC client over one, and while 
+           waiting to reconnect to a server that is not there.
+    \return 0 once every manager is destroyed, rather than terminating.
+*/
+int checkManagerShutdown(int argc, char* argv[])
+{
+    const int serverPort = 8018;
+    const int absentPort = 8019;
+
+    // The server runs until the process exits.
+    asyncServerTCPManager* server = new asyncServerTCPManager(serverPort);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    (void)server;
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        asyncClientTCPManager striped("127.0.0.1", serverPort, BufferLimits(), ReconnectBackoff(), DelimiterFraming(), 2);
+        asyncClientTCPManager absent("127.0.0.1", absentPort);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        {
+            asyncRpcClientTCP rpc(striped);
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+    }
+    long destroyed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "checkManagerShutdown passed, managers destroyed " << destroyed << " ms after construction." << std::endl;
+    return 0;
+}
+
+/*!
+    \fn checkChannelShutdown
+    \brief Check an asyncChannelServerTCP drops the channels of a client once 
+           it disconnects, and joins its thread when destroyed, while its 
+           manager is still receiving.
+    \return 0 if the peer was dropped and the server destroyed.
+*/
+int checkChannelShutdown(int argc, char* argv[])
+{
+    const int serverPort = 8022;
+    const std::uint16_t echo = 1;
+
+    // The manager runs until the process exits.
+    basic_asyncServerTCPManager<LengthPrefixFraming>* server = new basic_asyncServerTCPManager<LengthPrefixFraming>(serverPort);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    bool echoed = false;
+    std::size_t peersConnected = 0;
+    std::size_t peersClosed = 0;
+    auto start = std::chrono::steady_clock::now();
+    {
+        basic_asyncChannelServerTCP<LengthPrefixFraming> channels(*server);
+        channels.handle(echo, [&channels](std::uint64_t from, std::string& message)
+        {
+            channels.send(from, echo, std::move(message), TrafficClass::Control);
+        });
+
+        {
+            basic_asyncClientTCPManager<LengthPrefixFraming> connection("127.0.0.1", serverPort);
+            basic_asyncChannelClientTCP<LengthPrefixFraming> client(connection);
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            client.send(echo, "<Echo/>", TrafficClass::Control);
+            echoed = (client.receive(echo) == "<Echo/>");
+            peersConnected = channels.peers();
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (channels.peers() != 0 && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        peersClosed = channels.peers();
+    }
+    long destroyed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    bool passed = echoed && (peersConnected == 1) && (peersClosed == 0);
+    std::cout << "checkChannelShutdown " << (passed ? "passed" : "FAILED") << ", server destroyed " << destroyed << " ms after construction." << std::endl;
+    std::cout << "  echoed " << (echoed ? "yes" : "no") << ", peers while connected " << peersConnected
+        << ", after disconnecting " << peersClosed << "." << std::endl;
+    return passed ? 0 : 1;
+}
+
+/*!
+    \fn checkHeartbeatFraming
+    \brief Check heartbeats are discarded, not received, under the default 
+           DelimiterFraming, which keeps the delimiter in each message.
+    \return 0 if both the async client and server discarded the heartbeat.
+*/
+int checkHeartbeatFraming(int argc, char* argv[])
+{
+    const int clientPort = 8015;
+    const int serverPort = 8016;
+    const std::string framed = "<Heartbeat/>\r\nhello\r\n";
+    HeartbeatOptions heartbeat;
+    heartbeat.timeout = std::chrono::seconds(5);
+
+    // The client and server run until the process exits.
+    boost::asio::io_context rawIo;
+    boost::asio::ip::tcp::acceptor acceptor(rawIo, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), clientPort));
+    asyncClientTCPManager* client = new asyncClientTCPManager("127.0.0.1", clientPort, BufferLimits(), ReconnectBackoff(), DelimiterFraming(), 1, heartbeat);
+    boost::asio::ip::tcp::socket accepted(rawIo);
+    acceptor.accept(accepted);
+    boost::asio::write(accepted, boost::asio::buffer(framed));
+    std::string clientReceived = client->receive();
+
+    basic_asyncServerTCPManager<>* server = new basic_asyncServerTCPManager<>(serverPort, BufferLimits(), DelimiterFraming(), heartbeat);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    boost::asio::ip::tcp::socket connected(rawIo);
+    connected.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), serverPort));
+    boost::asio::write(connected, boost::asio::buffer(framed));
+    std::string serverReceived = server->receive();
+
+    bool passed = (clientReceived == "hello\r\n") && (serverReceived == "hello\r\n");
+    std::cout << "checkHeartbeatFraming " << (passed ? "passed" : "FAILED") << "." << std::endl;
+    std::cout << "  asyncClientTCPManager received first: " << clientReceived.substr(0, clientReceived.find('\r')) << std::endl;
+    std::cout << "  asyncServerTCPManager received first: " << serverReceived.substr(0, serverReceived.find('\r')) << std::endl;
+    return passed ? 0 : 1;
+}
+
+/*!
+    \fn CopiesSending
+    \brief Send a frame, counting the copies of it made by the sending thread, 
+           as the bytes it allocates over the frame's size.
+    \param send sends the frame, given as an rvalue.
+    \return the copies.
+*/
+double CopiesSending(std::size_t size, const std::function<void(std::string&&)>& send)
+{
+    std::string frame(size, 'v');
+    std::size_t before = ThreadAllocatedBytes();
+    send(std::move(frame));
+    return double(ThreadAllocatedBytes() - before) / size;
+}
+
+int benchmarkSendCopies(int argc, char* argv[])
+{
+    std::size_t size = (argc > 2) ? std::stoul(argv[2]) : 100 * 1024;
+    if (!allocationsCounted)
+    {
+        std::cout << "benchmarkSendCopies counts through a replacement operator new, run: console-allocations benchmarkSendCopies" << std::endl;
+        return 1;
+    }
+    const int lineServerPort = 8012;
+    const int prefixServerPort = 8013;
+    const int connectionPort = 8014;
+    const int subscribers = 4;
+
+    // The servers and clients run until the process exits.
+    asyncServerTCPManager* lineServer = new asyncServerTCPManager(lineServerPort);
+    basic_asyncServerTCPManager<LengthPrefixFraming>* prefixServer = new basic_asyncServerTCPManager<LengthPrefixFraming>(prefixServerPort);
+    ConnectionManager* connectionServer = new ConnectionManager(connectionPort);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    asyncClientTCPManager* lineClient = new asyncClientTCPManager("127.0.0.1", lineServerPort);
+    basic_asyncClientTCPManager<LengthPrefixFraming>* prefixClient = new basic_asyncClientTCPManager<LengthPrefixFraming>("127.0.0.1", prefixServerPort);
+    for (int i = 0; i < subscribers; i++)
+    {
+        new asyncClientTCPManager("127.0.0.1", lineServerPort);
+        new ConnectionClient("127.0.0.1", connectionPort);
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    const std::string header = "<Vision detector=\"7\">";
+    const std::string trailer = "</Vision>";
+
+    double delimited = CopiesSending(size, [&](std::string&& frame) { lineClient->send(std::move(frame)); });
+    double prefixed = CopiesSending(size, [&](std::string&& frame) { prefixClient->send(std::move(frame)); });
+    double shared = CopiesSending(size, [&](std::string&& frame)
+    {
+        lineClient->send(std::make_shared<const std::string>(std::move(frame)));
+    });
+    double gathered = CopiesSending(size, [&](std::string&& frame)
+    {
+        lineClient->send(std::vector<boost::asio::const_buffer>{ boost::asio::buffer(header), boost::asio::buffer(frame), boost::asio::buffer(trailer) });
+    });
+    double broadcast = CopiesSending(size, [&](std::string&& frame) { lineServer->send_all(std::move(frame)); });
+    double connections = CopiesSending(size, [&](std::string&& frame) { connectionServer->SendMessage(std::move(frame)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500)); // Until the frames have arrived, so their logging is done.
+
+    std::cout << "benchmarkSendCopies copies of a " << size << " byte frame made sending it." << std::endl;
+    std::cout << "  asyncClientTCPManager::send, delimited:        " << delimited << std::endl;
+    std::cout << "  asyncClientTCPManager::send, length prefixed:  " << prefixed << std::endl;
+    std::cout << "  asyncClientTCPManager::send, shared:           " << shared << std::endl;
+    std::cout << "  asyncClientTCPManager::send, gathered:         " << gathered << std::endl;
+    std::cout << "  asyncServerTCPManager::send_all, " << subscribers << " clients:  " << broadcast << std::endl;
+    std::cout << "  ConnectionManager::SendMessage, " << subscribers << " clients:   " << connections << std::endl;
+    (void)prefixServer;
+    return 0;
+}
+
+/*!
+    \fn TimeLogging
+    \brief Time a log call made in batches of half a thread's buffer, writing 
+           each batch out between them, so no record is dropped.
+    \param log makes one call.
+    \return the nanoseconds per call.
+*/
+double TimeLogging(int count, const std::function<void(int)>& log)
+{
+    const int batch = static_cast<int>(Logger::RecordsPerThread / 2);
+    std::chrono::steady_clock::duration elapsed{0};
+    for (int done = 0; done < count; done += batch)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = done; i < done + batch; i++)
+        {
+            log(i);
+        }
+        elapsed += std::chrono::steady_clock::now() - start;
+        Logger::Instance().Flush();
+    }
+    return double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / count;
+}
+
+int benchmarkLogging(int argc, char* argv[])
+{
+    int count = (argc > 2) ? std::stoi(argv[2]) : 1000000;
+    const std::string address = "127.0.0.1";
+    const int port = 8000;
+
+    std::ofstream discard("/dev/null");
+    Logger& logger = Logger::Instance();
+    LogLevel level = Logger::Level();
+    logger.SetOutput(discard);
+    Logger::SetLevel(LogLevel::Info);
+
+    double disabled = TimeLogging(count, [&](int i)
+    {
+        LOG_TRACE("asyncConnectionTCP::handle_read " << address << ":" << port << " message " << i);
+    });
+    double enabled = TimeLogging(count, [&](int i)
+    {
+        LOG_INFO("asyncConnectionTCP::handle_read " << address << ":" << port << " message " << i);
+    });
+    double direct = TimeLogging(count, [&](int i)
+    {
+        discard << "asyncConnectionTCP::handle_read " << address << ":" << port << " message " << i << std::endl;
+    });
+    LogStatistics statistics = logger.Statistics();
+
+    logger.SetOutput(std::cout);
+    Logger::SetLevel(level);
+
+    std::cout << "benchmarkLogging nanoseconds per line logged, over " << count << " lines." << std::endl;
+    std::cout << "  LOG_TRACE, level disabled:       " << disabled << std::endl;
+    std::cout << "  LOG_INFO, to the thread's ring:  " << enabled << std::endl;
+    std::cout << "  std::ostream << std::endl:       " << direct << std::endl;
+    std::cout << "  Written: " << statistics.written << ", dropped: " << statistics.dropped << std::endl;
+    return 0;
+}
+
+int asycServerTCP_read()
+{
+    while(true)
+    {
+        
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1)
+    {
+        if (!strcmp(argv[1], "asyncClientTCPManager"))        {
+            return asyncClientTCPManagerExample(argc, argv);
+        }
+        else if (!strcmp(argv[1], "asycServerTCP"))        {
+            return asycServerTCPManagerExample(argc, argv);
+        }
+        else if (!strcmp(argv[1], "fanInClient"))        {
+            return fanInClientExample(argc, argv);
+        }
+        else if (!strcmp(argv[1], "benchmarkAwaitTags"))        {
+            return benchmarkAwaitTags(argc, argv);
+        }
+        else if (!strcmp(argv[1], "benchmarkAwaitParsed"))        {
+            return benchmarkAwaitParsed(argc, argv);
+        }
+        else if (!strcmp(argv[1], "benchmarkQueues"))        {
+            return benchmarkQueues(argc, argv);
+        }
+        else if (!strcmp(argv[1], "benchmarkRegistry"))        {
+            return benchmarkRegistry(argc, argv);
+        }
+        else if (!strcmp(argv[1], "benchmarkFrameReads"))        {
+            return benchmarkFrameReads(argc, argv);
+        }
+        else if (!strcmp(argv[1], "countAllocations"))        {
+            return countAllocations(argc, argv);
+        }
+        else if (!strcmp(argv[1], "benchmarkReconnectStorm"))        {
+            return benchmarkReconnectStorm(argc, argv);
+        }
+        else if (!strcmp(argv[1], "benchmarkRpc"))        {
+            return benchmarkRpc(argc, argv);
+        }
+        else if (!strcmp(argv[1], "benchmarkStripes"))        {
+            return benchmarkStripes(argc, argv);
+        }
+        else if (!strcmp(argv[1], "benchmarkConnect"))        {
+            return benchmarkConnect(argc, argv);
+        }
+        else if (!strcmp(argv[1], "benchmarkLanes"))        {
+            return benchmarkLanes(argc, argv);
+        }
+        else if (!strcmp(argv[1], "benchmarkChannels"))        {
+            return benchmarkChannels(argc, argv);
+        }
+        else if (!strcmp(argv[1], "benchmarkHeartbeats"))        {
+            return benchmarkHeartbeats(argc, argv);
+        }
+        else if (!strcmp(argv[1], "checkReceiveQueueLimits"))        {
+            return checkReceiveQueueLimits(argc, argv);
+        }
+        else if (!strcmp(argv[1], "checkSendQueueOverflow"))        {
+            return checkSendQueueOverflow(argc, argv);
+        }
+        else if (!strcmp(argv[1], "checkResume"))        {
+            return checkResume(argc, argv);
+        }
+        else if (!strcmp(argv[1], "checkResumeOrder"))        {
+            return checkResumeOrder(argc, argv);
+        }
+        else if (!strcmp(argv[1], "checkManagerShutdown"))        {
+            return checkManagerShutdown(argc, argv);
+        }
+        else if (!strcmp(argv[1], "checkChannelShutdown"))        {
+            return checkChannelShutdown(argc, argv);
+        }
+        else if (!strcmp(argv[1], "checkHeartbeatFraming"))        {
+            return checkHeartbeatFraming(argc, argv);
+        }
+        else if (!strcmp(argv[1], "benchmarkSendCopies"))        {
+            return benchmarkSendCopies(argc, argv);
+        }
+        else if (!strcmp(argv[1], "benchmarkLogging"))        {
+            return benchmarkLogging(argc, argv);
+        }
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+        else if (!strcmp(argv[1], "awaitableClient"))        {
+            return awaitableClientExample(argc, argv);
         }
+#endif
     }
     else if (argc == 1)
     {